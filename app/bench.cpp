@@ -0,0 +1,297 @@
+// Replays a corpus through AsyncService and reports throughput and latency as JSON, for every combination of the
+// configurations to sweep. Requests arrive open-loop: their arrival times are drawn up front from a Poisson process,
+// and latency counts from the arrival time, so a backlog that builds up while the service is saturated shows up in
+// the latency instead of slowing down the arrivals.
+//
+// Usage:
+//
+//   bergamot-bench --model-config-paths config.yml --input corpus.txt --rate 20 --workers 1 2 4 --html 0 1
+//   bergamot-bench --model-config-paths config.yml --input long-sentences.txt --wrap-mode fixed balanced
+//
+// Every line of the input is one request. Everything runs offline, with the local model files of the config. Besides
+// throughput and latency, every run reports how full its batches were and how much of them was padding, which is
+// where settings that change the length of sentences, like wrap-mode, show their effect.
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _MSC_VER
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "translator/parser.h"
+#include "translator/response.h"
+#include "translator/response_options.h"
+#include "translator/service.h"
+#include "translator/utils.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+struct BenchConfig {
+  std::string modelConfigPath;
+  std::string input;                ///< Corpus to replay, one request per line. Read from stdin if empty.
+  size_t requests{0};               ///< Requests to send, cycling through the corpus. 0 sends every line once.
+  double rate{0.0};                 ///< Mean arrival rate in requests per second. 0 sends all requests at once.
+  size_t concurrency{0};            ///< Maximum number of requests in flight. 0 means no limit.
+  unsigned int seed{42};            ///< Seed for the arrival times.
+  std::vector<size_t> workers{1};   ///< Values of `--cpu-threads` to sweep.
+  std::vector<int> miniBatchWords;  ///< Values of `mini-batch-words` to sweep. Empty keeps the one of the model config.
+  std::vector<size_t> cacheSizes{0};
+  std::vector<int> html{0};  ///< Whether to wrap every request in HTML markup and translate it as HTML.
+  std::vector<std::string> wrapModes;  ///< Values of `wrap-mode` to sweep. Empty keeps the one of the model config.
+};
+
+/// Outcome of a run with one combination of settings.
+struct RunResult {
+  double seconds{0.0};
+  size_t sentences{0};
+  size_t words{0};
+  std::vector<double> latencies;  ///< Per request, in seconds.
+  BatchingMetrics batching;       ///< Of the model, at the end of the run.
+};
+
+size_t countWords(const std::string &line) {
+  std::istringstream stream(line);
+  size_t count = 0;
+  for (std::string word; stream >> word;) ++count;
+  return count;
+}
+
+double percentile(const std::vector<double> &sorted, double p) {
+  if (sorted.empty()) return 0.0;
+  size_t index = std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()));
+  return sorted[index];
+}
+
+RunResult run(const BenchConfig &bench, const std::vector<std::string> &corpus, size_t workers, int miniBatchWords,
+              size_t cacheSize, bool html, const std::string &wrapMode) {
+  AsyncService::Config serviceConfig;
+  serviceConfig.numWorkers = workers;
+  serviceConfig.cacheSize = cacheSize;
+  AsyncService service(serviceConfig);
+
+  auto options = parseOptionsFromFilePath(bench.modelConfigPath);
+  if (miniBatchWords > 0) {
+    options->set("mini-batch-words", miniBatchWords);
+  }
+  if (!wrapMode.empty()) {
+    options->set("wrap-mode", wrapMode);
+  }
+  std::shared_ptr<TranslationModel> model = service.createCompatibleModel(options);
+
+  ResponseOptions responseOptions;
+  responseOptions.HTML = html;
+
+  // Arrival times, relative to the start of the run.
+  size_t numRequests = bench.requests > 0 ? bench.requests : corpus.size();
+  std::vector<Clock::duration> arrivals(numRequests, Clock::duration::zero());
+  if (bench.rate > 0.0) {
+    std::mt19937 generator(bench.seed);
+    std::exponential_distribution<double> interArrival(bench.rate);
+    std::chrono::duration<double> elapsed(0.0);
+    for (auto &arrival : arrivals) {
+      elapsed += std::chrono::duration<double>(interArrival(generator));
+      arrival = std::chrono::duration_cast<Clock::duration>(elapsed);
+    }
+  }
+
+  RunResult result;
+  result.latencies.resize(numRequests);
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  size_t inFlight = 0, completed = 0;
+
+  Clock::time_point start = Clock::now();
+  for (size_t i = 0; i < numRequests; i++) {
+    Clock::time_point arrival = start + arrivals[i];
+    std::this_thread::sleep_until(arrival);
+
+    if (bench.concurrency > 0) {
+      std::unique_lock<std::mutex> lock(mutex);
+      finished.wait(lock, [&] { return inFlight < bench.concurrency; });
+    }
+
+    const std::string &line = corpus[i % corpus.size()];
+    std::string source = html ? "<p>" + line + "</p>" : line;
+    size_t words = countWords(line);
+
+    auto callback = [&, i, arrival, words](Response &&response) {
+      Clock::time_point now = Clock::now();
+      std::lock_guard<std::mutex> lock(mutex);
+      result.latencies[i] = std::chrono::duration<double>(now - arrival).count();
+      result.sentences += response.size();
+      result.words += words;
+      --inFlight;
+      ++completed;
+      finished.notify_all();
+    };
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++inFlight;
+    }
+    service.translate(model, std::move(source), callback, responseOptions);
+  }
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&] { return completed == numRequests; });
+  result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  result.batching = model->batchingMetrics();
+  return result;
+}
+
+/// Prints the result of a run as a JSON object, but leaves it open so the caller can add the peak RSS of the run.
+void printResult(std::ostream &out, size_t workers, int miniBatchWords, size_t cacheSize, bool html,
+                 const std::string &wrapMode, const RunResult &result) {
+  std::vector<double> sorted = result.latencies;
+  std::sort(sorted.begin(), sorted.end());
+
+  out << "{\"workers\": " << workers << ", \"mini-batch-words\": " << miniBatchWords
+      << ", \"cache-size\": " << cacheSize << ", \"html\": " << (html ? "true" : "false")
+      << ", \"wrap-mode\": \"" << (wrapMode.empty() ? "config" : wrapMode) << "\""
+      << ", \"requests\": " << result.latencies.size() << ", \"seconds\": " << result.seconds
+      << ", \"sentences-per-second\": " << result.sentences / result.seconds
+      << ", \"words-per-second\": " << result.words / result.seconds
+      << ", \"latency-p50\": " << percentile(sorted, 0.50) << ", \"latency-p95\": " << percentile(sorted, 0.95)
+      << ", \"latency-p99\": " << percentile(sorted, 0.99) << ", \"batches\": " << result.batching.batches
+      << ", \"batch-fill\": " << result.batching.fill() << ", \"padding-waste\": " << result.batching.paddingWaste();
+}
+
+/// Runs one combination of settings and returns its result as a JSON object. Each run gets a process of its own, so
+/// that peak-rss-kb is the peak of that run alone: the peak of a process only ever goes up, so within a single process
+/// every run after the largest would report the peak of the largest. Without fork(), peak-rss-kb is null.
+std::string measure(const BenchConfig &bench, const std::vector<std::string> &corpus, size_t workers,
+                    int miniBatchWords, size_t cacheSize, bool html, const std::string &wrapMode) {
+#ifndef _MSC_VER
+  int fds[2];
+  ABORT_IF(pipe(fds) != 0, "Could not create a pipe: {}", std::strerror(errno));
+  pid_t pid = fork();
+  ABORT_IF(pid < 0, "Could not fork: {}", std::strerror(errno));
+
+  if (pid == 0) {
+    close(fds[0]);
+    std::ostringstream out;
+    printResult(out, workers, miniBatchWords, cacheSize, html, wrapMode,
+                run(bench, corpus, workers, miniBatchWords, cacheSize, html, wrapMode));
+    std::string json = out.str();
+    for (size_t written = 0; written < json.size();) {
+      ssize_t count = write(fds[1], json.data() + written, json.size() - written);
+      if (count < 0 && errno == EINTR) continue;
+      if (count <= 0) _exit(1);
+      written += count;
+    }
+    _exit(0);
+  }
+
+  close(fds[1]);
+  std::string json;
+  char buffer[4096];
+  for (ssize_t count; (count = read(fds[0], buffer, sizeof(buffer))) != 0;) {
+    if (count < 0 && errno == EINTR) continue;
+    ABORT_IF(count < 0, "Could not read the result of a run: {}", std::strerror(errno));
+    json.append(buffer, count);
+  }
+  close(fds[0]);
+
+  // wait4 rather than RUSAGE_CHILDREN, which is the largest peak of all children so far and so has the same problem.
+  int status;
+  struct rusage usage;
+  while (wait4(pid, &status, 0, &usage) < 0) {
+    ABORT_IF(errno != EINTR, "Could not wait for a run: {}", std::strerror(errno));
+  }
+  ABORT_IF(!WIFEXITED(status) || WEXITSTATUS(status) != 0, "The run with {} workers failed", workers);
+  return json + ", \"peak-rss-kb\": " + std::to_string(usage.ru_maxrss) + "}";
+#else
+  std::ostringstream out;
+  printResult(out, workers, miniBatchWords, cacheSize, html, wrapMode,
+              run(bench, corpus, workers, miniBatchWords, cacheSize, html, wrapMode));
+  return out.str() + ", \"peak-rss-kb\": null}";
+#endif
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  BenchConfig bench;
+
+  CLI::App app{"Bergamot benchmark"};
+  app.add_option("--model-config-paths", bench.modelConfigPath, "Configuration file of the model to benchmark")
+      ->required();
+  app.add_option("--input", bench.input, "Corpus to replay, one request per line. Defaults to stdin");
+  app.add_option("--requests", bench.requests, "Requests to send, cycling through the corpus. 0 sends every line once");
+  app.add_option("--rate", bench.rate, "Mean arrival rate in requests per second (Poisson). 0 sends all at once");
+  app.add_option("--concurrency", bench.concurrency, "Maximum number of requests in flight. 0 means no limit");
+  app.add_option("--seed", bench.seed, "Seed for the arrival times");
+  app.add_option("--workers", bench.workers, "Worker counts to sweep");
+  app.add_option("--mini-batch-words", bench.miniBatchWords, "Values of mini-batch-words to sweep");
+  app.add_option("--cache-size", bench.cacheSizes, "Cache sizes to sweep");
+  app.add_option("--html", bench.html, "Whether to translate as HTML (0, 1 or both) to sweep");
+  app.add_option("--wrap-mode", bench.wrapModes, "Values of wrap-mode (fixed, balanced) to sweep");
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    return app.exit(e);
+  }
+
+  std::string text;
+  if (bench.input.empty()) {
+    text = readFromStdin();
+  } else {
+    std::ifstream file(bench.input);
+    ABORT_IF(!file, "Could not open {}", bench.input);
+    std::ostringstream buffer;
+    buffer << file.rdbuf();
+    text = buffer.str();
+  }
+
+  std::vector<std::string> corpus;
+  std::istringstream lines(text);
+  for (std::string line; std::getline(lines, line);) {
+    if (!line.empty()) corpus.push_back(line);
+  }
+  ABORT_IF(corpus.empty(), "Nothing to replay, the input is empty");
+
+  // A value of 0 for mini-batch-words keeps the one of the model config.
+  std::vector<int> miniBatchWords = bench.miniBatchWords.empty() ? std::vector<int>{0} : bench.miniBatchWords;
+  // Likewise an empty wrap-mode.
+  std::vector<std::string> wrapModes = bench.wrapModes.empty() ? std::vector<std::string>{""} : bench.wrapModes;
+
+  std::cout << "[" << std::flush;  // Before any run forks, or its children would print it again.
+  bool first = true;
+  for (size_t workers : bench.workers) {
+    for (int words : miniBatchWords) {
+      for (size_t cacheSize : bench.cacheSizes) {
+        for (int html : bench.html) {
+          for (auto &wrapMode : wrapModes) {
+            std::string result = measure(bench, corpus, workers, words, cacheSize, html != 0, wrapMode);
+            std::cout << (first ? "\n  " : ",\n  ") << result;
+            std::cout.flush();
+            first = false;
+          }
+        }
+      }
+    }
+  }
+  std::cout << "\n]" << std::endl;
+  return 0;
+}
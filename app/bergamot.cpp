@@ -1,10 +1,379 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <string_view>
+#include <vector>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include "translator/byte_array_util.h"
+#include "translator/html_stream.h"
 #include "translator/parser.h"
 #include "translator/response.h"
 #include "translator/response_options.h"
 #include "translator/service.h"
 #include "translator/utils.h"
 
+namespace {
+
+using namespace marian::bergamot;
+
+/// Translates stdin a line or paragraph at a time and writes the translations to stdout, in input order, as soon as
+/// they are ready. At most maxPending lines or paragraphs are held in memory, so input of any size can be piped
+/// through while the workers of the service translate different parts of it in parallel.
+void translateStream(AsyncService &service, std::shared_ptr<TranslationModel> model,
+                     const ResponseOptions &responseOptions, bool paragraphs, size_t maxPending) {
+  StreamTranslator stream(
+      service, model, [](std::string &&text) { std::cout << text; }, responseOptions, maxPending);
+
+  // Empty lines are copied as they are, which also keeps the separation of paragraphs.
+  std::string paragraph;
+  for (std::string line; std::getline(std::cin, line);) {
+    if (line.empty()) {
+      if (!paragraph.empty()) {
+        stream.translate(std::move(paragraph));
+        stream.copy("\n");
+        paragraph.clear();
+      }
+      stream.copy("\n");
+    } else if (paragraphs) {
+      if (!paragraph.empty()) paragraph += '\n';
+      paragraph += line;
+    } else {
+      stream.translate(std::move(line));
+      stream.copy("\n");
+    }
+  }
+
+  if (!paragraph.empty()) {
+    stream.translate(std::move(paragraph));
+    stream.copy("\n");
+  }
+
+  stream.flush();
+  std::cout.flush();
+}
+
+namespace fs = std::filesystem;
+
+/// Read-only view of the contents of a file. Memory-mapped where possible, so that large files are paged in as they
+/// are translated rather than copied up front. Elsewhere, read in a single call.
+class InputFile {
+ public:
+  explicit InputFile(const fs::path &path) {
+#ifndef _MSC_VER
+    int fd = ::open(path.c_str(), O_RDONLY);
+    ABORT_IF(fd < 0, "Could not open {}", path.string());
+    struct stat info;
+    ABORT_IF(::fstat(fd, &info) != 0, "Could not stat {}", path.string());
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0) {
+      void *mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      ABORT_IF(mapped == MAP_FAILED, "Could not map {}", path.string());
+      ::madvise(mapped, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char *>(mapped);
+    }
+    ::close(fd);
+#else
+    std::ifstream in(path, std::ios::binary);
+    ABORT_IF(!in, "Could not open {}", path.string());
+    buffer_.resize(fs::file_size(path));
+    in.read(buffer_.data(), buffer_.size());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+  }
+
+  ~InputFile() {
+#ifndef _MSC_VER
+    if (size_ > 0) ::munmap(const_cast<char *>(data_), size_);
+#endif
+  }
+
+  InputFile(const InputFile &) = delete;
+  InputFile &operator=(const InputFile &) = delete;
+
+  std::string_view contents() const { return std::string_view(data_, size_); }
+
+ private:
+  const char *data_{nullptr};
+  size_t size_{0};
+#ifdef _MSC_VER
+  std::string buffer_;
+#endif
+};
+
+/// Cuts text into shards of at least shardSize bytes, ending at a separator (or the end of the text). A shard is
+/// translated as a request of its own, so the separator has to be one that sentences never span: a line break if the
+/// ssplit-mode takes every line on its own, otherwise a blank line.
+std::vector<std::string_view> shard(std::string_view text, size_t shardSize, std::string_view separator) {
+  std::vector<std::string_view> shards;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = text.find(separator, std::min(begin + std::max<size_t>(shardSize, 1), text.size()) - 1);
+    end = (end == std::string_view::npos) ? text.size() : end + separator.size();
+    shards.push_back(text.substr(begin, end - begin));
+    begin = end;
+  }
+  return shards;
+}
+
+/// Writes contents to path through a temporary file that is renamed, so path either is complete or does not exist.
+void writeAtomically(const fs::path &path, const std::string &contents) {
+  fs::path temporary = path;
+  temporary += ".tmp";
+  {
+    std::ofstream out(temporary, std::ios::binary);
+    ABORT_IF(!out, "Could not write {}", temporary.string());
+    out.write(contents.data(), contents.size());
+  }
+  fs::rename(temporary, path);
+}
+
+/// Translates files and directory trees to a mirror tree under an output directory. Files are cut into shards which
+/// are translated concurrently, up to maxPending at a time across all files. A translated shard is stored next to
+/// its output file in a `.parts` directory, and once all shards of a file are done they are put together. Output
+/// files that exist from an interrupted earlier run are not translated again, nor are shards, as long as the input and
+/// the shard size did not change since.
+///
+/// Translations are passed from the workers to the thread that calls run(), which does all of the writing.
+class FileTranslator {
+ public:
+  /// @param [in] lineBased: Whether the model's ssplit-mode treats every line on its own, so that files can be cut
+  /// into shards at any line break rather than only at blank lines.
+  FileTranslator(AsyncService &service, std::shared_ptr<TranslationModel> model, const ResponseOptions &options,
+                 const fs::path &outputDir, size_t shardSize, size_t maxPending, bool lineBased)
+      : service_(service),
+        model_(model),
+        options_(options),
+        outputDir_(outputDir),
+        shardSize_(shardSize),
+        maxPending_(std::max<size_t>(maxPending, 1)),
+        separator_(lineBased ? "\n" : "\n\n") {}
+
+  void run(const std::vector<std::string> &inputs) {
+    std::vector<std::pair<fs::path, fs::path>> files;  // Input and output path.
+    for (const fs::path input : inputs) {
+      if (fs::is_directory(input)) {
+        std::vector<fs::path> found;
+        for (auto &entry : fs::recursive_directory_iterator(input)) {
+          if (entry.is_regular_file()) found.push_back(entry.path());
+        }
+        std::sort(found.begin(), found.end());
+        for (auto &path : found) {
+          files.emplace_back(path, outputDir_ / input.filename() / fs::relative(path, input));
+        }
+      } else {
+        files.emplace_back(input, outputDir_ / input.filename());
+      }
+    }
+    checkOutputsDistinct(files);
+
+    start_ = std::chrono::steady_clock::now();
+    for (auto &[input, output] : files) {
+      translateFile(input, output);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (inFlight_ > 0 || !completed_.empty()) {
+      drain(lock);
+    }
+    report(/*final=*/true);
+  }
+
+ private:
+  struct Job {
+    fs::path output;
+    fs::path parts;
+    size_t numShards;
+    size_t shardsDone{0};
+  };
+
+  struct Completed {
+    std::shared_ptr<Job> job;
+    size_t shard;
+    size_t bytes;
+    std::string text;
+  };
+
+  void translateFile(const fs::path &input, const fs::path &output) {
+    if (fs::exists(output)) {  // Done in an earlier run.
+      ++filesDone_;
+      return;
+    }
+    fs::create_directories(output.parent_path());
+
+    InputFile file(input);
+    std::vector<std::string_view> shards = shard(file.contents(), shardSize_, separator_);
+
+    auto job = std::make_shared<Job>();
+    job->output = output;
+    job->parts = output;
+    job->parts += ".parts";
+    job->numShards = shards.size();
+    keepPartsIfCurrent(*job, input, file.contents().size());
+
+    for (size_t i = 0; i < shards.size(); i++) {
+      if (fs::exists(partPath(*job, i))) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        completeShard(job);
+        continue;
+      }
+
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (inFlight_ >= maxPending_) drain(lock);
+        ++inFlight_;
+      }
+
+      size_t bytes = shards[i].size();
+      auto callback = [this, job, i, bytes](Response &&response) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed_.push_back(Completed{job, i, bytes, std::move(response.target.text)});
+        progress_.notify_all();
+      };
+      service_.translate(model_, std::string(shards[i]), callback, options_);
+    }
+
+    if (shards.empty()) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      finishFile(*job);
+    }
+  }
+
+  /// Outputs are named after the last component of each input, so inputs like `a/x.txt` and `b/x.txt` would share an
+  /// output file and a parts directory, as would a file and a directory of the same name. Those are rejected before
+  /// anything is written. Sorted by component, any outputs under another one directly follow it.
+  static void checkOutputsDistinct(const std::vector<std::pair<fs::path, fs::path>> &files) {
+    std::vector<const std::pair<fs::path, fs::path> *> sorted;
+    for (auto &file : files) sorted.push_back(&file);
+    std::sort(sorted.begin(), sorted.end(), [](auto *a, auto *b) { return a->second < b->second; });
+
+    for (size_t i = 1; i < sorted.size(); i++) {
+      const fs::path &previous = sorted[i - 1]->second, &output = sorted[i]->second;
+      auto [differs, rest] = std::mismatch(previous.begin(), previous.end(), output.begin(), output.end());
+      bool under = differs == previous.end();
+      ABORT_IF(under, "Inputs {} and {} would both be translated to {}", sorted[i - 1]->first.string(),
+               sorted[i]->first.string(), previous.string());
+    }
+  }
+
+  /// Waits for at least one translated shard and writes all that are available. Called with the lock held, which is
+  /// released while writing.
+  void drain(std::unique_lock<std::mutex> &lock) {
+    progress_.wait(lock, [&] { return !completed_.empty(); });
+    std::deque<Completed> completed;
+    completed.swap(completed_);
+    inFlight_ -= completed.size();
+
+    lock.unlock();
+    for (auto &shard : completed) {
+      writeAtomically(partPath(*shard.job, shard.shard), shard.text);
+      bytesTranslated_ += shard.bytes;
+    }
+    lock.lock();
+
+    for (auto &shard : completed) {
+      completeShard(shard.job);
+    }
+    report(/*final=*/false);
+  }
+
+  void completeShard(const std::shared_ptr<Job> &job) {
+    ++shardsDone_;
+    if (++job->shardsDone == job->numShards) finishFile(*job);
+  }
+
+  /// Puts the translated shards of a file together into its output, and removes them.
+  void finishFile(const Job &job) {
+    fs::path temporary = job.output;
+    temporary += ".tmp";
+    {
+      std::ofstream out(temporary, std::ios::binary);
+      ABORT_IF(!out, "Could not write {}", temporary.string());
+      for (size_t i = 0; i < job.numShards; i++) {
+        std::ifstream part(partPath(job, i), std::ios::binary);
+        out << part.rdbuf();
+      }
+    }
+    fs::rename(temporary, job.output);
+    fs::remove_all(job.parts);
+    ++filesDone_;
+  }
+
+  /// Parts of an earlier run only fit together with new ones if the input was cut the same way, so they are kept only
+  /// if the shard size and separator and the size and modification time of the input are what the manifest in the
+  /// parts directory says they were. Otherwise they are removed, and the manifest written anew.
+  void keepPartsIfCurrent(const Job &job, const fs::path &input, size_t inputSize) {
+    std::ostringstream manifest;
+    manifest << "shard-size " << shardSize_ << "\n"
+             << "shard-at-blank-lines " << (separator_.size() > 1) << "\n"
+             << "input-size " << inputSize << "\n"
+             << "input-mtime " << fs::last_write_time(input).time_since_epoch().count() << "\n";
+
+    fs::path manifestPath = job.parts / kManifest;
+    {
+      std::ifstream existing(manifestPath, std::ios::binary);
+      std::string previous((std::istreambuf_iterator<char>(existing)), std::istreambuf_iterator<char>());
+      if (existing && previous == manifest.str()) return;
+    }
+
+    fs::remove_all(job.parts);
+    fs::create_directories(job.parts);
+    writeAtomically(manifestPath, manifest.str());
+  }
+
+  static fs::path partPath(const Job &job, size_t shard) { return job.parts / std::to_string(shard); }
+
+  static constexpr const char *kManifest = "manifest";
+
+  /// Writes progress to stderr, at most once a second unless final.
+  void report(bool final) {
+    auto now = std::chrono::steady_clock::now();
+    if (!final && now - lastReport_ < std::chrono::seconds(1)) return;
+    lastReport_ = now;
+
+    double seconds = std::chrono::duration<double>(now - start_).count();
+    std::cerr << "Files " << filesDone_ << ", shards " << shardsDone_ << ", " << std::fixed << std::setprecision(2)
+              << bytesTranslated_ / 1e6 << " MB translated in " << seconds << "s ("
+              << (seconds > 0 ? bytesTranslated_ / 1e6 / seconds : 0.0) << " MB/s)" << (final ? "\n" : "\r")
+              << std::flush;
+  }
+
+  AsyncService &service_;
+  std::shared_ptr<TranslationModel> model_;
+  ResponseOptions options_;
+  fs::path outputDir_;
+  size_t shardSize_;
+  size_t maxPending_;
+  std::string separator_;  ///< What shards end with, see shard().
+
+  std::mutex mutex_;
+  std::condition_variable progress_;  ///< Notified when a shard is translated.
+  std::deque<Completed> completed_;   ///< Translated shards that are yet to be written.
+  size_t inFlight_{0};                ///< Shards being translated or waiting to be written.
+
+  // Progress, only touched by the thread that calls run().
+  std::chrono::steady_clock::time_point start_, lastReport_;
+  size_t filesDone_{0}, shardsDone_{0}, bytesTranslated_{0};
+};
+
+}  // namespace
+
 int main(int argc, char *argv[]) {
   using namespace marian::bergamot;
   ConfigParser<AsyncService> configParser("Bergamot CLI", /*multiOpMode=*/false);
@@ -19,6 +388,26 @@ int main(int argc, char *argv[]) {
   std::shared_ptr<TranslationModel> model = service.createCompatibleModel(options);
 
   ResponseOptions responseOptions;
+
+  if (!config.files.inputs.empty()) {
+    ABORT_IF(config.files.outputDir.empty(), "Translating --input-files requires an --output-dir");
+    std::string ssplitMode = options->get<std::string>("ssplit-mode");
+    bool lineBased = ssplitMode == "sentence" || ssplitMode == "paragraph";
+    FileTranslator translator(service, model, responseOptions, config.files.outputDir, config.files.shardSize,
+                              config.stream.maxPending, lineBased);
+    translator.run(config.files.inputs);
+    return 0;
+  }
+
+  if (config.stream.unit == "line" || config.stream.unit == "paragraph") {
+    std::ios_base::sync_with_stdio(false);
+    translateStream(service, model, responseOptions, config.stream.unit == "paragraph", config.stream.maxPending);
+    return 0;
+  }
+
+  ABORT_IF(config.stream.unit != "all", "Unknown stream unit {}, choose one of all, line or paragraph",
+           config.stream.unit);
+
   std::string input = readFromStdin();
 
   // Create a barrier using future/promise.
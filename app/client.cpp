@@ -0,0 +1,168 @@
+// Sends every line of stdin to a bergamot-server as a request of its own, and writes the translations to stdout in
+// the order of the input. All requests are sent on one connection without waiting for responses, which come back
+// in whatever order the server completes them. For trying out and testing a server locally:
+//
+//   bergamot-server --model en-de=en-de/config.yml --socket /tmp/bergamot.sock &
+//   bergamot-client --socket /tmp/bergamot.sock --model en-de < input.txt
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+
+#include "3rd_party/marian-dev/src/3rd_party/CLI/CLI.hpp"
+#include "server_protocol.h"
+
+using namespace bergamot::server;
+
+namespace {
+
+struct ClientConfig {
+  std::string socketPath;
+  std::string host{"127.0.0.1"};
+  uint16_t port{0};
+  std::string model;
+  bool html{false};
+};
+
+[[noreturn]] void fail(const std::string &message) {
+  std::cerr << message << std::endl;
+  std::exit(1);
+}
+
+int connectTo(const ClientConfig &config) {
+  int fd;
+  if (!config.socketPath.empty()) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (config.socketPath.size() >= sizeof(address.sun_path)) fail("Socket path is too long: " + config.socketPath);
+    std::strncpy(address.sun_path, config.socketPath.c_str(), sizeof(address.sun_path) - 1);
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+      fail("Could not connect to " + config.socketPath + ": " + std::strerror(errno));
+    }
+  } else {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(config.port);
+    if (::inet_pton(AF_INET, config.host.c_str(), &address.sin_addr) != 1) fail("Not an IPv4 address: " + config.host);
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+      fail("Could not connect to " + config.host + ":" + std::to_string(config.port) + ": " + std::strerror(errno));
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+void writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::send(fd, data, size, MSG_NOSIGNAL);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      fail(std::string("Could not send: ") + std::strerror(errno));
+    }
+    data += written;
+    size -= written;
+  }
+}
+
+/// Returns false on a clean end of the stream before any of size was read.
+bool readAll(int fd, char *data, size_t size) {
+  size_t total = 0;
+  while (total < size) {
+    ssize_t got = ::read(fd, data + total, size - total);
+    if (got < 0) {
+      if (errno == EINTR) continue;
+      fail(std::string("Could not receive: ") + std::strerror(errno));
+    }
+    if (got == 0) {
+      if (total == 0) return false;
+      fail("Connection closed in the middle of a response");
+    }
+    total += got;
+  }
+  return true;
+}
+
+/// Sends a request for every line of stdin, then closes the sending side of the connection.
+void sendRequests(int fd, const ClientConfig &config, uint32_t &sent) {
+  std::string line;
+  char header[kRequestHeaderSize];
+  for (sent = 0; std::getline(std::cin, line); ++sent) {
+    encode(RequestHeader{sent, static_cast<uint8_t>(config.html ? kHTML : 0),
+                         static_cast<uint16_t>(config.model.size()), static_cast<uint32_t>(line.size())},
+           header);
+    writeAll(fd, header, sizeof(header));
+    writeAll(fd, config.model.data(), config.model.size());
+    writeAll(fd, line.data(), line.size());
+  }
+  ::shutdown(fd, SHUT_WR);
+}
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  ClientConfig config;
+  CLI::App app{"Bergamot client"};
+  app.add_option("--socket", config.socketPath, "Unix-domain socket the server listens on");
+  app.add_option("--host", config.host, "IPv4 address the server listens on");
+  app.add_option("--port", config.port, "TCP port the server listens on, used when no --socket is given");
+  app.add_option("--model", config.model, "Name of the model to translate with. Defaults to that of the server");
+  app.add_flag("--html", config.html, "Translate the input as HTML");
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    return app.exit(e);
+  }
+
+  if (config.socketPath.empty() && config.port == 0) fail("Give a --socket or a --port to connect to");
+  std::ios_base::sync_with_stdio(false);
+  std::cin.tie(nullptr);  // Reading stdin must not flush stdout, which is written by another thread.
+
+  int fd = connectTo(config);
+
+  // Requests go out from a thread of their own, so that responses are read while the server is still being sent to.
+  uint32_t sent = 0;
+  std::thread sender(sendRequests, fd, std::cref(config), std::ref(sent));
+
+  std::map<uint32_t, std::string> early;  // Responses that overtook one before them.
+  uint32_t next = 0;
+  int errors = 0;
+  char header[kResponseHeaderSize];
+  while (readAll(fd, header, sizeof(header))) {
+    ResponseHeader response = decodeResponse(header);
+    std::string text(response.textLength, '\0');
+    if (!text.empty()) readAll(fd, &text[0], text.size());
+
+    if (response.status != Status::OK) {
+      std::cerr << "Request " << response.id << " failed: " << text << std::endl;
+      text.clear();
+      ++errors;
+    }
+
+    early.emplace(response.id, std::move(text));
+    for (auto it = early.find(next); it != early.end(); it = early.find(++next)) {
+      std::cout << it->second << '\n';
+      early.erase(it);
+    }
+  }
+
+  sender.join();
+  ::close(fd);
+  std::cout.flush();
+
+  if (next != sent) fail("Got " + std::to_string(next) + " responses in order out of " + std::to_string(sent));
+  return errors > 0 ? 1 : 0;
+}
@@ -0,0 +1,505 @@
+// Serves translations from AsyncService over Unix-domain and TCP sockets, in the format described in
+// server_protocol.h. Any number of models can be loaded, each under a name requests refer to it by.
+//
+// Usage:
+//
+//   bergamot-server --model en-de=en-de/config.yml --model de-en=de-en/config.yml --socket /tmp/bergamot.sock
+//   bergamot-server --model en-de=en-de/config.yml --port 8787 --cpu-threads 4
+//
+// The first model is the default. A single thread multiplexes all connections with epoll. The text of a request is
+// read straight into the string that is handed to AsyncService::translate, and the translation is written from the
+// string in the Response, so the payload is not copied on either side.
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "server_protocol.h"
+#include "translator/parser.h"
+#include "translator/response.h"
+#include "translator/response_options.h"
+#include "translator/service.h"
+#include "translator/utils.h"
+
+using namespace marian::bergamot;
+using namespace bergamot::server;
+
+namespace {
+
+struct ServerConfig {
+  std::vector<std::string> models;  ///< name=path to model config.
+  std::string socketPath;
+  std::string host{"127.0.0.1"};
+  uint16_t port{0};
+  size_t maxRequestBytes{16 << 20};
+  size_t maxPending{256};
+  AsyncService::Config service;
+};
+
+std::atomic<bool> stopRequested{false};
+
+/// SIGINT and SIGTERM are blocked but while the event loop waits in epoll_pwait, which then returns with EINTR and the
+/// loop sees the flag. A signal can't slip in between checking the flag and starting to wait.
+void requestStop(int) { stopRequested = true; }
+
+void setNonBlocking(int fd) {
+  int flags = ::fcntl(fd, F_GETFL, 0);
+  ABORT_IF(flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0, "fcntl failed: {}", std::strerror(errno));
+}
+
+/// Translations handed over from the worker threads to the event loop. Shared with the callbacks, so that a
+/// translation that completes while the server shuts down has somewhere to go.
+struct Mailbox {
+  struct Letter {
+    uint64_t connection;
+    uint32_t id;
+    Status status;
+    std::string text;
+  };
+
+  explicit Mailbox(int fd) : eventFd(fd) {}
+  ~Mailbox() { ::close(eventFd); }
+
+  void post(Letter &&letter) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      letters.push_back(std::move(letter));
+    }
+    uint64_t one = 1;
+    [[maybe_unused]] ssize_t ignored = ::write(eventFd, &one, sizeof(one));
+  }
+
+  std::vector<Letter> collect() {
+    uint64_t count;
+    [[maybe_unused]] ssize_t ignored = ::read(eventFd, &count, sizeof(count));
+    std::vector<Letter> collected;
+    std::lock_guard<std::mutex> lock(mutex);
+    collected.swap(letters);
+    return collected;
+  }
+
+  const int eventFd;
+  std::mutex mutex;
+  std::vector<Letter> letters;
+};
+
+class Server {
+ public:
+  Server(AsyncService &service, std::map<std::string, std::shared_ptr<TranslationModel>> models,
+         std::string defaultModel, size_t maxRequestBytes, size_t maxPending)
+      : service_(service),
+        models_(std::move(models)),
+        defaultModel_(std::move(defaultModel)),
+        maxRequestBytes_(maxRequestBytes),
+        maxPending_(std::max<size_t>(maxPending, 1)) {
+    epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    ABORT_IF(epollFd_ < 0, "epoll_create1 failed: {}", std::strerror(errno));
+
+    int eventFd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    ABORT_IF(eventFd < 0, "eventfd failed: {}", std::strerror(errno));
+    mailbox_ = std::make_shared<Mailbox>(eventFd);
+    watch(eventFd, kMailbox, EPOLLIN);
+  }
+
+  ~Server() {
+    for (auto &[key, connection] : connections_) ::close(connection.fd);
+    for (auto &[key, fd] : listeners_) ::close(fd);
+    if (!socketPath_.empty()) ::unlink(socketPath_.c_str());
+    ::close(epollFd_);
+  }
+
+  void listenUnix(const std::string &path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    ABORT_IF(path.size() >= sizeof(address.sun_path), "Socket path {} is too long", path);
+    std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+    ::unlink(path.c_str());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ABORT_IF(fd < 0, "socket failed: {}", std::strerror(errno));
+    ABORT_IF(::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0, "Could not bind {}: {}", path,
+             std::strerror(errno));
+    socketPath_ = path;
+    listen(fd);
+  }
+
+  void listenTcp(const std::string &host, uint16_t port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    ABORT_IF(::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1, "Not an IPv4 address: {}", host);
+
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ABORT_IF(fd < 0, "socket failed: {}", std::strerror(errno));
+    int one = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    ABORT_IF(::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0, "Could not bind {}:{}: {}", host,
+             port, std::strerror(errno));
+    listen(fd);
+  }
+
+  /// Serves until SIGINT or SIGTERM.
+  /// @param [in] waitMask: Signal mask while waiting for events, with SIGINT and SIGTERM unblocked. They are to be
+  /// blocked otherwise.
+  void run(const sigset_t &waitMask) {
+    std::vector<epoll_event> events(64);
+    while (!stopRequested) {
+      int ready = ::epoll_pwait(epollFd_, events.data(), events.size(), -1, &waitMask);
+      if (ready < 0) {
+        ABORT_IF(errno != EINTR, "epoll_pwait failed: {}", std::strerror(errno));
+        continue;
+      }
+
+      for (int i = 0; i < ready; ++i) {
+        uint64_t key = events[i].data.u64;
+        if (key == kMailbox) {
+          deliver();
+        } else if (auto listener = listeners_.find(key); listener != listeners_.end()) {
+          accept(listener->second);
+        } else if (auto found = connections_.find(key); found != connections_.end()) {
+          Connection &connection = found->second;
+          if (events[i].events & (EPOLLERR | EPOLLHUP)) connection.broken = true;
+          if (!connection.broken && (events[i].events & EPOLLIN)) receive(connection);
+          if (!connection.broken && (events[i].events & EPOLLOUT)) send(connection);
+          update(connection);
+        }
+      }
+    }
+  }
+
+ private:
+  static constexpr uint64_t kMailbox = 0;
+
+  struct Outgoing {
+    char header[kResponseHeaderSize];
+    std::string text;
+    size_t written{0};  ///< Bytes of header and text written so far.
+  };
+
+  struct Connection {
+    uint64_t key;
+    int fd;
+    uint32_t events{0};  ///< Events watched for on fd.
+
+    // Request being read: the header, then the model name, then the text.
+    char header[kRequestHeaderSize];
+    size_t headerRead{0};
+    RequestHeader request{};
+    std::string model;
+    std::string text;
+    size_t bodyRead{0};
+
+    std::deque<Outgoing> outgoing;
+    size_t inFlight{0};         ///< Requests handed to the service and not yet answered.
+    bool readClosed{false};     ///< The peer is done sending.
+    bool closeWhenSent{false};  ///< Close once outgoing is written, after a protocol error.
+    bool broken{false};         ///< Close now.
+  };
+
+  void watch(int fd, uint64_t key, uint32_t events) {
+    epoll_event event{};
+    event.events = events;
+    event.data.u64 = key;
+    ABORT_IF(::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) < 0, "epoll_ctl failed: {}", std::strerror(errno));
+  }
+
+  void listen(int fd) {
+    ABORT_IF(::listen(fd, SOMAXCONN) < 0, "listen failed: {}", std::strerror(errno));
+    setNonBlocking(fd);
+    uint64_t key = nextKey_++;
+    listeners_[key] = fd;
+    watch(fd, key, EPOLLIN);
+  }
+
+  void accept(int listener) {
+    while (true) {
+      int fd = ::accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+          LOG(warn, "accept failed: {}", std::strerror(errno));
+        }
+        return;
+      }
+      int one = 1;
+      ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));  // Fails harmlessly on Unix sockets.
+
+      uint64_t key = nextKey_++;
+      Connection &connection = connections_[key];
+      connection.key = key;
+      connection.fd = fd;
+      connection.events = EPOLLIN;
+      watch(fd, key, EPOLLIN);
+    }
+  }
+
+  /// Reads requests until the socket runs dry or enough requests are in flight.
+  void receive(Connection &connection) {
+    while (!connection.readClosed && !connection.closeWhenSent && connection.inFlight < maxPending_) {
+      char *target;
+      size_t wanted;
+      if (connection.headerRead < kRequestHeaderSize) {
+        target = connection.header + connection.headerRead;
+        wanted = kRequestHeaderSize - connection.headerRead;
+      } else if (connection.bodyRead < connection.model.size()) {
+        target = &connection.model[connection.bodyRead];
+        wanted = connection.model.size() - connection.bodyRead;
+      } else {
+        size_t textRead = connection.bodyRead - connection.model.size();
+        target = &connection.text[textRead];
+        wanted = connection.text.size() - textRead;
+      }
+
+      ssize_t got = wanted > 0 ? ::read(connection.fd, target, wanted) : 0;
+      if (wanted > 0) {
+        if (got < 0) {
+          if (errno == EINTR) continue;
+          if (errno != EAGAIN && errno != EWOULDBLOCK) connection.broken = true;
+          return;
+        }
+        if (got == 0) {
+          connection.readClosed = true;
+          return;
+        }
+      }
+
+      if (connection.headerRead < kRequestHeaderSize) {
+        connection.headerRead += got;
+        if (connection.headerRead < kRequestHeaderSize) continue;
+        connection.request = decodeRequest(connection.header);
+        if (connection.request.textLength > maxRequestBytes_) {
+          reply(connection, connection.request.id, Status::TOO_LARGE,
+                "Request of " + std::to_string(connection.request.textLength) + " bytes exceeds the limit of " +
+                    std::to_string(maxRequestBytes_));
+          connection.closeWhenSent = true;
+          return;
+        }
+        connection.model.resize(connection.request.modelLength);
+        connection.text.resize(connection.request.textLength);
+        connection.bodyRead = 0;
+      } else {
+        connection.bodyRead += got;
+      }
+
+      if (connection.headerRead == kRequestHeaderSize &&
+          connection.bodyRead == connection.model.size() + connection.text.size()) {
+        dispatch(connection);
+      }
+    }
+  }
+
+  /// Hands the request that was just read to the service.
+  void dispatch(Connection &connection) {
+    RequestHeader request = connection.request;
+    std::string text = std::move(connection.text);
+    std::string name = connection.model.empty() ? defaultModel_ : connection.model;
+    connection.headerRead = 0;
+    connection.bodyRead = 0;
+    connection.model.clear();
+    connection.text = std::string();
+
+    auto model = models_.find(name);
+    if (model == models_.end()) {
+      reply(connection, request.id, Status::UNKNOWN_MODEL, "No model named " + name);
+      return;
+    }
+
+    ResponseOptions options;
+    options.HTML = request.flags & kHTML;
+
+    ++connection.inFlight;
+    auto mailbox = mailbox_;
+    uint64_t key = connection.key;
+    auto callback = [mailbox, key, id = request.id](Response &&response) {
+      mailbox->post(Mailbox::Letter{key, id, Status::OK, std::move(response.target.text)});
+    };
+    try {
+      service_.translate(model->second, std::move(text), callback, options);
+    } catch (const std::exception &e) {
+      // Input the service refuses, such as HTML it can't parse, is the client's problem and not the other
+      // connections'. Aborts throw, see main.
+      --connection.inFlight;
+      reply(connection, request.id, Status::BAD_REQUEST, e.what());
+    }
+  }
+
+  /// Queues translations that completed to be written to their connections.
+  void deliver() {
+    for (auto &letter : mailbox_->collect()) {
+      auto found = connections_.find(letter.connection);
+      if (found == connections_.end()) continue;  // Went away in the meantime.
+      Connection &connection = found->second;
+      --connection.inFlight;
+      reply(connection, letter.id, letter.status, std::move(letter.text));
+      send(connection);
+      // Below maxPending again, there may be requests waiting in the socket.
+      if (!connection.broken) receive(connection);
+      update(connection);
+    }
+  }
+
+  void reply(Connection &connection, uint32_t id, Status status, std::string &&text) {
+    Outgoing &outgoing = connection.outgoing.emplace_back();
+    encode(ResponseHeader{id, status, static_cast<uint32_t>(text.size())}, outgoing.header);
+    outgoing.text = std::move(text);
+  }
+
+  /// Writes as much of the queued responses as the socket takes.
+  void send(Connection &connection) {
+    constexpr size_t kMaxIovecs = 64;
+    while (!connection.outgoing.empty()) {
+      iovec iov[kMaxIovecs];
+      size_t count = 0;
+      for (auto it = connection.outgoing.begin(); it != connection.outgoing.end() && count + 2 <= kMaxIovecs; ++it) {
+        size_t skip = it->written;
+        if (skip < kResponseHeaderSize) {
+          iov[count++] = iovec{it->header + skip, kResponseHeaderSize - skip};
+          skip = 0;
+        } else {
+          skip -= kResponseHeaderSize;
+        }
+        if (skip < it->text.size()) iov[count++] = iovec{&it->text[skip], it->text.size() - skip};
+      }
+
+      msghdr message{};
+      message.msg_iov = iov;
+      message.msg_iovlen = count;
+      ssize_t sent = ::sendmsg(connection.fd, &message, MSG_NOSIGNAL);
+      if (sent < 0) {
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) connection.broken = true;
+        return;
+      }
+
+      size_t remaining = sent;
+      while (remaining > 0) {
+        Outgoing &front = connection.outgoing.front();
+        size_t left = kResponseHeaderSize + front.text.size() - front.written;
+        if (remaining < left) {
+          front.written += remaining;
+          break;
+        }
+        remaining -= left;
+        connection.outgoing.pop_front();
+      }
+    }
+  }
+
+  /// Closes the connection if it is done with, otherwise watches it for the events it is waiting on.
+  void update(Connection &connection) {
+    bool drained = connection.outgoing.empty();
+    bool done = connection.broken || (drained && connection.closeWhenSent) ||
+                (drained && connection.readClosed && connection.inFlight == 0);
+    if (done) {
+      uint64_t key = connection.key;
+      ::close(connection.fd);  // Also removes it from epoll.
+      connections_.erase(key);
+      return;
+    }
+
+    uint32_t events = 0;
+    if (!connection.readClosed && !connection.closeWhenSent && connection.inFlight < maxPending_) events |= EPOLLIN;
+    if (!drained) events |= EPOLLOUT;
+    if (events != connection.events) {
+      epoll_event event{};
+      event.events = events;
+      event.data.u64 = connection.key;
+      ::epoll_ctl(epollFd_, EPOLL_CTL_MOD, connection.fd, &event);
+      connection.events = events;
+    }
+  }
+
+  AsyncService &service_;
+  std::map<std::string, std::shared_ptr<TranslationModel>> models_;
+  std::string defaultModel_;
+  size_t maxRequestBytes_;
+  size_t maxPending_;
+
+  int epollFd_;
+  std::shared_ptr<Mailbox> mailbox_;
+  std::string socketPath_;
+  uint64_t nextKey_{kMailbox + 1};
+  std::unordered_map<uint64_t, int> listeners_;
+  std::unordered_map<uint64_t, Connection> connections_;
+};
+
+}  // namespace
+
+int main(int argc, char *argv[]) {
+  ServerConfig config;
+  CLI::App app{"Bergamot server"};
+  app.add_option("--model", config.models, "Model to serve as name=config.yml, repeat for more. The first is default")
+      ->required();
+  app.add_option("--socket", config.socketPath, "Path of a Unix-domain socket to listen on");
+  app.add_option("--host", config.host, "IPv4 address to listen on for TCP");
+  app.add_option("--port", config.port, "TCP port to listen on");
+  app.add_option("--max-request-bytes", config.maxRequestBytes, "Largest text accepted in a request");
+  app.add_option("--max-pending", config.maxPending, "Requests in flight per connection before it is read no further");
+  AsyncService::Config::addOptions(app, config.service);
+
+  try {
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError &e) {
+    return app.exit(e);
+  }
+
+  ABORT_IF(config.socketPath.empty() && config.port == 0, "Give a --socket, a --port or both to listen on");
+
+  // Blocked before the service starts its threads, which inherit the mask, so that the signals only ever arrive in
+  // Server::run.
+  sigset_t stopSignals, waitMask;
+  sigemptyset(&stopSignals);
+  sigaddset(&stopSignals, SIGINT);
+  sigaddset(&stopSignals, SIGTERM);
+  ::pthread_sigmask(SIG_BLOCK, &stopSignals, &waitMask);
+  sigdelset(&waitMask, SIGINT);
+  sigdelset(&waitMask, SIGTERM);
+
+  AsyncService service(config.service);
+
+  std::map<std::string, std::shared_ptr<TranslationModel>> models;
+  std::string defaultModel;
+  for (auto &model : config.models) {
+    size_t separator = model.find('=');
+    ABORT_IF(separator == std::string::npos, "Expected name=config.yml for --model, got {}", model);
+    std::string name = model.substr(0, separator);
+    ABORT_IF(models.count(name), "Model {} given more than once", name);
+    models[name] = service.createCompatibleModel(parseOptionsFromFilePath(model.substr(separator + 1)));
+    if (defaultModel.empty()) defaultModel = name;
+  }
+
+  Server server(service, std::move(models), defaultModel, config.maxRequestBytes, config.maxPending);
+  if (!config.socketPath.empty()) server.listenUnix(config.socketPath);
+  if (config.port != 0) server.listenTcp(config.host, config.port);
+
+  struct sigaction action {};
+  action.sa_handler = requestStop;
+  ::sigaction(SIGINT, &action, nullptr);
+  ::sigaction(SIGTERM, &action, nullptr);
+
+  // A bad request must not take the server down for everyone, so from here on ABORT throws, for dispatch to catch.
+  marian::setThrowExceptionOnAbort(true);
+
+  server.run(waitMask);
+  return 0;
+}
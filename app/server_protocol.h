@@ -0,0 +1,104 @@
+#ifndef BERGAMOT_APP_SERVER_PROTOCOL_H_
+#define BERGAMOT_APP_SERVER_PROTOCOL_H_
+
+// Wire format spoken by bergamot-server and bergamot-client. A connection carries a stream of requests one way and a
+// stream of responses the other. Every request carries an id chosen by the client, which the response to it repeats:
+// a client may have any number of requests in flight on one connection, and responses come back in the order the
+// translations complete rather than the order the requests were sent.
+//
+// All integers are little-endian.
+//
+//   Request:   u32 id | u8 flags | u16 model length | u32 text length | model | text
+//   Response:  u32 id | u8 status | u32 text length | text
+//
+// An empty model name selects the default model of the server. On an error status, the text of the response is a
+// message describing the error.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bergamot {
+namespace server {
+
+constexpr size_t kRequestHeaderSize = 4 + 1 + 2 + 4;
+constexpr size_t kResponseHeaderSize = 4 + 1 + 4;
+
+/// Bits of the flags field of a request.
+enum RequestFlags : uint8_t {
+  kHTML = 1 << 0,  ///< Translate the text as HTML, see ResponseOptions::HTML.
+};
+
+enum class Status : uint8_t {
+  OK = 0,
+  UNKNOWN_MODEL = 1,  ///< No model by the requested name is loaded.
+  TOO_LARGE = 2,      ///< The text is larger than the server accepts. The server closes the connection after this.
+  BAD_REQUEST = 3,    ///< The text could not be translated, e.g. HTML that does not parse. The text says why.
+};
+
+struct RequestHeader {
+  uint32_t id;
+  uint8_t flags;
+  uint16_t modelLength;
+  uint32_t textLength;
+};
+
+struct ResponseHeader {
+  uint32_t id;
+  Status status;
+  uint32_t textLength;
+};
+
+namespace detail {
+
+template <class T>
+inline void store(char *&out, T value) {
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    *out++ = static_cast<char>((value >> (8 * i)) & 0xff);
+  }
+}
+
+template <class T>
+inline T load(const char *&in) {
+  T value = 0;
+  for (size_t i = 0; i < sizeof(T); ++i) {
+    value |= static_cast<T>(static_cast<unsigned char>(*in++)) << (8 * i);
+  }
+  return value;
+}
+
+}  // namespace detail
+
+inline void encode(const RequestHeader &header, char out[kRequestHeaderSize]) {
+  detail::store(out, header.id);
+  detail::store(out, header.flags);
+  detail::store(out, header.modelLength);
+  detail::store(out, header.textLength);
+}
+
+inline RequestHeader decodeRequest(const char in[kRequestHeaderSize]) {
+  RequestHeader header;
+  header.id = detail::load<uint32_t>(in);
+  header.flags = detail::load<uint8_t>(in);
+  header.modelLength = detail::load<uint16_t>(in);
+  header.textLength = detail::load<uint32_t>(in);
+  return header;
+}
+
+inline void encode(const ResponseHeader &header, char out[kResponseHeaderSize]) {
+  detail::store(out, header.id);
+  detail::store(out, static_cast<uint8_t>(header.status));
+  detail::store(out, header.textLength);
+}
+
+inline ResponseHeader decodeResponse(const char in[kResponseHeaderSize]) {
+  ResponseHeader header;
+  header.id = detail::load<uint32_t>(in);
+  header.status = static_cast<Status>(detail::load<uint8_t>(in));
+  header.textLength = detail::load<uint32_t>(in);
+  return header;
+}
+
+}  // namespace server
+}  // namespace bergamot
+
+#endif  // BERGAMOT_APP_SERVER_PROTOCOL_H_
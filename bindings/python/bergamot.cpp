@@ -10,53 +10,144 @@
 #include <translator/service.h>
 #include <translator/translation_model.h>
 
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace py = pybind11;
 
+using marian::bergamot::Alignment;
 using marian::bergamot::AnnotatedText;
+using marian::bergamot::BatchingMetrics;
 using marian::bergamot::ByteRange;
 using marian::bergamot::ConcatStrategy;
 using marian::bergamot::Response;
 using marian::bergamot::ResponseOptions;
+using marian::bergamot::ServiceMetrics;
+using marian::bergamot::WorkerMetrics;
 using Service = marian::bergamot::AsyncService;
 using _Model = marian::bergamot::TranslationModel;
 using Model = std::shared_ptr<_Model>;
-using Alignment = std::vector<std::vector<float>>;
 using Alignments = std::vector<Alignment>;
 
 PYBIND11_MAKE_OPAQUE(std::vector<Response>);
 PYBIND11_MAKE_OPAQUE(std::vector<std::string>);
 PYBIND11_MAKE_OPAQUE(Alignments);
 
+/// Sends what the library writes to std::cout and std::cerr to Python's sys.stdout and sys.stderr. Set up once and
+/// shared by all Services for as long as any of them is around, rather than on every call: swapping the streams of
+/// std::cout and std::cerr for each call costs an import, and would get mixed up with Services used at the same time.
+class StreamRedirect {
+ public:
+  /// Only to be called with the GIL held, which also guards `current`.
+  static std::shared_ptr<StreamRedirect> acquire() {
+    static std::weak_ptr<StreamRedirect> current;
+    std::shared_ptr<StreamRedirect> redirect = current.lock();
+    if (!redirect) {
+      redirect = std::make_shared<StreamRedirect>(py::module_::import("sys"));
+      current = redirect;
+    }
+    return redirect;
+  }
+
+  explicit StreamRedirect(py::module_ sys)
+      : outstream_(std::cout, sys.attr("stdout")), errstream_(std::cerr, sys.attr("stderr")) {}
+
+ private:
+  py::scoped_ostream_redirect outstream_;
+  py::scoped_ostream_redirect errstream_;
+};
+
+/// Holds on to `value` from callbacks that are copied and destroyed on worker threads without the GIL, so that the
+/// Python objects in it are only let go of with the GIL held.
+template <class T>
+std::shared_ptr<T> holdWithGIL(T &&value) {
+  return std::shared_ptr<T>(new T(std::move(value)), [](T *held) {
+    py::gil_scoped_acquire acquire;
+    delete held;
+  });
+}
+
+/// Responses to a list of inputs in the order they complete, as `(index, Response)` with the index of the input.
+/// Iterating releases the GIL while waiting for the next one.
+class ResponseStream {
+ public:
+  explicit ResponseStream(size_t size) : state_(std::make_shared<State>()) { state_->remaining = size; }
+
+  /// Callback to pass along with the input at `index`.
+  std::function<void(Response &&)> callback(size_t index) {
+    return [state = state_, index](Response &&response) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      state->completed.emplace_back(index, std::move(response));
+      state->ready.notify_one();
+    };
+  }
+
+  py::tuple next() {
+    std::pair<size_t, Response> completed;
+    {
+      py::gil_scoped_release release;
+      std::unique_lock<std::mutex> lock(state_->mutex);
+      if (state_->remaining == 0) throw py::stop_iteration();
+      state_->ready.wait(lock, [this] { return !state_->completed.empty(); });
+      completed = std::move(state_->completed.front());
+      state_->completed.pop_front();
+      --state_->remaining;
+    }
+    return py::make_tuple(completed.first, std::move(completed.second));
+  }
+
+ private:
+  /// Shared with the callbacks, which may outlive the stream if it is not iterated to the end.
+  struct State {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::pair<size_t, Response>> completed;
+    size_t remaining;  ///< Responses not handed out yet.
+  };
+
+  std::shared_ptr<State> state_;
+};
+
 class ServicePyAdapter {
  public:
-  ServicePyAdapter(const Service::Config &config) : service_(make_service(config)) {
+  ServicePyAdapter(const Service::Config &config)
+      : redirect_(StreamRedirect::acquire()),
+        getRunningLoop_(py::module_::import("asyncio").attr("get_running_loop")),
+        setResult_(py::cpp_function([](py::object future, py::object result) {
+          // The awaiting coroutine may have been cancelled in the meantime.
+          if (!future.attr("done")().cast<bool>()) {
+            future.attr("set_result")(result);
+          }
+        })),
+        service_(make_service(config)) {
     // Set marian to throw exceptions instead of std::abort()
     marian::setThrowExceptionOnAbort(true);
   }
 
+  ~ServicePyAdapter() {
+    // Translations still in flight finish first, and their callbacks may need the GIL.
+    py::gil_scoped_release release;
+    service_.reset();
+  }
+
   std::shared_ptr<_Model> modelFromConfig(const std::string &config) {
     auto parsedConfig = marian::bergamot::parseOptionsFromString(config);
-    return service_.createCompatibleModel(parsedConfig);
+    return service_->createCompatibleModel(parsedConfig);
   }
 
   std::shared_ptr<_Model> modelFromConfigPath(const std::string &configPath) {
     auto config = marian::bergamot::parseOptionsFromFilePath(configPath);
-    return service_.createCompatibleModel(config);
+    return service_->createCompatibleModel(config);
   }
 
   std::vector<Response> translate(Model model, std::vector<std::string> &inputs, const ResponseOptions &options) {
-    py::scoped_ostream_redirect outstream(std::cout,                                 // std::ostream&
-                                          py::module_::import("sys").attr("stdout")  // Python output
-    );
-    py::scoped_ostream_redirect errstream(std::cerr,                                 // std::ostream&
-                                          py::module_::import("sys").attr("stderr")  // Python output
-    );
-
-    py::call_guard<py::gil_scoped_release> gil_guard;
+    py::gil_scoped_release release;
 
     // Prepare promises, save respective futures. Have callback's in async set
     // value to the promises.
@@ -67,7 +158,7 @@ class ServicePyAdapter {
     for (size_t i = 0; i < inputs.size(); i++) {
       auto callback = [&promises, i](Response &&response) { promises[i].set_value(std::move(response)); };
 
-      service_.translate(model, std::move(inputs[i]), std::move(callback), options);
+      service_->translate(model, std::move(inputs[i]), std::move(callback), options);
 
       futures.push_back(std::move(promises[i].get_future()));
     }
@@ -82,16 +173,45 @@ class ServicePyAdapter {
     return responses;
   }
 
+  /// Starts translating `input` and returns an asyncio future of the Response, on the event loop of the calling
+  /// coroutine. Only the GIL is taken for a moment when the translation completes, no thread waits for it.
+  py::object translateAsync(Model model, std::string input, const ResponseOptions &options) {
+    struct Pending {
+      py::object loop, future, setResult;
+    };
+    py::object loop = getRunningLoop_();
+    py::object future = loop.attr("create_future")();
+    auto pending = holdWithGIL(Pending{loop, future, setResult_});
+
+    auto callback = [pending](Response &&response) {
+      py::gil_scoped_acquire acquire;
+      try {
+        pending->loop.attr("call_soon_threadsafe")(pending->setResult, pending->future, py::cast(std::move(response)));
+      } catch (py::error_already_set &) {
+        // The event loop was closed, there is no one left to hand the Response to.
+      }
+    };
+
+    {
+      py::gil_scoped_release release;
+      service_->translate(model, std::move(input), std::move(callback), options);
+    }
+    return future;
+  }
+
+  /// Starts translating all of `inputs` and returns a ResponseStream to iterate over the Responses as they complete.
+  ResponseStream translateStream(Model model, std::vector<std::string> &inputs, const ResponseOptions &options) {
+    py::gil_scoped_release release;
+    ResponseStream stream(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+      service_->translate(model, std::move(inputs[i]), stream.callback(i), options);
+    }
+    return stream;
+  }
+
   std::vector<Response> pivot(Model first, Model second, std::vector<std::string> &inputs,
                               const ResponseOptions &options) {
-    py::scoped_ostream_redirect outstream(std::cout,                                 // std::ostream&
-                                          py::module_::import("sys").attr("stdout")  // Python output
-    );
-    py::scoped_ostream_redirect errstream(std::cerr,                                 // std::ostream&
-                                          py::module_::import("sys").attr("stderr")  // Python output
-    );
-
-    py::call_guard<py::gil_scoped_release> gil_guard;
+    py::gil_scoped_release release;
     // Prepare promises, save respective futures. Have callback's in async set
     // value to the promises.
     std::vector<std::future<Response>> futures;
@@ -101,7 +221,7 @@ class ServicePyAdapter {
     for (size_t i = 0; i < inputs.size(); i++) {
       auto callback = [&promises, i](Response &&response) { promises[i].set_value(std::move(response)); };
 
-      service_.pivot(first, second, std::move(inputs[i]), std::move(callback), options);
+      service_->pivot(first, second, std::move(inputs[i]), std::move(callback), options);
 
       futures.push_back(std::move(promises[i].get_future()));
     }
@@ -116,22 +236,19 @@ class ServicePyAdapter {
     return responses;
   }
 
-  private /*functions*/:
-  static Service make_service(const Service::Config &config) {
-    py::scoped_ostream_redirect outstream(std::cout,                                 // std::ostream&
-                                          py::module_::import("sys").attr("stdout")  // Python output
-    );
-    py::scoped_ostream_redirect errstream(std::cerr,                                 // std::ostream&
-                                          py::module_::import("sys").attr("stderr")  // Python output
-    );
-
-    py::call_guard<py::gil_scoped_release> gil_guard;
+  ServiceMetrics metrics() const { return service_->metrics(); }
 
-    return Service(config);
+  private /*functions*/:
+  static std::unique_ptr<Service> make_service(const Service::Config &config) {
+    py::gil_scoped_release release;
+    return std::make_unique<Service>(config);
   }
 
   private /*data*/:
-  Service service_;
+  std::shared_ptr<StreamRedirect> redirect_;  ///< Before service_, so that it is there for as long as service_ is.
+  py::object getRunningLoop_;
+  py::object setResult_;
+  std::unique_ptr<Service> service_;
 };
 
 PYBIND11_MODULE(_bergamot, m) {
@@ -163,11 +280,27 @@ PYBIND11_MODULE(_bergamot, m) {
       .def("sentenceAsByteRange", &AnnotatedText::sentenceAsByteRange)
       .def_readonly("text", &AnnotatedText::text);
 
+  // Exposes the scores without copying, i.e. `numpy.asarray(alignment)` gives a
+  // (target tokens x source tokens) matrix backed by the response's memory.
+  py::class_<Alignment>(m, "Alignment", py::buffer_protocol())
+      .def_property_readonly("rows", &Alignment::rows)
+      .def_property_readonly("cols", &Alignment::cols)
+      .def("__call__", [](const Alignment &alignment, size_t t, size_t s) { return alignment(t, s); })
+      .def_buffer([](Alignment &alignment) -> py::buffer_info {
+        auto rows = static_cast<py::ssize_t>(alignment.rows());
+        auto cols = static_cast<py::ssize_t>(alignment.cols());
+        auto itemSize = static_cast<py::ssize_t>(sizeof(float));
+        return py::buffer_info(alignment.data(), {rows, cols}, {itemSize * cols, itemSize}, /*readonly=*/true);
+      });
+
+  py::bind_vector<Alignments>(m, "VectorAlignment");
+
   py::class_<Response>(m, "Response")
       .def(py::init<>())
       .def_readonly("source", &Response::source)
       .def_readonly("target", &Response::target)
-      .def_readonly("alignments", &Response::alignments);
+      .def_readonly("alignments", &Response::alignments)
+      .def("targetWords", &marian::bergamot::getWordByteRanges, py::arg("sentenceIdx"));
 
   py::bind_vector<std::vector<std::string>>(m, "VectorString");
   py::bind_vector<std::vector<Response>>(m, "VectorResponse");
@@ -190,12 +323,45 @@ PYBIND11_MODULE(_bergamot, m) {
       .def_readwrite("concatStrategy", &ResponseOptions::concatStrategy)
       .def_readwrite("sentenceMappings", &ResponseOptions::sentenceMappings);
 
+  py::class_<ResponseStream>(m, "ResponseStream")
+      .def("__iter__", [](py::object self) { return self; })
+      .def("__next__", &ResponseStream::next);
+
   py::class_<ServicePyAdapter>(m, "Service")
       .def(py::init<const Service::Config &>())
       .def("modelFromConfig", &ServicePyAdapter::modelFromConfig)
       .def("modelFromConfigPath", &ServicePyAdapter::modelFromConfigPath)
       .def("translate", &ServicePyAdapter::translate)
-      .def("pivot", &ServicePyAdapter::pivot);
+      .def("translate_async", &ServicePyAdapter::translateAsync, py::arg("model"), py::arg("input"),
+           py::arg("options"))
+      .def("translate_stream", &ServicePyAdapter::translateStream, py::arg("model"), py::arg("inputs"),
+           py::arg("options"))
+      .def("pivot", &ServicePyAdapter::pivot)
+      .def("metrics", &ServicePyAdapter::metrics);
+
+  py::class_<BatchingMetrics>(m, "BatchingMetrics")
+      .def_readonly("enqueuedSentences", &BatchingMetrics::enqueuedSentences)
+      .def_readonly("pendingSentences", &BatchingMetrics::pendingSentences)
+      .def_readonly("batches", &BatchingMetrics::batches)
+      .def_readonly("batchedSentences", &BatchingMetrics::batchedSentences)
+      .def_readonly("batchedTokens", &BatchingMetrics::batchedTokens)
+      .def_readonly("paddedTokens", &BatchingMetrics::paddedTokens)
+      .def_readonly("capacity", &BatchingMetrics::capacity)
+      .def_property_readonly("fill", &BatchingMetrics::fill)
+      .def_property_readonly("paddingWaste", &BatchingMetrics::paddingWaste);
+
+  py::class_<WorkerMetrics>(m, "WorkerMetrics")
+      .def_readonly("busySeconds", &WorkerMetrics::busySeconds)
+      .def_readonly("idleSeconds", &WorkerMetrics::idleSeconds)
+      .def_readonly("busy", &WorkerMetrics::busy)
+      .def_property_readonly("utilization", &WorkerMetrics::utilization);
+
+  py::class_<ServiceMetrics>(m, "ServiceMetrics")
+      .def_readonly("uptimeSeconds", &ServiceMetrics::uptimeSeconds)
+      .def_readonly("translateCalls", &ServiceMetrics::translateCalls)
+      .def_readonly("batching", &ServiceMetrics::batching)
+      .def_readonly("workers", &ServiceMetrics::workers)
+      .def_property_readonly("translateCallRate", &ServiceMetrics::translateCallRate);
 
   py::class_<Service::Config>(m, "ServiceConfig")
       .def(py::init<>([](size_t numWorkers, size_t cacheSize, std::string logging) {
@@ -207,7 +373,10 @@ PYBIND11_MODULE(_bergamot, m) {
            }),
            py::arg("numWorkers") = 1, py::arg("cacheSize") = 0, py::arg("logLevel") = "off")
       .def_readwrite("numWorkers", &Service::Config::numWorkers)
-      .def_readwrite("cacheSize", &Service::Config::cacheSize);
+      .def_readwrite("cacheSize", &Service::Config::cacheSize)
+      .def_readwrite("responseCacheSize", &Service::Config::responseCacheSize)
+      .def_readwrite("responseCacheTTL", &Service::Config::responseCacheTTL);
 
-  py::class_<_Model, std::shared_ptr<_Model>>(m, "TranslationModel");
+  py::class_<_Model, std::shared_ptr<_Model>>(m, "TranslationModel")
+      .def("batchingMetrics", &_Model::batchingMetrics);
 }
@@ -55,6 +55,8 @@ template <class Service>
 void TestSuite<Service>::TestSuite::run(const std::string &opModeAsString, std::vector<Ptr<TranslationModel>> &models) {
   if (opModeAsString == "decoder") {
     benchmarkDecoder(models.front());
+  } else if (opModeAsString == "benchmark-quality-estimator") {
+    benchmarkQualityEstimator(models.front());
   } else if (opModeAsString == "test-response-source-sentences") {
     annotatedTextSentences(models.front(), /*source=*/true);
   } else if (opModeAsString == "test-response-target-sentences") {
@@ -98,6 +100,39 @@ void TestSuite<Service>::benchmarkDecoder(Ptr<TranslationModel> &model) {
   std::cerr << "Total time: " << std::setprecision(5) << decoderTimer.elapsed() << "s wall" << std::endl;
 }
 
+// Reads from stdin and translates it a few times, to measure how much quality estimation adds to translation time.
+// Workers estimate quality whether a request asks for quality scores or not, so the cost is read from the
+// QUALITY_ESTIMATE stage. Run without a cache, or all but the first translation are cache hits.
+template <class Service>
+void TestSuite<Service>::benchmarkQualityEstimator(Ptr<TranslationModel> &model) {
+  ABORT_IF(!kStageTimingEnabled, "benchmark-quality-estimator needs a build with ENABLE_STAGE_TIMING.");
+  std::string source = readFromStdin();
+
+  const size_t iterations = 5;
+  double wall = 0.0, translate = 0.0, qualityEstimate = 0.0;
+  size_t sentences = 0;
+  for (size_t i = 0; i < iterations; i++) {
+    ResponseOptions responseOptions;
+    responseOptions.qualityScores = true;
+    responseOptions.timings = true;
+
+    std::string input = source;
+    marian::timer::Timer timer;
+    Response response = bridge_.translate(service_, model, std::move(input), responseOptions);
+    wall += timer.elapsed();
+    translate += (*response.timings)[Stage::TRANSLATE];
+    qualityEstimate += (*response.timings)[Stage::QUALITY_ESTIMATE];
+    sentences = response.size();
+  }
+
+  std::cerr << std::setprecision(5) << "Total time: " << wall / iterations << "s wall\n"
+            << "Translation: " << translate / iterations << "s\n"
+            << "Quality estimation: " << qualityEstimate / iterations << "s, "
+            << 1e6 * qualityEstimate / (iterations * std::max<size_t>(sentences, 1)) << "us per sentence\n"
+            << "Quality estimation overhead: " << 100.0 * qualityEstimate / translate << "% of translation"
+            << std::endl;
+}
+
 // Reads from stdin and translates.  Prints the tokens separated by space for each sentence. Prints words from source
 // side text annotation if source=true, target annotation otherwise.
 template <class Service>
@@ -266,10 +301,10 @@ void TestSuite<Service>::pivotTranslate(std::vector<Ptr<TranslationModel>> &mode
     std::cout << "< " << response.target.sentence(sentenceId) << "\n\n";
 
     // Assert what we have is a probability distribution over source-tokens given a target token.
-    for (size_t t = 0; t < response.alignments[sentenceId].size(); t++) {
+    for (size_t t = 0; t < response.alignments[sentenceId].rows(); t++) {
       float sum = 0.0f;
-      for (size_t s = 0; s < response.alignments[sentenceId][t].size(); s++) {
-        sum += response.alignments[sentenceId][t][s];
+      for (size_t s = 0; s < response.alignments[sentenceId].cols(); s++) {
+        sum += response.alignments[sentenceId](t, s);
       }
 
       std::cerr << fmt::format("Sum @ (target-token = {}, sentence = {}) = {}", t, sentenceId, sum) << std::endl;
@@ -277,12 +312,12 @@ void TestSuite<Service>::pivotTranslate(std::vector<Ptr<TranslationModel>> &mode
     }
 
     // For each target token, find argmax s, i.e find argmax p(s | t), max p(s | t)
-    for (size_t t = 0; t < response.alignments[sentenceId].size(); t++) {
+    for (size_t t = 0; t < response.alignments[sentenceId].rows(); t++) {
       bool valid = false;
       float maxV = 0.0f;
       auto argmaxV = std::make_pair(-1, -1);
-      for (size_t s = 0; s < response.alignments[sentenceId][t].size(); s++) {
-        auto v = response.alignments[sentenceId][t][s];
+      for (size_t s = 0; s < response.alignments[sentenceId].cols(); s++) {
+        auto v = response.alignments[sentenceId](t, s);
         if (v > maxV) {
           maxV = v;
           argmaxV = std::make_pair(t, s);
@@ -68,6 +68,9 @@ class TestSuite {
  private:
   void benchmarkDecoder(Ptr<TranslationModel> &model);
 
+  // Reads from stdin and translates it a few times. Prints how much time quality estimation adds to translation.
+  void benchmarkQualityEstimator(Ptr<TranslationModel> &model);
+
   // Reads from stdin and translates.  Prints the tokens separated by space for each sentence. Prints words from source
   // side text annotation if source=true, target annotation otherwise.
   void annotatedTextWords(Ptr<TranslationModel> model, bool sourceSide = true);
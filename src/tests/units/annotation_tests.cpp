@@ -212,3 +212,34 @@ TEST_CASE("Test Annotation API with random sentences") {
   std::string obtainedString = std::string(emptyView.data(), emptyView.size());
   CHECK(expectedEmptyString == obtainedString);
 }
+
+TEST_CASE("Reserving room leaves an AnnotatedText as it was") {
+  std::string sentence = "Hello world.";
+  std::vector<marian::string_view> tokens{marian::string_view(sentence.data(), 5),
+                                          marian::string_view(sentence.data() + 5, 6),
+                                          marian::string_view(sentence.data() + 11, 1)};
+
+  AnnotatedText reserved;
+  reserved.reserve(/*numSentences=*/2, /*numWords=*/6);
+  CHECK(reserved.numSentences() == 0);
+  CHECK(reserved.gap(0) == "");
+
+  AnnotatedText plain;
+  for (AnnotatedText *text : {&reserved, &plain}) {
+    text->appendSentence(" ", tokens.begin(), tokens.end());
+    text->appendSentence(" ", tokens.begin(), tokens.end());
+    text->appendEndingWhitespace("\n");
+  }
+
+  CHECK(reserved.text == plain.text);
+  REQUIRE(reserved.numSentences() == 2);
+  for (size_t s = 0; s < reserved.numSentences(); s++) {
+    CHECK(reserved.sentenceAsByteRange(s) == plain.sentenceAsByteRange(s));
+    REQUIRE(reserved.numWords(s) == 3);
+    for (size_t w = 0; w < reserved.numWords(s); w++) {
+      CHECK(reserved.wordAsByteRange(s, w) == plain.wordAsByteRange(s, w));
+    }
+  }
+  CHECK(reserved.gap(2) == "\n");
+  CHECK(reserved.sentence(1) == "Hello world.");
+}
@@ -1,5 +1,7 @@
 
+#include <chrono>
 #include <random>
+#include <string>
 #include <thread>
 
 #include "catch.hpp"
@@ -51,6 +53,122 @@ TEST_CASE("Test Cache in a threaded setting") {
   std::cout << "(Hits, Misses) = " << stats.hits << " " << stats.misses << "\n";
 
   // Can we create a specialization of the actual cache-type we want? Does it compile, at least?
-  // We already have Ptr<History>, it's easier to move Ptr<History> to cache.
+  // Values are shared pointers to translated sentences, cheap to copy in and out of the cache.
   TranslationCache translationCache(/*size=*/300, /*mutexBuckets=*/16);
 }
+
+TEST_CASE("Tokenization cache matches on the exact sentence") {
+  TokenizationCache cache(/*size=*/16, /*mutexBuckets=*/4);
+
+  auto tokenized = std::make_shared<TokenizedSentence>();
+  tokenized->tokenOffsets = {{0, 5}, {5, 11}};
+  cache.store("Hello world", tokenized);
+
+  auto [found, cached] = cache.find("Hello world");
+  REQUIRE(found);
+  CHECK(cached->tokenOffsets == tokenized->tokenOffsets);
+
+  CHECK(!cache.find("Hello world!").first);
+  CHECK(!cache.find("hello world").first);
+}
+
+TEST_CASE("Tokenizing through the cache") {
+  TokenizationCache cache(/*size=*/16, /*mutexBuckets=*/4);
+
+  // Stands in for the vocabulary: a token for every space-separated word, taking the space before it along.
+  size_t calls = 0;
+  auto encode = [&calls](const marian::string_view &sentence, std::vector<marian::string_view> &wordRanges) {
+    ++calls;
+    Segment segment;
+    size_t begin = 0;
+    for (size_t i = 1; i <= sentence.size(); i++) {
+      if (i == sentence.size() || sentence[i] == ' ') {
+        wordRanges.emplace_back(sentence.data() + begin, i - begin);
+        segment.push_back(marian::Word::fromWordIndex(segment.size()));
+        begin = i;
+      }
+    }
+    return segment;
+  };
+
+  SECTION("A sentence seen before comes from the cache, with views into the new occurrence") {
+    std::string first = "Hello world", second = "Hello world";
+    std::vector<marian::string_view> firstRanges, secondRanges;
+    Segment segment = tokenizeThroughCache(cache, first, firstRanges, encode);
+    CHECK(tokenizeThroughCache(cache, second, secondRanges, encode) == segment);
+    CHECK(calls == 1);
+    REQUIRE(secondRanges.size() == 2);
+    CHECK(secondRanges[0].data() == second.data());
+    CHECK(secondRanges[1] == " world");
+  }
+
+  SECTION("An empty sentence is tokenized rather than found in an empty record") {
+    std::vector<marian::string_view> wordRanges;
+    CHECK(tokenizeThroughCache(cache, marian::string_view(), wordRanges, encode).empty());
+    CHECK(tokenizeThroughCache(cache, marian::string_view(""), wordRanges, encode).empty());
+    CHECK(wordRanges.empty());
+    CHECK(calls == 2);
+  }
+}
+
+TEST_CASE("Response cache tells collisions and expired entries from hits") {
+  using Clock = std::chrono::steady_clock;
+  std::string source = "<p>Hello world</p>";
+
+  auto entryFor = [](size_t modelId, const std::string &text, Clock::time_point stored) {
+    return CachedResponse{modelId, CachedResponse::hashSource(text), text.size(), stored, nullptr};
+  };
+
+  Clock::time_point stored = Clock::now();
+  CachedResponse cached = entryFor(1, source, stored);
+  CHECK(cached.isSource(source));
+  CHECK(!cached.isSource(source + " "));
+
+  SECTION("Same model and source") {
+    CHECK(cached.matches(entryFor(1, source, stored + std::chrono::seconds(5)), /*ttl=*/10.0));
+    CHECK(cached.matches(entryFor(1, source, stored + std::chrono::hours(24)), /*ttl=*/0.0));
+  }
+
+  SECTION("Expired") {
+    CHECK(!cached.matches(entryFor(1, source, stored + std::chrono::seconds(10)), /*ttl=*/10.0));
+    CHECK(!cached.matches(entryFor(1, source, stored + std::chrono::seconds(11)), /*ttl=*/10.0));
+  }
+
+  SECTION("Collisions") {
+    CHECK(!cached.matches(entryFor(2, source, stored), /*ttl=*/0.0));
+    CHECK(!cached.matches(entryFor(1, "<p>Hello World</p>", stored), /*ttl=*/0.0));
+    CHECK(!cached.matches(entryFor(1, source + source, stored), /*ttl=*/0.0));
+
+    // Same hash, different length, or the other way around
+    CachedResponse request = entryFor(1, source, stored);
+    request.sourceSize += 1;
+    CHECK(!cached.matches(request, /*ttl=*/0.0));
+    request = entryFor(1, source, stored);
+    request.sourceHash ^= 1;
+    CHECK(!cached.matches(request, /*ttl=*/0.0));
+  }
+
+  SECTION("Every byte counts, whether in whole words or in the tail") {
+    std::string text(37, 'a');
+    uint64_t hash = CachedResponse::hashSource(text);
+    for (size_t i = 0; i < text.size(); i++) {
+      std::string changed = text;
+      changed[i] = 'b';
+      CHECK(CachedResponse::hashSource(changed) != hash);
+    }
+    CHECK(CachedResponse::hashSource("") != CachedResponse::hashSource(std::string(1, '\0')));
+  }
+
+  SECTION("An entry stored under a colliding key is found, but does not match") {
+    ResponseCache cache(/*size=*/16, /*mutexBuckets=*/4);
+    cache.store(42, std::make_shared<CachedResponse const>(cached));
+    auto [found, entry] = cache.find(42);
+    REQUIRE(found);
+    CHECK(entry->matches(entryFor(1, source, stored), /*ttl=*/0.0));
+    CHECK(!entry->matches(entryFor(1, "<p>Something else</p>", stored), /*ttl=*/0.0));
+
+    // Unused records hold a null entry under key 0
+    auto [foundEmpty, empty] = cache.find(0);
+    CHECK((!foundEmpty || !empty));
+  }
+}
@@ -0,0 +1,211 @@
+#include <string>
+#include <vector>
+
+#include "catch.hpp"
+#include "translator/html.h"
+#include "translator/html_stream.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+class MarianThrowsExceptionsFixture {
+ protected:
+  MarianThrowsExceptionsFixture() : prev_(marian::getThrowExceptionOnAbort()) {
+    marian::setThrowExceptionOnAbort(true);
+  }
+  ~MarianThrowsExceptionsFixture() { marian::setThrowExceptionOnAbort(prev_); }
+
+ private:
+  bool prev_;
+};
+
+using SplitSegments = std::vector<HTMLSplitter::Segment>;
+
+// Feeds `input` to a splitter `pieceSize` bytes at a time. Merges consecutive
+// segments that are copied as is, as those may be cut differently depending on
+// where the pieces end.
+SplitSegments split(std::string const &input, size_t pieceSize, size_t maxBuffered = 1 << 20) {
+  HTMLSplitter splitter(HTML::Options(), maxBuffered);
+  SplitSegments segments, out;
+  for (size_t offset = 0; offset < input.size(); offset += pieceSize)
+    splitter.write(std::string_view(input).substr(offset, pieceSize), segments);
+  splitter.close(segments);
+
+  for (auto &segment : segments) {
+    if (!segment.translate && !out.empty() && !out.back().translate)
+      out.back().html += segment.html;
+    else
+      out.push_back(std::move(segment));
+  }
+  return out;
+}
+
+SplitSegments split(std::string const &input) { return split(input, input.size() + 1); }
+
+std::string join(SplitSegments const &segments) {
+  std::string out;
+  for (auto const &segment : segments) out += segment.html;
+  return out;
+}
+
+std::vector<std::string> translated(SplitSegments const &segments) {
+  std::vector<std::string> out;
+  for (auto const &segment : segments)
+    if (segment.translate) out.push_back(segment.html);
+  return out;
+}
+
+}  // namespace
+
+TEST_CASE("Split HTML at block-level elements") {
+  SplitSegments segments = split("<div><p>Hello <b>world</b>.</p>\n  <p>Second</p></div>");
+  REQUIRE(segments.size() == 5);
+  CHECK(segments[0].html == "<div><p>");
+  CHECK(!segments[0].translate);
+  CHECK(segments[1].html == "Hello <b>world</b>.");
+  CHECK(segments[1].translate);
+  CHECK(segments[2].html == "</p>\n  <p>");
+  CHECK(!segments[2].translate);
+  CHECK(segments[3].html == "Second");
+  CHECK(segments[3].translate);
+  CHECK(segments[4].html == "</p></div>");
+  CHECK(!segments[4].translate);
+}
+
+TEST_CASE("Split HTML without markup") {
+  SplitSegments segments = split("Just text");
+  REQUIRE(segments.size() == 1);
+  CHECK(segments[0].html == "Just text");
+  CHECK(segments[0].translate);
+
+  CHECK(split("").empty());
+  CHECK(translated(split(" \n ")).empty());
+}
+
+TEST_CASE("Split HTML at void block-level elements") {
+  CHECK(translated(split("line one<br>line two<hr/>")) == std::vector<std::string>{"line one", "line two"});
+}
+
+TEST_CASE("Do not split HTML inside inline elements") {
+  SplitSegments segments = split("<p><a href=\"#\"><div>x</div></a></p>");
+  REQUIRE(segments.size() == 3);
+  CHECK(segments[1].html == "<a href=\"#\"><div>x</div></a>");
+  CHECK(segments[1].translate);
+}
+
+TEST_CASE("Copy ignored elements, scripts and comments between blocks") {
+  std::string input(
+      "<p>x</p><script>if (a < b && c) {}</script><code>int <b>x</b>; <code>y</code></code>\n<!-- <p>c</p> -->"
+      "<p>y</p>");
+  SplitSegments segments = split(input);
+  REQUIRE(segments.size() == 5);
+  CHECK(segments[1].html == "x");
+  CHECK(segments[2].html ==
+        "</p><script>if (a < b && c) {}</script><code>int <b>x</b>; <code>y</code></code>\n<!-- <p>c</p> --><p>");
+  CHECK(!segments[2].translate);
+  CHECK(segments[3].html == "y");
+}
+
+TEST_CASE("Split HTML independent of how the input arrives") {
+  std::string input(
+      "<!DOCTYPE html>\n"
+      "<html><head><title>Test</title><style>p > a { color: red; }</style></head>\n"
+      "<body>\n"
+      "  <h1 class=\"title\">A <em>big</em> title</h1>\n"
+      "  <p>Some text with a <a href='https://example.com/?a=1&amp;b=2'>link</a> &amp; an entity.<br>A second "
+      "line.</p>\n"
+      "  <!-- a comment -->\n"
+      "  <ul><li>One</li><li>Two <img src=\"x.png\"/> three</li></ul>\n"
+      "  <pre><code>if (a &lt; b) return;</code></pre>\n"
+      "  <p>Last <span>paragraph<span> with <?pi?> nesting</span></span></p>\n"
+      "</body></html>\n");
+
+  SplitSegments segments = split(input);
+  CHECK(join(segments) == input);
+  std::vector<std::string> expected{
+      "Test",
+      "A <em>big</em> title",
+      "Some text with a <a href='https://example.com/?a=1&amp;b=2'>link</a> &amp; an entity.",
+      "A second line.",
+      "One",
+      "Two <img src=\"x.png\"/> three",
+      "Last <span>paragraph<span> with <?pi?> nesting</span></span>",
+  };
+  CHECK(translated(segments) == expected);
+
+  for (size_t pieceSize = 1; pieceSize < 40; ++pieceSize) {
+    CAPTURE(pieceSize);
+    SplitSegments pieces = split(input, pieceSize);
+    CHECK(join(pieces) == input);
+    CHECK(translated(pieces) == translated(segments));
+  }
+
+  // Each translated segment should be complete HTML on its own.
+  for (auto const &segment : translated(segments)) {
+    std::string html(segment);
+    CHECK_NOTHROW(HTML(std::move(html), true));
+  }
+}
+
+TEST_CASE("Split HTML with a bounded buffer") {
+  // Scripts, comments and ignored elements are copied in parts while they arrive
+  std::string script("<p>x</p><script>" + std::string(1000, 'a') + "</SCRIPT><!--" + std::string(1000, '-') +
+                     "--><p>y</p><code>" + std::string(1000, 'b') + "</code>");
+  HTMLSplitter splitter(HTML::Options(), 100);
+  std::vector<HTMLSplitter::Segment> segments;
+  for (size_t offset = 0; offset < script.size(); offset += 10) {
+    splitter.write(std::string_view(script).substr(offset, 10), segments);
+    size_t written = 0;
+    for (auto const &segment : segments) written += segment.html.size();
+    CHECK(std::min(offset + 10, script.size()) - written <= 120);
+  }
+  splitter.close(segments);
+  CHECK(join(segments) == script);
+  CHECK(translated(segments) == std::vector<std::string>{"x", "y"});
+
+  // Long text is cut between words
+  std::string text("<p>");
+  for (size_t i = 0; i < 100; ++i) text += "word" + std::to_string(i) + " ";
+  text += "</p>";
+  for (size_t pieceSize : {1, 7, 64}) {
+    CAPTURE(pieceSize);
+    SplitSegments pieces = split(text, pieceSize, 100);
+    CHECK(join(pieces) == text);
+    CHECK(translated(pieces).size() > 5);
+    for (auto const &segment : translated(pieces)) {
+      CHECK(segment.size() <= 100 + pieceSize + 10);
+      CHECK(segment.back() == ' ');
+    }
+  }
+
+  // Inline elements are kept whole
+  std::string inlined("<p><b>" + text + "</b></p>");
+  CHECK(translated(split(inlined, 10, 100)) == std::vector<std::string>{"<b>" + text + "</b>"});
+}
+
+TEST_CASE("Split HTML with an unclosed script") {
+  std::string input("<p>x</p><script>" + std::string(500, 'a'));
+  for (size_t maxBuffered : {100, 1000}) {
+    CAPTURE(maxBuffered);
+    SplitSegments segments = split(input, 10, maxBuffered);
+    CHECK(join(segments) == input);
+  }
+}
+
+TEST_CASE_METHOD(MarianThrowsExceptionsFixture, "Split HTML fails at a malformed tag right away") {
+  for (std::string tag : {"<a /c>", "</p x>", "<a <b>"}) {
+    CAPTURE(tag);
+    HTMLSplitter splitter;
+    std::vector<HTMLSplitter::Segment> segments;
+    CHECK_THROWS_WITH(splitter.write("<p>Some text " + tag + " and more</p>", segments), "HTML parse error");
+  }
+
+  // Unless more input can still fix it
+  HTMLSplitter splitter;
+  std::vector<HTMLSplitter::Segment> segments;
+  for (std::string piece : {"<p>Some <a title=\"open", " quote\">link</a></p><br", "/", "><p>x</p>"})
+    CHECK_NOTHROW(splitter.write(piece, segments));
+  CHECK_NOTHROW(splitter.close(segments));
+  CHECK(join(segments) == "<p>Some <a title=\"open quote\">link</a></p><br/><p>x</p>");
+}
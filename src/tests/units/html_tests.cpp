@@ -1,7 +1,13 @@
 #include "html_tests.h"
 
+#include <chrono>
+#include <iostream>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
 #include "catch.hpp"
 #include "data/types.h"  // for marian::string_view
 #include "translator/html.h"
@@ -346,6 +352,55 @@ TEST_CASE("Test reconstruction of target sentence") {
   CHECK(asTokens(response.target) == html_tokens_target);
 }
 
+TEST_CASE("Test reconstruction of target sentence with reordering") {
+  std::string input("<p>one <b>two</b> three four five six seven <i>eight</i> nine</p>");
+  HTML html(std::move(input), true);
+  CHECK(input == "one two three four five six seven eight nine");
+
+  AnnotatedText source("one two three four five six seven eight nine");
+  recordSentenceFromByteRange(source, {
+                                          ByteRange{0, 3},    // 0.0 "one"
+                                          ByteRange{3, 7},    // 0.1 " two"
+                                          ByteRange{7, 13},   // 0.2 " three"
+                                          ByteRange{13, 18},  // 0.3 " four"
+                                          ByteRange{18, 23},  // 0.4 " five"
+                                          ByteRange{23, 27},  // 0.5 " six"
+                                          ByteRange{27, 33},  // 0.6 " seven"
+                                          ByteRange{33, 39},  // 0.7 " eight"
+                                          ByteRange{39, 44},  // 0.8 " nine"
+                                          ByteRange{44, 44}   // 0.9 ""
+                                      });
+
+  AnnotatedText target("nine eight seven six five four three two one");
+  recordSentenceFromByteRange(target, {
+                                          ByteRange{0, 4},    // 0.0 "nine"
+                                          ByteRange{4, 10},   // 0.1 " eight"
+                                          ByteRange{10, 16},  // 0.2 " seven"
+                                          ByteRange{16, 20},  // 0.3 " six"
+                                          ByteRange{20, 25},  // 0.4 " five"
+                                          ByteRange{25, 30},  // 0.5 " four"
+                                          ByteRange{30, 36},  // 0.6 " three"
+                                          ByteRange{36, 40},  // 0.7 " two"
+                                          ByteRange{40, 44},  // 0.8 " one"
+                                          ByteRange{44, 44}   // 0.9 ""
+                                      });
+
+  // Each target token aligns best with its mirror image in the source, tied
+  // with the end of the source sentence. Ties go to the first source token.
+  std::vector<std::vector<float>> alignment(10, std::vector<float>(10, 0.01f));
+  for (size_t t = 0; t < 9; ++t) alignment[t][8 - t] = alignment[t][9] = 0.45f;
+  alignment[9][9] = 1.0f;
+
+  Response response;
+  response.source = source;
+  response.target = target;
+  response.alignments = {alignment};
+
+  html.restore(response);
+
+  CHECK(response.target.text == "<p>nine <i>eight</i> seven six five four three <b>two</b> one</p>");
+}
+
 TEST_CASE("Test reconstruction of target sentence with entities") {
   std::string input("<p>hello <b>world &amp; friends!</b></p>");
   HTML html(std::move(input), true);
@@ -694,6 +749,201 @@ TEST_CASE("Test ignored element (with entity)") {
   CHECK(response.target.text == expected_str);
 }
 
+TEST_CASE("Test attributes are normalised") {
+  std::string test_str("<p id=1 class = 'a b'  hidden data-x=\"y\">hello</p>");
+  std::string expected_str("<p id=\"1\" class=\"a b\" hidden=\"\" data-x=\"y\">hello</p>");
+
+  std::string input(test_str);
+  HTML html(std::move(input), true);
+  CHECK(input == "hello");
+
+  Response response;
+  std::string sentence_str("hello");
+  std::vector<string_view> sentence{
+      string_view(sentence_str.data() + 0, 5),  // hello
+      string_view(sentence_str.data() + 5, 0),  // ""
+  };
+  response.source.appendSentence("", sentence.begin(), sentence.end());
+  response.target.appendSentence("", sentence.begin(), sentence.end());
+  response.alignments = {identity_matrix<float>(2)};
+
+  html.restore(response);
+  CHECK(response.source.text == expected_str);
+  CHECK(response.target.text == expected_str);
+}
+
+TEST_CASE("Test valueless attributes") {
+  std::string test_str("<p hidden>hello <input disabled></p>");
+  std::string expected_str("<p hidden=\"\">hello <input disabled=\"\"></p>");
+
+  std::string input(test_str);
+  HTML html(std::move(input), true);
+  CHECK(input == "hello ");
+
+  Response response;
+  std::string sentence_str("hello ");
+  std::vector<string_view> sentence{
+      string_view(sentence_str.data() + 0, 6),  // hello_
+      string_view(sentence_str.data() + 6, 0),  // ""
+  };
+  response.source.appendSentence("", sentence.begin(), sentence.end());
+  response.target.appendSentence("", sentence.begin(), sentence.end());
+  response.alignments = {identity_matrix<float>(2)};
+
+  html.restore(response);
+  CHECK(response.source.text == expected_str);
+  CHECK(response.target.text == expected_str);
+}
+
+TEST_CASE("Test HTML can be moved after parsing") {
+  // Tags point into the original input, which HTML keeps. Short inputs fit in
+  // std::string's small buffer, so this makes sure moving HTML keeps them valid.
+  std::string test_str("<b id=\"x\">hi</b>");
+
+  std::string input(test_str);
+  HTML parsed(std::move(input), true);
+  HTML html(std::move(parsed));
+  CHECK(input == "hi");
+
+  Response response;
+  std::string sentence_str("hi");
+  std::vector<string_view> sentence{
+      string_view(sentence_str.data() + 0, 2),  // hi
+      string_view(sentence_str.data() + 2, 0),  // ""
+  };
+  response.source.appendSentence("", sentence.begin(), sentence.end());
+  response.target.appendSentence("", sentence.begin(), sentence.end());
+  response.alignments = {identity_matrix<float>(2)};
+
+  html.restore(response);
+  CHECK(response.source.text == test_str);
+  CHECK(response.target.text == test_str);
+}
+
+TEST_CASE("Test quality scores are added as markup") {
+  std::string test_str("<p>hello <b>world</b></p>");
+  std::string expected_str(
+      "<p><font x-bergamot-sentence-index=\"0\" x-bergamot-sentence-score=\"-1\">"
+      "<font x-bergamot-word-index=\"0\" x-bergamot-word-score=\"-0.5\">hello</font></font> "
+      "<b><font x-bergamot-sentence-index=\"0\" x-bergamot-sentence-score=\"-1\">"
+      "<font x-bergamot-word-index=\"1\" x-bergamot-word-score=\"-1.5\">world</font></font></b></p>");
+
+  std::string input(test_str);
+  HTML html(std::move(input), true);
+  CHECK(input == "hello world");
+
+  Response response;
+  std::string sentence_str("hello world");
+  std::vector<string_view> sentence{
+      string_view(sentence_str.data() + 0, 4),   // 0.0 hell
+      string_view(sentence_str.data() + 4, 1),   // 0.1 o
+      string_view(sentence_str.data() + 5, 6),   // 0.2 _world
+      string_view(sentence_str.data() + 11, 0),  // 0.3 ""
+  };
+  response.source.appendSentence("", sentence.begin(), sentence.end());
+  response.target.appendSentence("", sentence.begin(), sentence.end());
+  response.alignments = {identity_matrix<float>(4)};
+
+  Response::SentenceQualityScore quality;
+  quality.wordScores = {-0.5, -1.5};
+  quality.wordRanges = {{0, 2}, {2, 3}};
+  quality.sentenceScore = -1.0;
+  response.qualityScores.push_back(quality);
+
+  html.restore(response);
+  CHECK(response.source.text == test_str);
+  CHECK(response.target.text == expected_str);
+}
+
+// Hidden by default, run with `html_tests "[benchmark]"`.
+TEST_CASE("HTML parsing of a tag-dense page", "[.][benchmark]") {
+  std::string page;
+  for (size_t i = 0; page.size() < (1 << 21); ++i) {
+    page += "<div class=\"row\" id=\"row-" + std::to_string(i) +
+            "\"><ul>\n"
+            "  <li><a href=\"/item?id=1\" title=\"First\">First <b>item</b></a> <span class=\"meta\">(<i>12</i> "
+            "points)</span></li>\n"
+            "  <li><a href='/item?id=2' data-x=2>Second <em>item</em></a><img src=\"a.png\" alt=\"\"><br></li>\n"
+            "  <li><p>Some <u>longer</u> text with <strong>nested <span>inline <b>markup</b></span></strong>, "
+            "&amp; an entity.</p><!-- comment --></li>\n"
+            "</ul></div>\n";
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  auto maxResidentKB = []() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;  // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+  };
+  long before = maxResidentKB();
+#endif
+
+  const size_t iterations = 10;
+  std::vector<HTML> parsed;  // keep them alive so their memory shows up in the resident set size
+  parsed.reserve(iterations);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    std::string input(page);
+    parsed.emplace_back(std::move(input), true);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  double megabytes = static_cast<double>(page.size() * iterations) / (1 << 20);
+  std::cout << "Parsed " << megabytes << " MB of HTML in " << elapsed.count() << "s: " << megabytes / elapsed.count()
+            << " MB/s" << std::endl;
+#if defined(__unix__) || defined(__APPLE__)
+  std::cout << "Peak resident set size grew by " << (maxResidentKB() - before) / 1024 << " MB for " << iterations
+            << " parsed pages" << std::endl;
+#endif
+  CHECK(parsed.size() == iterations);
+}
+
+// Hidden by default, run with `html_tests "[benchmark]"`.
+TEST_CASE("HTML restoration of long sentences", "[.][benchmark]") {
+  const size_t numWords = 1000;
+  std::string page("<p>");
+  std::vector<ByteRange> ranges;
+  std::string text;
+  for (size_t i = 0; i < numWords; ++i) {
+    std::string word = (i == 0 ? "w" : " w") + std::to_string(i);
+    ranges.push_back(ByteRange{text.size(), text.size() + word.size()});
+    text += word;
+    page += i % 3 == 0 ? "<b>" + word + "</b>" : word;
+  }
+  ranges.push_back(ByteRange{text.size(), text.size()});
+  page += "</p>";
+
+  // Every target token aligns mostly with a source token some distance away.
+  std::vector<std::vector<float>> alignment(numWords + 1, std::vector<float>(numWords + 1, 0.0f));
+  for (size_t t = 0; t <= numWords; ++t)
+    for (size_t s = 0; s <= numWords; ++s) alignment[t][s] = 1.0f / (1.0f + (t * 7 + s * 13) % (numWords + 1));
+
+  const size_t iterations = 20;
+  std::chrono::duration<double> elapsed{0};
+  for (size_t i = 0; i < iterations; ++i) {
+    std::string input(page);
+    HTML html(std::move(input), true);
+
+    Response response;
+    response.source = AnnotatedText(std::string(text));
+    recordSentenceFromByteRange(response.source, ranges);
+    response.target = AnnotatedText(std::string(text));
+    recordSentenceFromByteRange(response.target, ranges);
+    response.alignments = {alignment};
+
+    auto start = std::chrono::steady_clock::now();
+    html.restore(response);
+    elapsed += std::chrono::steady_clock::now() - start;
+  }
+
+  std::cout << "Restored " << iterations << " sentences of " << numWords << " words in " << elapsed.count() << "s"
+            << std::endl;
+}
+
 TEST_CASE("End-to-end translation", "[!mayfail]") {
   std::string input("<p>I <b>like</b> to <u>drive</u> this car.</p>");
   HTML html(std::move(input), true);
@@ -702,7 +952,7 @@ TEST_CASE("End-to-end translation", "[!mayfail]") {
   Response response;
 
   // clang-format off
-  response.alignments = std::vector<std::vector<std::vector<float>>>{{
+  response.alignments = std::vector<Alignment>{{
     {0.982376,  0.00742467, 0.00682965, 0.00121767, 0.000848056,6.51436e-05,7.53791e-06,0.00123162},
     {0.165639,  0.368694,   0.230394,   0.222476,   0.00349563, 0.00105052, 0.000603092,0.00764845},
     {0.00493271,0.0805876,  0.0139988,  0.89116,    0.000928116,0.00200724, 0.000512013,0.00587302},
@@ -797,7 +1047,7 @@ TEST_CASE("End-to-end translation when no words with markup align", "[!mayfail]"
   Response response;
 
   // clang-format off
-  response.alignments = std::vector<std::vector<std::vector<float>>>{{
+  response.alignments = std::vector<Alignment>{{
     {0.5360, 0.4405, 0.0142, 0.0061, 0.0029, 0.0001, 0.0000, 0.0001},
     {0.0451, 0.0602, 0.5120, 0.2584, 0.1145, 0.0062, 0.0019, 0.0017},
     {0.0392, 0.0009, 0.6535, 0.2293, 0.0492, 0.0199, 0.0014, 0.0067},
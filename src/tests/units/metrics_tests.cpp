@@ -0,0 +1,65 @@
+#include "catch.hpp"
+#include "translator/metrics.h"
+
+using namespace marian::bergamot;
+
+TEST_CASE("Batching counters follow sentences from the queue into batches") {
+  BatchingCounters counters;
+  counters.enqueued(10);
+  counters.enqueued(6);
+
+  // 5 sentences of 2, 3, 3, 4 and 8 tokens padded to 8, in a batch that takes 64 tokens.
+  counters.batched(/*sentences=*/5, /*tokens=*/20, /*paddedTokens=*/40, /*miniBatchWords=*/64);
+  // 3 sentences of 4 tokens each, no padding.
+  counters.batched(/*sentences=*/3, /*tokens=*/12, /*paddedTokens=*/12, /*miniBatchWords=*/64);
+
+  BatchingMetrics metrics = counters.snapshot();
+  CHECK(metrics.enqueuedSentences == 16);
+  CHECK(metrics.pendingSentences == 8);
+  CHECK(metrics.batches == 2);
+  CHECK(metrics.batchedSentences == 8);
+  CHECK(metrics.batchedTokens == 32);
+  CHECK(metrics.paddedTokens == 52);
+  CHECK(metrics.capacity == 128);
+  CHECK(metrics.fill() == Approx(52.0 / 128));
+  CHECK(metrics.paddingWaste() == Approx(1.0 - 32.0 / 52));
+
+  SECTION("Clearing drops the pending sentences, but keeps what was counted") {
+    counters.cleared();
+    BatchingMetrics cleared = counters.snapshot();
+    CHECK(cleared.pendingSentences == 0);
+    CHECK(cleared.enqueuedSentences == 16);
+    CHECK(cleared.batches == 2);
+
+    counters.enqueued(4);
+    CHECK(counters.snapshot().pendingSentences == 4);
+  }
+}
+
+TEST_CASE("Batching metrics without batches") {
+  BatchingMetrics metrics = BatchingCounters().snapshot();
+  CHECK(metrics.pendingSentences == 0);
+  CHECK(metrics.fill() == 0.0);
+  CHECK(metrics.paddingWaste() == 0.0);
+}
+
+TEST_CASE("Worker counters add up the time spent waiting and translating") {
+  WorkerCounters counters;
+  CHECK(counters.snapshot().utilization() == 0.0);
+
+  counters.startBatch(std::chrono::milliseconds(30));
+  WorkerMetrics during = counters.snapshot();
+  CHECK(during.busy);
+  CHECK(during.idleSeconds == Approx(0.03));
+  CHECK(during.busySeconds == 0.0);
+
+  counters.finishBatch(std::chrono::milliseconds(60));
+  counters.startBatch(std::chrono::milliseconds(10));
+  counters.finishBatch(std::chrono::milliseconds(100));
+
+  WorkerMetrics after = counters.snapshot();
+  CHECK(!after.busy);
+  CHECK(after.idleSeconds == Approx(0.04));
+  CHECK(after.busySeconds == Approx(0.16));
+  CHECK(after.utilization() == Approx(0.8));
+}
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "ssplit.h"
+#include "translator/parallel_split.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+std::string join(const std::vector<std::string_view> &parts) {
+  std::string out;
+  for (auto part : parts) out += part;
+  return out;
+}
+
+std::vector<std::string> sentences(std::string_view text, const ug::ssplit::SentenceSplitter &splitter,
+                                   ug::ssplit::SentenceStream::splitmode mode) {
+  std::vector<std::string> out;
+  auto stream = ug::ssplit::SentenceStream(text, splitter, mode);
+  std::string_view sentence;
+  while (stream >> sentence) out.emplace_back(sentence);
+  return out;
+}
+
+}  // namespace
+
+TEST_CASE("Cut text at paragraphs") {
+  std::string text;
+  for (size_t i = 0; i < 50; i++) {
+    text += "Paragraph " + std::to_string(i) + " has a sentence.\nAnd a line.\n\n";
+  }
+
+  for (size_t maxParts = 1; maxParts < 10; maxParts++) {
+    CAPTURE(maxParts);
+    auto parts = cutAtParagraphs(text, maxParts);
+    CHECK(join(parts) == text);
+    CHECK(parts.size() == maxParts);
+    for (size_t i = 0; i + 1 < parts.size(); i++) {
+      CHECK(parts[i].substr(parts[i].size() - 2) == "\n\n");
+      CHECK(parts[i].size() >= text.size() / maxParts);
+    }
+  }
+
+  // Without blank lines there is nowhere to cut
+  CHECK(cutAtParagraphs("One paragraph.\nTwo lines.", 4).size() == 1);
+  CHECK(cutAtParagraphs("", 4) == std::vector<std::string_view>{""});
+}
+
+TEST_CASE("Parts split into the same sentences as the whole") {
+  std::string text;
+  for (size_t i = 0; i < 20; i++) {
+    text += "Dr. Smith said hello. Then he left!\nA second line? Yes.\n\n";
+    text += "  Indented paragraph,\nwrapped over\nthree lines.\n\n\n\n";
+  }
+
+  ug::ssplit::SentenceSplitter splitter;
+  for (auto mode : {ug::ssplit::SentenceStream::splitmode::one_sentence_per_line,
+                    ug::ssplit::SentenceStream::splitmode::one_paragraph_per_line,
+                    ug::ssplit::SentenceStream::splitmode::wrapped_text}) {
+    std::vector<std::string> whole = sentences(text, splitter, mode);
+    for (size_t maxParts = 2; maxParts < 8; maxParts++) {
+      CAPTURE(maxParts);
+      std::vector<std::string> inParts;
+      for (auto part : cutAtParagraphs(text, maxParts)) {
+        for (auto &sentence : sentences(part, splitter, mode)) inParts.push_back(sentence);
+      }
+      CHECK(inParts == whole);
+    }
+  }
+}
+
+TEST_CASE("Helper threads are limited over all callers") {
+  HelperThreads helpers(3);
+
+  {
+    auto first = helpers.acquire(2);
+    CHECK(first.size() == 2);
+    auto second = helpers.acquire(5);
+    CHECK(second.size() == 1);
+    CHECK(helpers.acquire(1).size() == 0);
+    CHECK(helpers.used() == 3);
+  }
+  CHECK(helpers.used() == 0);
+
+  // Slots are given back exactly once, also when moved
+  {
+    HelperThreads::Slots slots;
+    CHECK(slots.size() == 0);
+    slots = helpers.acquire(2);
+    HelperThreads::Slots moved(std::move(slots));
+    CHECK(moved.size() == 2);
+    CHECK(helpers.used() == 2);
+    moved = helpers.acquire(1);
+    CHECK(helpers.used() == 1);
+  }
+  CHECK(helpers.used() == 0);
+
+  // Many concurrent callers never hold more than the limit together
+  std::atomic<size_t> held{0}, maxHeld{0};
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < 16; t++) {
+    threads.emplace_back([&] {
+      for (size_t i = 0; i < 1000; i++) {
+        auto slots = helpers.acquire(1 + i % 3);
+        size_t now = held += slots.size();
+        size_t seen = maxHeld.load();
+        while (now > seen && !maxHeld.compare_exchange_weak(seen, now)) {
+        }
+        held -= slots.size();
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  CHECK(maxHeld.load() <= 3);
+  CHECK(helpers.used() == 0);
+}
@@ -54,6 +54,119 @@ SCENARIO("Logistic Regressor test", "[QualityEstimator]") {
   }
 }
 
+SCENARIO("Multi-layer perceptron test", "[QualityEstimator]") {
+  GIVEN("An MLP without hidden layer over the logistic regressor features") {
+    const std::vector<std::vector<float> > features = {{-0.3, -0.3, 1.0, -0.183683336},
+                                                       {-0.0001, -0.0001, 1.0, -0.183683336},
+                                                       {-0.002, -0.002, 1.0, -0.183683336},
+                                                       {-0.5, -0.5, 1.0, -0.183683336},
+                                                       {-0.15, -0.2, 2.0, -0.183683336}};
+
+    MLPQualityEstimator::Matrix featureMatrix(features.size(), features.begin()->size());
+
+    for (int i = 0; i < features.size(); ++i) {
+      for (int j = 0; j < features.begin()->size(); ++j) {
+        featureMatrix.at(i, j) = features[i][j];
+      }
+    }
+
+    MLPQualityEstimator::Parameters parameters;
+    parameters.features = {WORD_MEAN_LOGPROB, WORD_MIN_LOGPROB, WORD_NUM_SUBWORDS, SENTENCE_MEAN_LOGPROB};
+    parameters.means = {-0.100000001, -0.769999981, 5, -0.5};
+    parameters.stds = {0.200000003, 0.300000012, 2.5, 0.100000001};
+    parameters.outputWeights = {0.99000001, 0.899999976, -0.200000003, 0.5};
+    parameters.outputBias = -0.300000012;
+
+    MLPQualityEstimator mlpQE(std::move(parameters));
+
+    WHEN("It's call predict") {
+      const std::vector<float> prediction = mlpQE.predict(featureMatrix);
+
+      THEN("return the same prediction as the logistic regressor") {
+        CHECK(prediction == std::vector<float>{-2.14596, -4.41793, -4.403, -0.93204, -3.03343});
+      }
+    }
+
+    THEN("it needs no alignments") { CHECK(!mlpQE.needsAlignments()); }
+  }
+
+  GIVEN("An MLP with a hidden layer") {
+    MLPQualityEstimator::Matrix featureMatrix(2, 2);
+    featureMatrix.at(0, 0) = -1.0;
+    featureMatrix.at(0, 1) = 0.5;
+    featureMatrix.at(1, 0) = 5.0;
+    featureMatrix.at(1, 1) = 1.0;
+
+    MLPQualityEstimator::Parameters parameters;
+    parameters.features = {WORD_MEAN_LOGPROB, WORD_ATTENTION_ENTROPY};
+    parameters.means = {1.0, 0.0};
+    parameters.stds = {2.0, 1.0};
+    parameters.hiddenSize = 2;
+    parameters.hiddenWeights = {1.0, -1.0, 0.5, 2.0};
+    parameters.hiddenBiases = {0.0, -1.0};
+    parameters.outputWeights = {1.0, -2.0};
+    parameters.outputBias = 0.5;
+
+    MLPQualityEstimator mlpQE(std::move(parameters));
+    const std::vector<float> expected = {-0.974077, -0.0788897};
+
+    WHEN("It's call predict") {
+      const std::vector<float> prediction = mlpQE.predict(featureMatrix);
+
+      THEN("return the prediction") { CHECK(prediction == expected); }
+    }
+
+    THEN("it needs alignments from the translation model, for the attention entropy") {
+      CHECK(mlpQE.needsAlignments());
+    }
+
+    WHEN("MLP is construct by aligned memory") {
+      const AlignedMemory memory = mlpQE.toAlignedMemory();
+      const auto mlpQEAlignedMemory = MLPQualityEstimator::fromAlignedMemory(memory);
+
+      THEN("return the same prediction") { CHECK(mlpQEAlignedMemory.predict(featureMatrix) == expected); }
+
+      THEN("createQualityEstimator picks the model type from the magic bytes") {
+        const auto qualityEstimator = createQualityEstimator(memory);
+        CHECK(std::dynamic_pointer_cast<MLPQualityEstimator>(qualityEstimator) != nullptr);
+      }
+    }
+
+    WHEN("The version of the binary format is not supported") {
+      AlignedMemory memory = mlpQE.toAlignedMemory();
+      reinterpret_cast<MLPQualityEstimator::Header*>(memory.begin())->version = MLPQualityEstimator::VERSION + 1;
+
+      THEN("loading it fails") {
+        const bool throwOnAbort = marian::getThrowExceptionOnAbort();
+        marian::setThrowExceptionOnAbort(true);
+        CHECK_THROWS(MLPQualityEstimator::fromAlignedMemory(memory));
+        marian::setThrowExceptionOnAbort(throwOnAbort);
+      }
+    }
+  }
+}
+
+SCENARIO("Mapping subwords to words", "[QualityEstimator]") {
+  GIVEN("The decoded subwords of a sentence, ending with the EOS token") {
+    std::string decoded = "marian es un buen servicio";
+    std::vector<marian::string_view> subwords;
+    for (auto [begin, size] : std::vector<std::pair<size_t, size_t>>{
+             {0, 2}, {2, 2}, {4, 2}, {6, 3}, {9, 3}, {12, 2}, {14, 3}, {17, 5}, {22, 4}, {26, 0}}) {
+      subwords.emplace_back(decoded.data() + begin, size);
+    }
+
+    THEN("a word starts at every subword beginning with whitespace") {
+      const std::vector<SubwordRange> words = mapWords(subwords);
+      CHECK(words == std::vector<SubwordRange>{{0, 3}, {3, 4}, {4, 5}, {5, 7}, {7, 9}});
+    }
+  }
+
+  GIVEN("Only the EOS token") {
+    std::vector<marian::string_view> subwords{marian::string_view()};
+    THEN("there are no words") { CHECK(mapWords(subwords).empty()); }
+  }
+}
+
 bool operator==(const std::vector<float>& value1, const std::vector<float>& value2) {
   return std::equal(value1.begin(), value1.end(), value2.begin(), value2.end(), [](const auto& a, const auto& b) {
     auto value = Approx(b).epsilon(0.001);
@@ -0,0 +1,146 @@
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "catch.hpp"
+#include "data/types.h"  // for marian::string_view
+#include "translator/response.h"
+
+using namespace marian::bergamot;
+using marian::string_view;
+
+namespace {
+
+AnnotatedText makeSentence(std::string &&text, std::vector<ByteRange> const &ranges) {
+  AnnotatedText annotated(std::move(text));
+
+  std::vector<string_view> tokens;
+  tokens.reserve(ranges.size());
+  for (auto &&range : ranges) tokens.emplace_back(annotated.text.data() + range.begin, range.size());
+
+  annotated.recordExistingSentence(tokens.begin(), tokens.end(), annotated.text.data() + ranges[0].begin);
+  return annotated;
+}
+
+void checkAlignment(Alignment const &alignment, std::vector<std::vector<float>> const &expected) {
+  REQUIRE(alignment.rows() == expected.size());
+  for (size_t t = 0; t < alignment.rows(); ++t) {
+    REQUIRE(alignment.cols() == expected[t].size());
+    for (size_t s = 0; s < alignment.cols(); ++s) {
+      CHECK(alignment(t, s) == Approx(expected[t][s]));
+    }
+  }
+}
+
+}  // namespace
+
+TEST_CASE("Remap alignments through a pivot with different tokenization") {
+  // source "x y" -> pivot "ab cd" -> target "u v"
+  Response first;
+  first.source = makeSentence("x y", {{0, 1}, {1, 3}, {3, 3}});
+  first.target = makeSentence("ab cd", {{0, 2}, {2, 5}, {5, 5}});
+  first.alignments = {{
+      {0.5, 0.5, 0.0},  // "ab"
+      {0.0, 1.0, 0.0},  // " cd"
+      {0.0, 0.0, 1.0}   // ""
+  }};
+
+  Response second;
+  second.source = makeSentence("ab cd", {{0, 1}, {1, 2}, {2, 5}, {5, 5}});
+  second.target = makeSentence("u v", {{0, 1}, {1, 3}, {3, 3}});
+  second.alignments = {{
+      {0.25, 0.25, 0.5, 0.0},  // "u"
+      {0.0, 0.0, 1.0, 0.0},    // " v"
+      {0.0, 0.0, 0.0, 1.0}     // ""
+  }};
+
+  std::vector<Alignment> remapped = remapAlignments(first, second);
+  REQUIRE(remapped.size() == 1);
+  checkAlignment(remapped[0], {
+                                  {0.25, 0.75, 0.0},  // "u" is half "a" and "b", half " cd"
+                                  {0.0, 1.0, 0.0},    // " v" is " cd"
+                                  {0.0, 0.0, 1.0}     // ""
+                              });
+}
+
+TEST_CASE("Remap alignments when the first model did not predict EOS") {
+  Response first;
+  first.source = makeSentence("x y", {{0, 1}, {1, 3}, {3, 3}});
+  first.target = makeSentence("ab cd", {{0, 2}, {2, 5}});
+  first.alignments = {{
+      {1.0, 0.0, 0.0},  // "ab"
+      {0.0, 1.0, 0.0}   // " cd"
+  }};
+
+  Response second;
+  second.source = makeSentence("ab cd", {{0, 2}, {2, 5}, {5, 5}});
+  second.target = makeSentence("u", {{0, 1}, {1, 1}});
+  second.alignments = {{
+      {0.5, 0.0, 0.5},  // "u"
+      {0.0, 0.0, 1.0}   // ""
+  }};
+
+  // The probability of the EOS of the second model is spread evenly over the tokens of the first one.
+  std::vector<Alignment> remapped = remapAlignments(first, second);
+  REQUIRE(remapped.size() == 1);
+  checkAlignment(remapped[0], {{0.75, 0.25, 0.0}, {0.5, 0.5, 0.0}});
+}
+
+// Hidden by default, run with `response_tests "[benchmark]"`.
+TEST_CASE("Remap alignments of long sentences", "[.][benchmark]") {
+  const size_t numWords = 500;
+
+  // The pivot is split into one token per word by the first model, and in two by the second one.
+  std::string source, pivot;
+  std::vector<ByteRange> sourceRanges, pivotRanges, splitPivotRanges;
+  for (size_t i = 0; i < numWords; ++i) {
+    std::string word = (i == 0 ? "w" : " w") + std::to_string(i);
+    sourceRanges.push_back(ByteRange{source.size(), source.size() + word.size()});
+    source += word;
+    pivotRanges.push_back(ByteRange{pivot.size(), pivot.size() + word.size()});
+    splitPivotRanges.push_back(ByteRange{pivot.size(), pivot.size() + 1});
+    splitPivotRanges.push_back(ByteRange{pivot.size() + 1, pivot.size() + word.size()});
+    pivot += word;
+  }
+  sourceRanges.push_back(ByteRange{source.size(), source.size()});
+  pivotRanges.push_back(ByteRange{pivot.size(), pivot.size()});
+  splitPivotRanges.push_back(ByteRange{pivot.size(), pivot.size()});
+
+  auto alignment = [](size_t rows, size_t cols) {
+    Alignment out(rows, cols);
+    for (size_t t = 0; t < rows; ++t) {
+      float sum = 0.0f;
+      for (size_t s = 0; s < cols; ++s) sum += out(t, s) = 1.0f / (1.0f + (t * 7 + s * 13) % cols);
+      for (size_t s = 0; s < cols; ++s) out(t, s) /= sum;
+    }
+    return out;
+  };
+
+  Response first;
+  first.source = makeSentence(std::string(source), sourceRanges);
+  first.target = makeSentence(std::string(pivot), pivotRanges);
+  first.alignments = {alignment(pivotRanges.size(), sourceRanges.size())};
+
+  Response second;
+  second.source = makeSentence(std::string(pivot), splitPivotRanges);
+  second.target = makeSentence(std::string(source), sourceRanges);
+  second.alignments = {alignment(sourceRanges.size(), splitPivotRanges.size())};
+
+  const size_t iterations = 20;
+  std::vector<Alignment> remapped;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    remapped = remapAlignments(first, second);
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  std::cout << "Remapped alignments of " << iterations << " sentences of " << numWords << " words in "
+            << elapsed.count() << "s: " << elapsed.count() / iterations * 1000 << " ms per sentence" << std::endl;
+
+  REQUIRE(remapped.size() == 1);
+  for (size_t t = 0; t < remapped[0].rows(); ++t) {
+    float sum = 0.0f;
+    for (size_t s = 0; s < remapped[0].cols(); ++s) sum += remapped[0](t, s);
+    CHECK(sum == Approx(1.0f).epsilon(0.001));
+  }
+}
@@ -0,0 +1,63 @@
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "catch.hpp"
+#include "translator/timing.h"
+
+using namespace marian::bergamot;
+
+TEST_CASE("Stage histograms put times in power of two buckets") {
+  StageHistograms histograms;
+
+  // 90 requests that took 100us to translate and 10 that took 10ms.
+  for (size_t i = 0; i < 90; i++) histograms.record(Stage::TRANSLATE, 100e-6);
+  for (size_t i = 0; i < 10; i++) histograms.record(Stage::TRANSLATE, 10e-3);
+
+  CHECK(histograms.count(Stage::TRANSLATE) == 100);
+  CHECK(histograms.count(Stage::TOKENIZE) == 0);
+
+  // 100us lies in [64, 128) and 10ms in [8192, 16384) microseconds.
+  CHECK(histograms.quantile(Stage::TRANSLATE, 0.50) == Approx(128e-6));
+  CHECK(histograms.quantile(Stage::TRANSLATE, 0.90) == Approx(128e-6));
+  CHECK(histograms.quantile(Stage::TRANSLATE, 0.99) == Approx(16384e-6));
+  CHECK(histograms.quantile(Stage::TOKENIZE, 0.50) == 0.0);
+}
+
+TEST_CASE("Stage histograms record the queue wait of every sentence") {
+  StageTimings timings;
+  timings[Stage::QUEUE] = 3e-3;
+  timings[Stage::TRANSLATE] = 1e-3;
+  timings.sentences.resize(3);
+  timings.sentences[0].queueWait = 1e-3;
+  timings.sentences[1].queueWait = 2e-3;
+  timings.sentences[2].queueWait = 3e-3;
+
+  StageHistograms histograms;
+  histograms.record(timings);
+
+  CHECK(histograms.count(Stage::QUEUE) == 3);
+  CHECK(histograms.count(Stage::TRANSLATE) == 1);
+  CHECK(histograms.count(Stage::HTML_RESTORE) == 1);
+
+  std::ostringstream out;
+  histograms.dump(out);
+  CHECK(out.str().find("queue") != std::string::npos);
+  CHECK(out.str().find("html-restore") != std::string::npos);
+}
+
+TEST_CASE("Stage histograms in a threaded setting") {
+  StageHistograms histograms;
+  size_t numThreads = 8, numIters = 10000;
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < numThreads; t++) {
+    threads.emplace_back([&histograms, numIters, t]() {
+      for (size_t i = 0; i < numIters; i++) histograms.record(Stage::QUEUE, (t + 1) * 1e-6);
+    });
+  }
+  for (auto &thread : threads) thread.join();
+
+  CHECK(histograms.count(Stage::QUEUE) == numThreads * numIters);
+  CHECK(histograms.quantile(Stage::QUEUE, 1.0) == Approx(16e-6));
+}
@@ -0,0 +1,84 @@
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "catch.hpp"
+#include "translator/wrap.h"
+
+using namespace marian::bergamot;
+
+namespace {
+
+/// Views of the tokens of text, one per character but for spaces, which are taken along by the character after them
+/// like SentencePiece does.
+std::vector<std::string_view> characters(const std::string &text) {
+  std::vector<std::string_view> tokens;
+  size_t begin = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    if (text[i] == ' ') continue;
+    tokens.emplace_back(&text[begin], i + 1 - begin);
+    begin = i + 1;
+  }
+  return tokens;
+}
+
+/// Length of every piece the tokens are cut into at starts.
+std::vector<size_t> lengths(const std::vector<size_t> &starts, size_t numTokens) {
+  std::vector<size_t> lengths;
+  for (size_t i = 0; i < starts.size(); i++) {
+    lengths.push_back((i + 1 < starts.size() ? starts[i + 1] : numTokens) - starts[i]);
+  }
+  return lengths;
+}
+
+}  // namespace
+
+TEST_CASE("Fixed wrapping cuts into pieces of the maximum length") {
+  std::string text(25, 'a');
+  auto tokens = characters(text);
+  CHECK(wrapPoints(tokens, 10, WrapMode::FIXED) == std::vector<size_t>{0, 10, 20});
+  CHECK(wrapPoints(tokens, 25, WrapMode::FIXED) == std::vector<size_t>{0});
+  CHECK(wrapPoints({}, 10, WrapMode::FIXED).empty());
+}
+
+TEST_CASE("Balanced wrapping makes as many pieces as fixed, of near-equal length") {
+  std::string text(25, 'a');
+  auto tokens = characters(text);
+  // Without any boundaries to prefer, pieces differ in length by at most one.
+  CHECK(lengths(wrapPoints(tokens, 10, WrapMode::BALANCED), tokens.size()) == std::vector<size_t>{9, 8, 8});
+  CHECK(wrapPoints(tokens, 25, WrapMode::BALANCED) == std::vector<size_t>{0});
+}
+
+TEST_CASE("Balanced wrapping cuts at punctuation, then between words") {
+  SECTION("After a clause ending mark near the middle") {
+    std::string text = "aaaaaaa; bbbbbbbbbbbbbbbb";  // 24 tokens, ';' is the 8th.
+    auto tokens = characters(text);
+    CHECK(wrapPoints(tokens, 20, WrapMode::BALANCED) == std::vector<size_t>{0, 8});
+  }
+
+  SECTION("Before a word rather than inside one") {
+    std::string text = "aaaaaaaaaa aaaaaaaaaaaaaa";  // 24 tokens, the 11th starts a word.
+    auto tokens = characters(text);
+    CHECK(wrapPoints(tokens, 20, WrapMode::BALANCED) == std::vector<size_t>{0, 10});
+  }
+
+  SECTION("A comma gives way to a full stop") {
+    std::string text = "aaaaaaaaaaaa,aa.aaaaaaaaa";  // 25 tokens, ',' is the 13th and '.' the 16th.
+    auto tokens = characters(text);
+    CHECK(wrapPoints(tokens, 20, WrapMode::BALANCED) == std::vector<size_t>{0, 16});
+  }
+}
+
+TEST_CASE("Balanced wrapping never exceeds the maximum length") {
+  std::string text = "a. b, c d eeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeeee f. g";
+  auto tokens = characters(text);
+  for (size_t maxLength = 1; maxLength <= tokens.size(); maxLength++) {
+    auto fixed = wrapPoints(tokens, maxLength, WrapMode::FIXED);
+    auto balanced = wrapPoints(tokens, maxLength, WrapMode::BALANCED);
+    REQUIRE(balanced.size() == fixed.size());
+    for (size_t length : lengths(balanced, tokens.size())) {
+      CHECK(length >= 1);
+      CHECK(length <= maxLength);
+    }
+  }
+}
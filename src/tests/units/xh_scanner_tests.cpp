@@ -1,3 +1,5 @@
+#include <chrono>
+#include <iostream>
 #include <string>
 
 #include "catch.hpp"
@@ -258,4 +260,124 @@ TEST_CASE("scan processing instruction") {
   CHECK(scanner.value() == "xml version=\"1.0\"");
   CHECK(scanner.next() == markup::Scanner::TT_PROCESSING_INSTRUCTION_END);
   CHECK(scanner.next() == markup::Scanner::TT_EOF);
-}
\ No newline at end of file
+}
+
+TEST_CASE("scan unterminated unquoted attribute") {
+  markup::instream in("<a href=test");
+  markup::Scanner scanner(in);
+
+  CHECK(scanner.next() == markup::Scanner::TT_TAG_START);
+  CHECK(scanner.next() == markup::Scanner::TT_ATTRIBUTE);
+  CHECK(scanner.attribute() == "href");
+  CHECK(scanner.value() == "test");
+  CHECK(scanner.next() == markup::Scanner::TT_EOF);
+}
+
+// The scanner skips ahead a block of characters at a time. These tests make
+// sure that the delimiters are found at every offset within and across blocks.
+TEST_CASE("scan text runs of varying length") {
+  for (size_t len = 1; len < 80; ++len) {
+    std::string text(len, 'x');
+    std::string html = text + "<b>" + text + "&amp;" + text;
+    markup::instream in(html.data(), html.data() + html.size());
+    markup::Scanner scanner(in);
+
+    CAPTURE(len);
+    CHECK(scanner.next() == markup::Scanner::TT_TEXT);
+    CHECK(scanner.value() == text);
+    CHECK(scanner.next() == markup::Scanner::TT_TAG_START);
+    CHECK(scanner.tag() == "b");
+    CHECK(scanner.next() == markup::Scanner::TT_TEXT);
+    CHECK(scanner.value() == text);
+    CHECK(scanner.next() == markup::Scanner::TT_TEXT);
+    CHECK(scanner.value() == "&");
+    CHECK(scanner.next() == markup::Scanner::TT_TEXT);
+    CHECK(scanner.value() == text);
+    CHECK(scanner.next() == markup::Scanner::TT_EOF);
+  }
+}
+
+TEST_CASE("scan attributes of varying length") {
+  for (size_t len = 1; len < 80; ++len) {
+    std::string name(len, 'n'), value(len, 'v'), space(len, ' ');
+    std::string html = "<a" + space + name + space + "=" + space + "\"" + value + "\"" + space + name + "='" + value +
+                       "'" + space + name + "=" + value + space + name + ">";
+    markup::instream in(html.data(), html.data() + html.size());
+    markup::Scanner scanner(in);
+
+    CAPTURE(len);
+    CHECK(scanner.next() == markup::Scanner::TT_TAG_START);
+    CHECK(scanner.tag() == "a");
+    for (size_t i = 0; i < 3; ++i) {
+      CHECK(scanner.next() == markup::Scanner::TT_ATTRIBUTE);
+      CHECK(scanner.attribute() == name);
+      CHECK(scanner.value() == value);
+    }
+    CHECK(scanner.next() == markup::Scanner::TT_ATTRIBUTE);
+    CHECK(scanner.attribute() == name);
+    CHECK(scanner.value() == "");
+    CHECK(scanner.next() == markup::Scanner::TT_EOF);
+  }
+}
+
+TEST_CASE("scan comments and scripts of varying length") {
+  for (size_t len = 1; len < 80; ++len) {
+    std::string data = std::string(len, 'x') + " a > b -- c ?> </scrip> " + std::string(len, 'y');
+    std::string html = "<!--" + data + "--><script>" + data + "</SCRIPT>";
+    markup::instream in(html.data(), html.data() + html.size());
+    markup::Scanner scanner(in);
+
+    CAPTURE(len);
+    CHECK(scanner.next() == markup::Scanner::TT_COMMENT_START);
+    CHECK(scanner.next() == markup::Scanner::TT_DATA);
+    CHECK(scanner.value() == data);
+    CHECK(scanner.next() == markup::Scanner::TT_COMMENT_END);
+    CHECK(scanner.next() == markup::Scanner::TT_TAG_START);
+    CHECK(scanner.tag() == "script");
+    CHECK(scanner.next() == markup::Scanner::TT_DATA);
+    CHECK(scanner.value() == data);
+    CHECK(scanner.next() == markup::Scanner::TT_TAG_END);
+    CHECK(scanner.next() == markup::Scanner::TT_EOF);
+  }
+}
+
+TEST_CASE("scan with embedded null characters") {
+  std::string html("text\0<b title=\"a\0b\">", 20);
+  markup::instream in(html.data(), html.data() + html.size());
+  markup::Scanner scanner(in);
+
+  CHECK(scanner.next() == markup::Scanner::TT_TEXT);
+  CHECK(scanner.value() == "text");
+  CHECK(scanner.next() == markup::Scanner::TT_EOF);
+}
+
+// Hidden by default, run with `xh_scanner_tests "[benchmark]"`.
+TEST_CASE("scanner throughput", "[.][benchmark]") {
+  std::string html;
+  while (html.size() < (1 << 20)) {
+    html +=
+        "<div class=\"paragraph\" id=para data-index='12'>\n"
+        "    <p>Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do eiusmod tempor incididunt ut labore "
+        "et dolore magna aliqua. Ut enim ad minim veniam, quis nostrud exercitation ullamco laboris nisi ut "
+        "aliquip ex ea commodo consequat. <a href=\"https://example.com/some/long/path?query=value&amp;other=1\" "
+        "title=\"Example link\">Duis aute irure</a> dolor in reprehenderit in voluptate velit esse cillum dolore "
+        "eu fugiat nulla pariatur &amp; excepteur sint occaecat.</p>\n"
+        "    <!-- a comment that is somewhat long to skip over -->\n"
+        "</div>\n";
+  }
+
+  const size_t iterations = 20;
+  size_t tokens = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < iterations; ++i) {
+    markup::instream in(html.data(), html.data() + html.size());
+    markup::Scanner scanner(in);
+    while (scanner.next() != markup::Scanner::TT_EOF) ++tokens;
+  }
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  double megabytes = static_cast<double>(html.size() * iterations) / (1 << 20);
+  std::cout << "Scanned " << megabytes << " MB (" << tokens << " tokens) in " << elapsed.count() << "s: "
+            << megabytes / elapsed.count() << " MB/s" << std::endl;
+  CHECK(tokens > 0);
+}
@@ -11,6 +11,7 @@ AggregateBatchingPool::AggregateBatchingPool() {
 size_t AggregateBatchingPool::enqueueRequest(Ptr<TranslationModel> model, Ptr<Request> request) {
   size_t sentencesEnqueued = model->enqueueRequest(request);
   aggregateQueue_.insert(model);
+  counters_.enqueued(sentencesEnqueued);
   return sentencesEnqueued;
 }
 
@@ -20,6 +21,7 @@ size_t AggregateBatchingPool::generateBatch(Ptr<TranslationModel>& model, Batch&
     Ptr<TranslationModel> candidate = *candidateItr;
     size_t numSentences = candidate->generateBatch(batch);
     if (numSentences > 0) {
+      counters_.batched(batch, candidate->miniBatchWords());
       model = candidate;
       return numSentences;
     } else {
@@ -30,7 +32,14 @@ size_t AggregateBatchingPool::generateBatch(Ptr<TranslationModel>& model, Batch&
   return /*numSentences=*/0;
 }
 
-void AggregateBatchingPool::clear() { aggregateQueue_.clear(); }
+void AggregateBatchingPool::clear() {
+  // Models that are not in the queue have nothing pending.
+  for (auto &model : aggregateQueue_) {
+    model->clear();
+  }
+  aggregateQueue_.clear();
+  counters_.cleared();
+}
 
 }  // namespace bergamot
 }  // namespace marian
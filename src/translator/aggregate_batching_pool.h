@@ -5,6 +5,7 @@
 #include <queue>
 
 #include "data/types.h"
+#include "metrics.h"
 #include "translation_model.h"
 
 namespace marian {
@@ -58,12 +59,16 @@ class AggregateBatchingPool {
   /// @returns Number of sentences in the generated batch.
   size_t generateBatch(Ptr<TranslationModel>& model, Batch& batch);
 
-  /// Clear the aggregate queue. Does not clear the underlying model/request pairs but the next call
-  /// to `generateBatch()` will return 0. (Unless `enqueueRequest()` was called in the mean time.)
+  /// Clear the aggregate queue along with the sentences queued with the models in it. The next call to
+  /// `generateBatch()` will return 0. (Unless `enqueueRequest()` was called in the mean time.)
   void clear();
 
+  /// Snapshot of the sentences queued and batches generated over all models. Safe to call from any thread.
+  BatchingMetrics metrics() const { return counters_.snapshot(); }
+
  private:
   std::unordered_set<std::shared_ptr<TranslationModel>, HashPtr<TranslationModel>> aggregateQueue_;
+  BatchingCounters counters_;
 };
 
 }  // namespace bergamot
@@ -1,13 +1,22 @@
 #include "annotation.h"
 
 #include <cassert>
+#include <limits>
+
+#include "common/logging.h"
 
 namespace marian {
 namespace bergamot {
 
+AnnotationOffset AnnotatedText::toOffset(size_t offset) {
+  ABORT_IF(offset > std::numeric_limits<AnnotationOffset>::max(),
+           "Text of {} bytes is too large for annotations, build without COMPACT_ANNOTATION", offset);
+  return static_cast<AnnotationOffset>(offset);
+}
+
 AnnotatedText::AnnotatedText(std::string &&t) : text(std::move(t)) {
   // Treat the entire text as a gap that recordExistingSentence will break.
-  annotation.token_begin_.back() = text.size();
+  annotation.token_begin_.back() = toOffset(text.size());
 }
 
 void AnnotatedText::appendSentence(string_view prefix, std::vector<string_view>::iterator begin,
@@ -21,7 +30,7 @@ void AnnotatedText::appendSentence(string_view prefix, std::vector<string_view>:
   std::size_t offset = text.size();
   for (std::vector<string_view>::iterator token = begin; token != end; ++token) {
     offset += token->size();
-    annotation.token_begin_.push_back(offset);
+    annotation.token_begin_.push_back(toOffset(offset));
   }
   if (begin != end) {
     text.append(begin->data(), (end - 1)->data() + (end - 1)->size());
@@ -30,13 +39,13 @@ void AnnotatedText::appendSentence(string_view prefix, std::vector<string_view>:
 
   // Add the gap after the sentence.  This is empty for now, but will be
   // extended with appendEndingWhitespace or another appendSentence.
-  annotation.gap_.push_back(annotation.token_begin_.size() - 1);
-  annotation.token_begin_.push_back(offset);
+  annotation.gap_.push_back(toOffset(annotation.token_begin_.size() - 1));
+  annotation.token_begin_.push_back(toOffset(offset));
 }
 
 void AnnotatedText::appendEndingWhitespace(string_view whitespace) {
   text.append(whitespace.data(), whitespace.size());
-  annotation.token_begin_.back() = text.size();
+  annotation.token_begin_.back() = toOffset(text.size());
 }
 
 void AnnotatedText::recordExistingSentence(std::vector<string_view>::iterator begin,
@@ -52,18 +61,20 @@ void AnnotatedText::recordExistingSentence(std::vector<string_view>::iterator be
     assert(i->data() >= text.data());                                  // In range.
     assert(i->data() + i->size() <= text.data() + text.size());        // In range
     assert(i + 1 == end || i->data() + i->size() == (i + 1)->data());  // Contiguous
-    annotation.token_begin_.push_back(i->data() - text.data());
+    // Offsets within text, which fits in AnnotationOffset as the constructor checked.
+    annotation.token_begin_.push_back(static_cast<AnnotationOffset>(i->data() - text.data()));
   }
   // Gap token after sentence.
-  annotation.gap_.push_back(annotation.token_begin_.size());
+  annotation.gap_.push_back(toOffset(annotation.token_begin_.size()));
   if (begin != end) {
-    annotation.token_begin_.push_back((end - 1)->data() + (end - 1)->size() - text.data());
+    const char *sentence_end = (end - 1)->data() + (end - 1)->size();
+    annotation.token_begin_.push_back(static_cast<AnnotationOffset>(sentence_end - text.data()));
   } else {
     // empty sentence.
-    annotation.token_begin_.push_back(sentence_begin - text.data());
+    annotation.token_begin_.push_back(static_cast<AnnotationOffset>(sentence_begin - text.data()));
   }
   // Add back size token ending.
-  annotation.token_begin_.push_back(text.size());
+  annotation.token_begin_.push_back(static_cast<AnnotationOffset>(text.size()));
 }
 
 }  // namespace bergamot
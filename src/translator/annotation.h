@@ -2,6 +2,7 @@
 #define BERGAMOT_SENTENCE_RANGES_H_
 
 #include <cassert>
+#include <cstdint>
 #include <utility>
 #include <vector>
 
@@ -11,6 +12,14 @@
 namespace marian {
 namespace bergamot {
 
+#ifdef COMPACT_ANNOTATION
+/// Byte offsets into the text are stored in 32 bits, which halves the memory taken by annotations and limits the text
+/// of an AnnotatedText to 4 GiB.
+typedef uint32_t AnnotationOffset;
+#else
+typedef size_t AnnotationOffset;
+#endif
+
 /// Annotation expresses sentence and token boundary information as ranges of
 /// bytes in a string, but does not itself own the string.
 ///
@@ -46,6 +55,13 @@ class Annotation {
 
   size_t numSentences() const { return gap_.size() - 1; }
 
+  /// Reserves room for numSentences more sentences with numWords words between them, to avoid reallocations when the
+  /// number is known up front.
+  void reserve(size_t numSentences, size_t numWords) {
+    token_begin_.reserve(token_begin_.size() + numWords + numSentences);
+    gap_.reserve(gap_.size() + numSentences);
+  }
+
   /// Returns number of words in the sentence identified by `sentenceIdx`.
   size_t numWords(size_t sentenceIdx) const {
     return gap_[sentenceIdx + 1] - gap_[sentenceIdx] - 1 /* minus the gap */;
@@ -80,7 +96,7 @@ class Annotation {
   ///   [token_begin_[i], token_begin_[i+1])
   /// The vector is padded so that these indices are always valid, even at the
   /// end.  So tokens_begin_.size() is the number of tokens plus 1.
-  std::vector<size_t> token_begin_;
+  std::vector<AnnotationOffset> token_begin_;
 
   /// Indices of tokens that correspond to gaps between sentences.  These are
   /// indices into token_begin_.
@@ -103,7 +119,7 @@ class Annotation {
   /// Example: one token "hi" -> empty gap, sentence with one token, empty gap
   /// token_begin_ = {0, 0, 2, 2};
   /// gap_ = {0, 2};
-  std::vector<size_t> gap_;
+  std::vector<AnnotationOffset> gap_;
 };
 
 /// AnnotatedText is effectively std::string text + Annotation, providing the
@@ -156,6 +172,9 @@ struct AnnotatedText {
   /// Returns the number of sentences in the annotation structure.
   const size_t numSentences() const { return annotation.numSentences(); }
 
+  /// See Annotation::reserve.
+  void reserve(size_t numSentences, size_t numWords) { annotation.reserve(numSentences, numWords); }
+
   /// Returns number of words in the sentece identified by sentenceIdx.
   const size_t numWords(size_t sentenceIdx) const { return annotation.numWords(sentenceIdx); }
 
@@ -224,6 +243,9 @@ struct AnnotatedText {
   string_view asStringView(const ByteRange &byteRange) const {
     return string_view(text.data() + byteRange.begin, byteRange.size());
   }
+
+  /// Converts a byte offset into text for storage in the annotation, aborting if it does not fit.
+  static AnnotationOffset toOffset(size_t offset);
 };
 
 }  // namespace bergamot
@@ -17,9 +17,11 @@ void Batch::log() {
 
 void Batch::add(const RequestSentence &sentence) { sentences_.push_back(sentence); }
 
-void Batch::completeBatch(const Histories &histories) {
+void Batch::completeBatch(const TranslatedSentences &translations, const WorkerTimings &timings) {
+  WorkerTimings share{timings.started, timings.translate / sentences_.size(),
+                      timings.qualityEstimate / sentences_.size()};
   for (size_t i = 0; i < sentences_.size(); i++) {
-    sentences_[i].completeSentence(histories[i]);
+    sentences_[i].completeSentence(translations[i], share);
   }
 }
 }  // namespace bergamot
@@ -2,6 +2,7 @@
 #define SRC_BERGAMOT_BATCH_H
 
 #include "request.h"
+#include "timing.h"
 #include "translator/beam_search.h"
 
 namespace marian {
@@ -22,13 +23,14 @@ class Batch {
   //
   // sentences() are used to access sentences to construct marian internal
   // batch.
-  const RequestSentences &sentences() { return sentences_; }
+  const RequestSentences &sentences() const { return sentences_; }
 
-  // On obtaining Histories after translating a batch, completeBatch can be
-  // called with Histories , which forwards the call to Request through
+  // On obtaining TranslatedSentences after translating a batch, completeBatch
+  // can be called with them, which forwards the call to Request through
   // RequestSentence and triggers completion, by setting the promised value to
-  // the future given to client.
-  void completeBatch(const Histories &histories);
+  // the future given to client. The time the worker spent on the batch is
+  // split evenly across its sentences.
+  void completeBatch(const TranslatedSentences &translations, const WorkerTimings &timings = WorkerTimings());
 
   // Convenience function to log batch-statistics. numTokens, max-length.
   void log();
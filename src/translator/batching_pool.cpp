@@ -45,11 +45,18 @@ size_t BatchingPool::generateBatch(Batch &batch) {
       } else {
         // Check if elements exist
         assert(batch.size() > 0);
-        return batch.size();
+        return completeBatch(batch);
       }
     }
   }
 
+  return completeBatch(batch);
+}
+
+size_t BatchingPool::completeBatch(const Batch &batch) {
+  if (batch.size() > 0) {
+    counters_.batched(batch, miniBatchWords_);
+  }
   return batch.size();
 }
 
@@ -76,6 +83,7 @@ size_t BatchingPool::enqueueRequest(Ptr<Request> request) {
     }
   }
 
+  counters_.enqueued(toBeFreshlyTranslated);
   return toBeFreshlyTranslated;
 }
 
@@ -83,6 +91,7 @@ void BatchingPool::clear() {
   for (size_t length = 0; length < bucket_.size(); length++) {
     bucket_[length].clear();
   }
+  counters_.cleared();
 }
 
 }  // namespace bergamot
@@ -8,6 +8,7 @@
 #include "common/options.h"
 #include "data/corpus_base.h"
 #include "definitions.h"
+#include "metrics.h"
 #include "request.h"
 
 namespace marian {
@@ -29,11 +30,22 @@ class BatchingPool {
   // Removes any pending requests from the pool.
   void clear();
 
+  // Maximum number of tokens in a batch, including padding.
+  size_t miniBatchWords() const { return miniBatchWords_; }
+
+  // Snapshot of the sentences queued and the batches generated so far. Safe to
+  // call from any thread.
+  BatchingMetrics metrics() const { return counters_.snapshot(); }
+
  private:
+  // Records a generated batch, returns its size.
+  size_t completeBatch(const Batch &batch);
+
   size_t miniBatchWords_;
   std::vector<std::set<RequestSentence>> bucket_;
   size_t batchNumber_{0};
   size_t maxActiveBucketLength_;
+  BatchingCounters counters_;
 };
 
 }  // namespace bergamot
@@ -1,7 +1,12 @@
 #pragma once
 #include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "definitions.h"
@@ -86,6 +91,99 @@ class AtomicCache {
   Equals equals_;
 };
 
-typedef AtomicCache<size_t, Ptr<History>> TranslationCache;
+struct TranslatedSentence;
+typedef AtomicCache<size_t, Ptr<TranslatedSentence const>> TranslationCache;
+
+/// Tokenization of a sentence. The byte ranges of the tokens are kept as offsets from the start of the sentence, so
+/// that they apply to any occurrence of the same sentence.
+struct TokenizedSentence {
+  Segment segment;
+  std::vector<std::pair<uint32_t, uint32_t>> tokenOffsets;  ///< Begin and end of every token.
+};
+
+struct Response;
+
+/// A finished Response, along with what it was made from to tell a hash collision from a hit. Rather than a copy of
+/// the source text, which can be a whole document, a second hash of it that is independent of the one the cache is
+/// keyed on is kept, together with its length.
+struct CachedResponse {
+  size_t modelId;
+  uint64_t sourceHash;  ///< hashSource() of the source text.
+  size_t sourceSize;
+  std::chrono::steady_clock::time_point stored;
+
+  /// Without source text if that was the same as the source of the request: a hit takes it from the new request.
+  Ptr<Response const> response;
+  bool sourceFromRequest{false};
+
+  /// 64-bit FNV-1a over eight bytes at a time, unrelated to the std::hash that keys ResponseCache.
+  static uint64_t hashSource(string_view source) {
+    const uint64_t prime = 0x100000001b3;
+    uint64_t hash = 0xcbf29ce484222325;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= source.size(); i += sizeof(uint64_t)) {
+      uint64_t word;
+      std::memcpy(&word, source.data() + i, sizeof(uint64_t));
+      hash = (hash ^ word) * prime;
+      hash ^= hash >> 29;  // The multiplication only carries upwards, so fold the high bits back in.
+    }
+    for (; i < source.size(); ++i) {
+      hash = (hash ^ static_cast<unsigned char>(source[i])) * prime;
+    }
+    return hash;
+  }
+
+  /// Whether `text` is the source this was made from, to the same certainty as matches().
+  bool isSource(string_view text) const { return text.size() == sourceSize && hashSource(text) == sourceHash; }
+
+  /// Whether this entry answers `request`, an entry made for a new request with the same key: it has to be for the
+  /// same model and source, and at most `ttl` seconds older than the request. A ttl of 0 means no expiry.
+  bool matches(const CachedResponse &request, double ttl) const {
+    return modelId == request.modelId && sourceSize == request.sourceSize && sourceHash == request.sourceHash &&
+           (ttl <= 0.0 || std::chrono::duration<double>(request.stored - stored).count() < ttl);
+  }
+};
+
+/// Whole requests, keyed on a hash of the source text, the ResponseOptions and the model.
+typedef AtomicCache<size_t, Ptr<CachedResponse const>> ResponseCache;
+
+/// Keyed on the bytes of the sentence itself rather than a hash, as a collision would silently tokenize a sentence as
+/// a different one.
+typedef AtomicCache<std::string, Ptr<TokenizedSentence const>> TokenizationCache;
+
+/// Tokenizes sentence through cache: gives the cached tokenization if there is one, or else calls
+/// `encode(sentence, wordRanges)` and stores what it made. Either way, views of the tokens in sentence are appended to
+/// wordRanges.
+///
+/// Empty sentences are left to encode. Records of the cache start out as an empty key with a null value, so looking
+/// up an empty sentence would find one of those.
+template <class Encode>
+Segment tokenizeThroughCache(TokenizationCache &cache, const string_view &sentence,
+                             std::vector<string_view> &wordRanges, Encode &&encode) {
+  if (sentence.empty()) {
+    return encode(sentence, wordRanges);
+  }
+
+  std::string key(sentence.data(), sentence.size());
+  auto [found, cached] = cache.find(key);
+  if (found && cached) {
+    wordRanges.reserve(wordRanges.size() + cached->tokenOffsets.size());
+    for (auto &[begin, end] : cached->tokenOffsets) {
+      wordRanges.emplace_back(sentence.data() + begin, end - begin);
+    }
+    return cached->segment;
+  }
+
+  size_t first = wordRanges.size();
+  auto tokenized = New<TokenizedSentence>();
+  tokenized->segment = encode(sentence, wordRanges);
+  tokenized->tokenOffsets.reserve(wordRanges.size() - first);
+  for (size_t i = first; i < wordRanges.size(); i++) {
+    uint32_t begin = static_cast<uint32_t>(wordRanges[i].data() - sentence.data());
+    tokenized->tokenOffsets.emplace_back(begin, begin + static_cast<uint32_t>(wordRanges[i].size()));
+  }
+  cache.store(key, tokenized);
+  return tokenized->segment;
+}
 
 }  // namespace marian::bergamot
@@ -1,11 +1,17 @@
 #include "html.h"
 
 #include <algorithm>
+#include <initializer_list>
 
 #include "response.h"
 #include "translator/definitions.h"
 #include "xh_scanner.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HTML_ARGMAX_SSE2
+#endif
+
 namespace {
 using marian::bergamot::AnnotatedText;
 using marian::bergamot::ByteRange;
@@ -52,11 +58,16 @@ size_t countPrefixWhitespaces(marian::string_view const &input) {
   return size;
 }
 
-std::string toLowerCase(std::string_view const &input) {
-  std::string out;
+/// Writes lowercase `input` to `out`. Reusing `out` between calls avoids an
+/// allocation for every tag name.
+void toLowerCase(std::string_view const &input, std::string &out) {
   out.resize(input.size());
   std::transform(input.begin(), input.end(), out.begin(), [](unsigned char c) { return std::tolower(c); });
-  return out;
+}
+
+bool equalsCaseInsensitive(std::string_view const &lhs, std::string_view const &rhs) {
+  auto equals = [](unsigned char l, unsigned char r) { return std::tolower(l) == std::tolower(r); };
+  return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin(), equals);
 }
 
 /// Very simple replacement for std::format introduced in C++20. Only supports
@@ -82,62 +93,55 @@ std::string format(std::string const &formatTemplate, Arg arg, Args... args) {
   return os.str();
 }
 
-/// Syntactic sugar around rbegin() and rend() that allows me to write
-/// `for (auto &&item : reversed(container))` instead of the needlessly verbose
-/// `for (auto it = container.rbegin(); it != container.rend(); ++it)`
-template <typename T>
-class Reversed {
- public:
-  using iterator = typename T::const_reverse_iterator;
-  explicit Reversed(T const &container) : container_(container){};
-  iterator begin() const { return container_.rbegin(); }
-  iterator end() const { return container_.rend(); }
-
- private:
-  T const &container_;
-};
-
-/// When comparing two tag stacks, determine which tags need to be closed and
-/// opened to get from one stack to the other.
-void diffTags(HTML::TagStack const &prev, HTML::TagStack const &curr, HTML::TagStack &opening,
-              HTML::TagStack &closing) {
-  opening.clear();
-  closing.clear();
-
-  size_t i = 0;
-
-  // Find first difference
-  for (; i < prev.size(); ++i)
-    if (i >= curr.size() || prev[i] != curr[i]) break;
-
-  // Only nodes of type ELEMENT can have children and thus would need a closing tag.
-  // NOLINTNEXTLINE(bugprone-narrowing-conversions)
-  std::copy_if(prev.begin() + i, prev.end(), std::back_inserter(closing),
-               [&](HTML::Tag *tag) { return tag->type == HTML::Tag::ELEMENT; });
-
-  // NOLINTNEXTLINE(bugprone-narrowing-conversions)
-  opening.insert(opening.end(), curr.begin() + i, curr.end());
-}
-
 bool intersects(ByteRange const &range, HTML::Span const &span) {
   return range.begin <= span.end && range.end >= span.begin;
 };
 
 bool contains(HTML::TagNameSet const &set, std::string_view const &name) { return set.find(name) != set.end(); }
 
-bool contains(HTML::TagStack const &stack, HTML::Tag const *tag) {
-  return std::find(stack.rbegin(), stack.rend(), tag) != stack.rend();
+bool contains(HTML::TagStack stack, HTML::Tag const *tag) {
+  for (; !stack.empty(); stack = stack.pop())
+    if (stack.back() == tag) return true;
+  return false;
 }
 
 /// Is tag stack B an extended version of A? I.e. same tags, but maybe a few
 /// more nested deeper.
 bool extends(HTML::TagStack const &b, HTML::TagStack const &a) {
-  if (a.size() > b.size()) return false;
+  return a.size() <= b.size() && HTML::TagStack::commonSize(a, b) == a.size();
+}
 
-  for (auto i = a.begin(), j = b.begin(); i != a.end(); ++i, ++j)
-    if (*i != *j) return false;
+/// Index of the first largest element in `values`, i.e. the same as
+/// `std::max_element(values, values + size) - values`. Alignment rows are
+/// as long as the source sentence, so this is vectorized for longer rows.
+size_t argmax(const float *values, size_t size) {
+#if defined(HTML_ARGMAX_SSE2)
+  if (size >= 8) {
+    // First find the largest value, four at a time.
+    size_t i = 4;
+    __m128 max = _mm_loadu_ps(values);
+    for (; i + 4 <= size; i += 4) max = _mm_max_ps(max, _mm_loadu_ps(values + i));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(2, 3, 0, 1)));
+    max = _mm_max_ps(max, _mm_shuffle_ps(max, max, _MM_SHUFFLE(1, 0, 3, 2)));
+    float best = _mm_cvtss_f32(max);
+    for (; i < size; ++i)
+      if (values[i] > best) best = values[i];
+
+    // Then find the first position it occurs at.
+    const __m128 needle = _mm_set1_ps(best);
+    for (i = 0; i + 4 <= size; i += 4) {
+      int mask = _mm_movemask_ps(_mm_cmpeq_ps(_mm_loadu_ps(values + i), needle));
+      if (mask)
+        for (size_t j = 0; j < 4; ++j)
+          if (mask & (1 << j)) return i + j;
+    }
+    for (; i < size; ++i)
+      if (values[i] == best) return i;
 
-  return true;
+    // Only reachable if the row contains NaNs, fall back to the scalar version.
+  }
+#endif
+  return std::max_element(values, values + size) - values;
 }
 
 /// Tests whether `response` has alignment info associated with it or not.
@@ -148,13 +152,14 @@ bool hasAlignments(Response const &response) {
   for (size_t sentenceIdx = 0; sentenceIdx < response.target.numSentences(); ++sentenceIdx) {
     // If response.alignments is just empty, this might catch it.
     if (response.alignments.size() <= sentenceIdx ||
-        response.alignments[sentenceIdx].size() != response.target.numWords(sentenceIdx))
+        response.alignments[sentenceIdx].rows() != response.target.numWords(sentenceIdx))
       return false;
 
     // If response.alignments is "empty" because the model did not provide alignments,
     // it still has entries for each target word. But all these entries are empty.
-    for (size_t wordIdx = 0; wordIdx < response.target.numWords(sentenceIdx); ++wordIdx)
-      if (response.alignments[sentenceIdx][wordIdx].size() != response.source.numWords(sentenceIdx)) return false;
+    if (response.target.numWords(sentenceIdx) > 0 &&
+        response.alignments[sentenceIdx].cols() != response.source.numWords(sentenceIdx))
+      return false;
   }
   return true;
 }
@@ -173,48 +178,67 @@ class TokenFormatter {
 
   // Append the markup necessary for moving from `prev` set of tags to `curr`.
   void append(HTML::TagStack const &prev, HTML::TagStack const &curr) {
-    HTML::TagStack opening, closing;
+    size_t common = HTML::TagStack::commonSize(prev, curr);
+
+    // Close tags, innermost first. Only nodes of type ELEMENT can have children
+    // and thus would need a closing tag.
+    for (HTML::TagStack stack = prev; stack.size() > common; stack = stack.pop())
+      if (stack.back()->type == HTML::Tag::ELEMENT) close(*stack.back());
 
-    diffTags(prev, curr, opening, closing);
+    open(curr, common);
+  }
 
-    for (HTML::Tag const *tag : Reversed(closing)) {
-      assert(tag->type == HTML::Tag::ELEMENT);
-      std::string closeTag = format("</{}>", tag->name);
-      html_.insert(offset_ + (closeLeft_ ? 0 : whitespaceSize_), closeTag);
-      offset_ += closeTag.size();
-      if (closeLeft_) whitespaceOffset_ += closeTag.size();
+ private:
+  // Opens the tags of `stack` above the first `common` ones, outermost first.
+  void open(HTML::TagStack const &stack, size_t common) {
+    if (stack.size() <= common) return;
+    open(stack.pop(), common);
+
+    HTML::Tag const &tag = *stack.back();
+    size_t pos = offset_ + whitespaceSize_;
+    size_t size = 0;
+    switch (tag.type) {
+      case HTML::Tag::ELEMENT:
+      case HTML::Tag::VOID_ELEMENT:
+        size = insert(pos, {"<", tag.name, tag.attributes, ">", tag.data});
+        break;
+      case HTML::Tag::COMMENT:
+        size = insert(pos, {"<!--", tag.data, "-->"});
+        break;
+      case HTML::Tag::PROCESSING_INSTRUCTION:
+        size = insert(pos, {"<?", tag.data, "?>"});
+        break;
+      case HTML::Tag::WHITESPACE: {
+        // Try to eat two newlines (paragraph break) from our segment
+        auto nl = html_.find("\n\n", whitespaceOffset_);
+        if (nl != std::string::npos && nl < whitespaceOffset_ + whitespaceSize_) {
+          html_.erase(nl, 2);
+          whitespaceSize_ -= 2;
+        }
+      } break;
     }
 
-    for (HTML::Tag const *tag : opening) {
-      std::string openTag;
-      switch (tag->type) {
-        case HTML::Tag::ELEMENT:
-        case HTML::Tag::VOID_ELEMENT:
-          openTag = format("<{}{}>{}", tag->name, tag->attributes, tag->data);
-          break;
-        case HTML::Tag::COMMENT:
-          openTag = format("<!--{}-->", tag->data);
-          break;
-        case HTML::Tag::PROCESSING_INSTRUCTION:
-          openTag = format("<?{}?>", tag->data);
-          break;
-        case HTML::Tag::WHITESPACE: {
-          // Try to eat two newlines (paragraph break) from our segment
-          auto pos = html_.find("\n\n", whitespaceOffset_);
-          if (pos != std::string::npos && pos < whitespaceOffset_ + whitespaceSize_) {
-            html_.erase(pos, 2);
-            whitespaceSize_ -= 2;
-          }
-        } break;
-      }
+    offset_ += size;
+    closeLeft_ = closeLeft_ && size == 0;
+  }
+
+  void close(HTML::Tag const &tag) {
+    size_t size = insert(offset_ + (closeLeft_ ? 0 : whitespaceSize_), {"</", tag.name, ">"});
+    offset_ += size;
+    if (closeLeft_) whitespaceOffset_ += size;
+  }
 
-      html_.insert(offset_ + whitespaceSize_, openTag);
-      offset_ += openTag.size();
-      closeLeft_ = closeLeft_ && openTag.empty();
+  // Inserts `parts` one after the other at `pos` in html_, without building
+  // the tag in a temporary string first. Returns the number of inserted chars.
+  size_t insert(size_t pos, std::initializer_list<std::string_view> parts) {
+    size_t size = 0;
+    for (std::string_view part : parts) {
+      html_.insert(pos + size, part.data(), part.size());
+      size += part.size();
     }
+    return size;
   }
 
- private:
   std::string html_;         // Output html
   size_t offset_;            // Size added by prepending HTML
   size_t whitespaceOffset_;  // position of prefix whitespace characters
@@ -244,7 +268,10 @@ size_t debugCountTokens(AnnotatedText const &text) {
 /// it takes nesting into account. I.e. `<a><a></a></a>` will be consumed to the
 // last `</a>`. Assumes TT_TAG_START is already consumed, which was necessary
 /// to determine whether this was an element that needed to be ignored.
-void consumeIgnoredTag(markup::Scanner &scanner, HTML::Tag &tag, std::string const &name) {
+/// Attributes are passed to `appendAttribute(name, value)`.
+template <typename AppendAttribute>
+void consumeIgnoredTag(markup::Scanner &scanner, HTML::Tag &tag, std::string_view name,
+                       AppendAttribute &&appendAttribute) {
   // Only full elements can be consumed this way. With void tags we don't know
   // where to stop scanning. All other types cannot be nested anyway.
   assert(tag.type == HTML::Tag::ELEMENT);
@@ -262,7 +289,7 @@ void consumeIgnoredTag(markup::Scanner &scanner, HTML::Tag &tag, std::string con
       case markup::Scanner::TT_EOF:
         ABORT("Did not find closing tag </{}>", name);
       case markup::Scanner::TT_ATTRIBUTE:
-        tag.attributes += format(" {}=\"{}\"", scanner.attribute(), scanner.value());
+        appendAttribute(scanner.attribute(), scanner.value());
         break;
       default:
         // Not an attribute! Must be something inside the body or the closing
@@ -289,10 +316,10 @@ void consumeIgnoredTag(markup::Scanner &scanner, HTML::Tag &tag, std::string con
         // Note: Looking specifically for only our own type of tag so we don't
         // have to care about whether other tags we encounter are void tags or
         // not. Does assume the HTML is valid, as no stack is kept.
-        if (toLowerCase(scanner.tag()) == name) ++inside;
+        if (equalsCaseInsensitive(scanner.tag(), name)) ++inside;
         break;
       case markup::Scanner::TT_TAG_END:
-        if (toLowerCase(scanner.tag()) == name) --inside;
+        if (equalsCaseInsensitive(scanner.tag(), name)) --inside;
         break;
       default:
         break;
@@ -339,25 +366,40 @@ std::ostream &operator<<(std::ostream &out, HTML::Tag const *tag) {
 }
 
 std::ostream &operator<<(std::ostream &out, HTML::TagStack const &tags) {
-  for (auto it = tags.begin(); it != tags.end(); ++it) {
-    if (it != tags.begin()) out << ' ';
-    out << *it;
-  }
-  return out;
+  if (tags.empty()) return out;
+  if (tags.size() > 1) out << tags.pop() << ' ';  // outer tags first
+  return out << tags.back();
+}
+
+size_t HTML::TagStack::commonSize(TagStack a, TagStack b) {
+  while (a.size() > b.size()) a = a.pop();
+  while (b.size() > a.size()) b = b.pop();
+
+  // Walk up until both stacks share a node, after which all outer tags are
+  // shared as well. Stacks built separately can still hold the same tags, so
+  // compare them tag by tag on the way up.
+  size_t common = a.size();
+  for (; a != b; a = a.pop(), b = b.pop())
+    if (a.back() != b.back()) common = a.size() - 1;
+
+  return common;
 }
 
 HTML::HTML(std::string &&source, bool processMarkup, Options &&options) : options_(std::move(options)) {
   if (!processMarkup) return;
 
-  std::string original = std::move(source);
-  markup::instream in(original.data(), original.data() + original.size());
+  original_ = std::make_unique<std::string const>(std::move(source));
+  markup::instream in(original_->data(), original_->data() + original_->size());
   markup::Scanner scanner(in);
   source.clear();  // source is moved out of, so should be clear anyway
+  source.reserve(original_->size());
 
-  Tag *tag = nullptr;             // current tag (after opening at least)
-  TagStack stack;                 // stack of currently open tags
-  bool addSentenceBreak = false;  // whether to add a sentence break next text segment
-  bool addWordBreak = false;      // whether to add a word break next text segment
+  Tag *tag = nullptr;                      // current tag (after opening at least)
+  std::string *ownedAttributes = nullptr;  // attributes of `tag` if not in the source
+  std::string name;                        // lowercase tag name, reused for each tag
+  TagStack stack;                          // stack of currently open tags
+  bool addSentenceBreak = false;           // whether to add a sentence break next text segment
+  bool addWordBreak = false;               // whether to add a word break next text segment
 
   // Starting point: an empty span with no open tags.
   spans_.push_back(Span{0, 0, {}});
@@ -377,14 +419,12 @@ HTML::HTML(std::string &&source, bool processMarkup, Options &&options) : option
         // we treat the text after it as a new sentence.
         if (addSentenceBreak) {
           // If there isn't already a \n\n at the end of source...
-          if (source.size() >= 2 && source.substr(source.size() - 2) != "\n\n") {
-            stack.push_back(makeTag({Tag::WHITESPACE}));
+          if (source.size() >= 2 && source.compare(source.size() - 2, 2, "\n\n") != 0) {
             // Important: span->size() == 0 to make it behave as a void element.
             // Also important: position before the \n\n tokens, not after, to
             // make it easier to remove them later through apply().
-            spans_.push_back(Span{source.size(), source.size(), stack});
+            spans_.push_back(Span{source.size(), source.size(), push(stack, makeTag({Tag::WHITESPACE}))});
             source.append("\n\n");  // Should work with ssplit-mode = wrapped_text
-            stack.pop_back();
           }
           addSentenceBreak = false;
         }
@@ -407,28 +447,31 @@ HTML::HTML(std::string &&source, bool processMarkup, Options &&options) : option
       } break;
 
       case markup::Scanner::TT_TAG_START: {
-        std::string name = toLowerCase(scanner.tag());
+        toLowerCase(scanner.tag(), name);
 
         // Tag *tag is used by attribute parsing
         auto type = contains(options_.voidTags, name) ? Tag::VOID_ELEMENT : Tag::ELEMENT;
-        tag = makeTag({type, std::string(scanner.tag())});
+        tag = makeTag({type, scanner.tag()});
+        ownedAttributes = nullptr;
 
-        stack.push_back(tag);
+        stack = push(stack, tag);
 
         // Empty elements (e.g. <img>) are not applicable to a span of text
         // so instead we "apply" them to an empty span in between, and then
         // immediately remove them again from the stack.
         if (tag->type == Tag::VOID_ELEMENT) {
           spans_.push_back(Span{source.size(), source.size(), stack});
-          stack.pop_back();
+          stack = stack.pop();
         }
 
         // Ignored tags have same semantics as void tags with regards to moving
         // them around with the rest of the content.
         if (contains(options_.ignoredTags, name)) {
-          consumeIgnoredTag(scanner, *tag, name);
+          consumeIgnoredTag(scanner, *tag, name, [&](std::string_view attribute, std::string_view value) {
+            appendAttribute(*tag, attribute, value, ownedAttributes);
+          });
           spans_.push_back(Span{source.size(), source.size(), stack});
-          stack.pop_back();
+          stack = stack.pop();
         }
 
         // Treat non-inline HTML tags as spaces that break up words.
@@ -440,14 +483,14 @@ HTML::HTML(std::string &&source, bool processMarkup, Options &&options) : option
       } break;
 
       case markup::Scanner::TT_TAG_END: {
-        std::string tagName = toLowerCase(scanner.tag());
+        toLowerCase(scanner.tag(), name);
         // If this is the closing bit of a void tag, i.e. triggered by the "/>"
         // bit of "<img/>", then completely ignore it.
-        if (contains(options_.voidTags, tagName)) break;
+        if (contains(options_.voidTags, name)) break;
 
         ABORT_IF(stack.empty(), "Encountered more closing tags ({}) than opening tags", scanner.tag());
 
-        ABORT_IF(toLowerCase(stack.back()->name) != toLowerCase(scanner.tag()),
+        ABORT_IF(!equalsCaseInsensitive(stack.back()->name, scanner.tag()),
                  "Encountered unexpected closing tag </{}>, stack is {}", scanner.tag(), stack);
 
         // What to do with "<u></u>" case, where tag is immediately closed
@@ -456,35 +499,31 @@ HTML::HTML(std::string &&source, bool processMarkup, Options &&options) : option
         if (spans_.empty() || !contains(spans_.back().tags, stack.back()))
           spans_.push_back(Span{source.size(), source.size(), stack});
 
-        stack.pop_back();
+        stack = stack.pop();
 
         // Add space if necessary
-        if (!contains(options_.inlineTags, tagName)) {
+        if (!contains(options_.inlineTags, name)) {
           addSentenceBreak = true;
-        } else if (!contains(options_.inWordTags, tagName)) {
+        } else if (!contains(options_.inWordTags, name)) {
           addWordBreak = true;
         }
       } break;
 
       case markup::Scanner::TT_ATTRIBUTE:
         assert(tag != nullptr);
-        tag->attributes += format(" {}=\"{}\"", scanner.attribute(), scanner.value());
+        appendAttribute(*tag, scanner.attribute(), scanner.value(), ownedAttributes);
         break;
 
       case markup::Scanner::TT_COMMENT_START:
         // Tag *tag is used when TT_DATA is seen to add the comment's content.
         tag = makeTag({Tag::COMMENT});
-        stack.push_back(tag);
-        spans_.push_back(Span{source.size(), source.size(), stack});
-        stack.pop_back();
+        spans_.push_back(Span{source.size(), source.size(), push(stack, tag)});
         break;
 
       case markup::Scanner::TT_PROCESSING_INSTRUCTION_START:
         // Tag *tag is used when TT_DATA is seen to add the PI's content.
         tag = makeTag({Tag::PROCESSING_INSTRUCTION});
-        stack.push_back(tag);
-        spans_.push_back(Span{source.size(), source.size(), stack});
-        stack.pop_back();
+        spans_.push_back(Span{source.size(), source.size(), push(stack, tag)});
         break;
 
       case markup::Scanner::TT_COMMENT_END:
@@ -538,7 +577,8 @@ void HTML::restore(Response &response) {
   assert(sourceTokenSpans.size() == debugCountTokens(response.source));
 
   // Find for every token in target the token in source that best matches.
-  std::vector<std::vector<size_t>> alignments;
+  // These are stored one sentence after the other.
+  std::vector<size_t> alignments;
   hardAlignments(response, alignments, sourceTokenSpans);
 
   std::vector<SpanIterator> targetTokenSpans;
@@ -605,6 +645,10 @@ AnnotatedText HTML::restoreTarget(AnnotatedText const &in, std::vector<SpanItera
   auto targetSpanIt = targetTokenSpans.begin();
   auto targetTagIt = targetTokenTags.begin();
 
+  // Which spans are assigned to at least one target token.
+  std::vector<bool> aligned(spans_.size(), false);
+  for (SpanIterator span : targetTokenSpans) aligned[span - spans_.begin()] = true;
+
   AnnotatedText out = in.apply([&]([[maybe_unused]] ByteRange range, string_view token, bool last) {
     TokenFormatter formatter(token);
 
@@ -614,10 +658,7 @@ AnnotatedText HTML::restoreTarget(AnnotatedText const &in, std::vector<SpanItera
       // We're only interested in empty spans or spans that would otherwise get
       // lost because they didn't align with anything between the spans in
       // targetSpanIt
-      // TODO That std::find makes this O(N*N) NOT GOOD NOT GOOD
-      if (stragglerSpanIt->size() != 0 &&
-          std::find(targetTokenSpans.begin(), targetTokenSpans.end(), stragglerSpanIt) != targetTokenSpans.end())
-        continue;
+      if (stragglerSpanIt->size() != 0 && aligned[stragglerSpanIt - spans_.cbegin()]) continue;
 
       formatter.append(prevTags, stragglerSpanIt->tags);
       prevTags = stragglerSpanIt->tags;
@@ -654,21 +695,52 @@ AnnotatedText HTML::restoreTarget(AnnotatedText const &in, std::vector<SpanItera
 }
 
 HTML::Tag *HTML::makeTag(Tag &&tag) {
-  pool_.emplace_front(std::move(tag));
-  return &pool_.front();
+  pool_.emplace_back(std::move(tag));
+  return &pool_.back();
 }
 
-void HTML::copyTagStack(Response const &response, std::vector<std::vector<size_t>> const &alignments,
+HTML::TagStack HTML::push(TagStack stack, Tag *tag) {
+  nodes_.push_back(TagStack::Node{tag, stack.top_, stack.size() + 1});
+  return TagStack(&nodes_.back());
+}
+
+void HTML::appendAttribute(Tag &tag, std::string_view name, std::string_view value, std::string *&owned) {
+  // Is this attribute written exactly as ` name="value"` in the source, and
+  // does it directly follow the attributes we already have?
+  // A valueless attribute has a null value, so it is never verbatim.
+  const char *begin = name.data() - 1;
+  bool verbatim = value.data() != nullptr && value.data() == name.data() + name.size() + 2 && begin[0] == ' ' &&
+                  name.data()[name.size()] == '=' && name.data()[name.size() + 1] == '"' &&
+                  value.data()[value.size()] == '"';
+
+  if (!owned && verbatim && (tag.attributes.empty() || tag.attributes.data() + tag.attributes.size() == begin)) {
+    const char *end = value.data() + value.size() + 1;
+    if (!tag.attributes.empty()) begin = tag.attributes.data();
+    tag.attributes = std::string_view(begin, end - begin);
+    return;
+  }
+
+  if (!owned) owned = &strings_.emplace_front(tag.attributes);
+  owned->append(" ").append(name).append("=\"").append(value).append("\"");
+  tag.attributes = *owned;
+}
+
+std::string_view HTML::makeString(std::string &&str) { return strings_.emplace_front(std::move(str)); }
+
+void HTML::copyTagStack(Response const &response, std::vector<size_t> const &alignments,
                         std::vector<SpanIterator> const &sourceTokenSpans,
                         std::vector<SpanIterator> &targetTokenSpans) {
   size_t offset = 0;  // Sentence offset in sourceTokenSpans
+  auto alignment = alignments.begin();
+
+  targetTokenSpans.reserve(alignments.size() + response.target.numSentences() + 1);
 
   // Fill targetTokenSpans based on the alignments we just made up.
   // NOTE: this should match the exact order of Apply()
   for (size_t sentenceIdx = 0; sentenceIdx < response.target.numSentences(); ++sentenceIdx) {
     targetTokenSpans.push_back(sourceTokenSpans[offset]);  // token_tag for sentence ending gap
     for (size_t t = 0; t < response.target.numWords(sentenceIdx); ++t) {
-      size_t s = alignments[sentenceIdx][t];
+      size_t s = *alignment++;
       assert(s < response.source.numWords(sentenceIdx));
       targetTokenSpans.push_back(sourceTokenSpans[offset + 1 + s]);  // +1 for prefix gap
     }
@@ -677,11 +749,25 @@ void HTML::copyTagStack(Response const &response, std::vector<std::vector<size_t
   }
 
   assert(offset + 1 == sourceTokenSpans.size());
+  assert(alignment == alignments.end());
   targetTokenSpans.push_back(sourceTokenSpans[offset]);  // token_tag for ending whitespace
 }
 
 void HTML::annotateTagStack(Response const &response, std::vector<SpanIterator> const &targetTokenSpans,
                             std::vector<HTML::TagStack> &targetTokenTags) {
+  // Adds `tag` to the stacks in [begin, end). Consecutive tokens with the same
+  // markup share the extended stack as well.
+  auto pushTag = [&](std::vector<TagStack>::iterator begin, std::vector<TagStack>::iterator end, Tag *tag) {
+    TagStack base, extended;
+    for (auto it = begin; it != end; ++it) {
+      if (it == begin || *it != base) {
+        base = *it;
+        extended = push(base, tag);
+      }
+      *it = extended;
+    }
+  };
+
   auto spanIt = targetTokenSpans.begin();
   for (size_t sentenceIdx = 0; sentenceIdx < response.target.numSentences(); ++sentenceIdx) {
     // Sentence prefix
@@ -701,24 +787,22 @@ void HTML::annotateTagStack(Response const &response, std::vector<SpanIterator>
     if (!response.qualityScores.empty()) {
       auto const &sentenceQuality = response.qualityScores[sentenceIdx];
       // Create a single <font> tag for this sentence with sentence level info
-      Tag *sentenceTag = makeTag({Tag::ELEMENT, "font"});
-      sentenceTag->attributes += format(" x-bergamot-sentence-index=\"{}\" x-bergamot-sentence-score=\"{}\"",
-                                        sentenceIdx, sentenceQuality.sentenceScore);
+      std::string_view attributes =
+          makeString(format(" x-bergamot-sentence-index=\"{}\" x-bergamot-sentence-score=\"{}\"", sentenceIdx,
+                            sentenceQuality.sentenceScore));
+      Tag *sentenceTag = makeTag({Tag::ELEMENT, "font", attributes});
 
       // Add that tag to all tokens in this sentence.
-      for (size_t tokenIdx = 0; tokenIdx < response.target.numWords(sentenceIdx); ++tokenIdx) {
-        targetTokenTags[tagOffset + tokenIdx].push_back(sentenceTag);
-      }
+      auto sentenceBegin = targetTokenTags.begin() + tagOffset;
+      pushTag(sentenceBegin, sentenceBegin + response.target.numWords(sentenceIdx), sentenceTag);
 
       // Add word level <font> tags as well to all tokens that make up a word.
       for (size_t wordIdx = 0; wordIdx < sentenceQuality.wordRanges.size(); ++wordIdx) {
-        Tag *wordTag = makeTag({Tag::ELEMENT, "font"});
-        wordTag->attributes += format(" x-bergamot-word-index=\"{}\" x-bergamot-word-score=\"{}\"", wordIdx,
-                                      sentenceQuality.wordScores[wordIdx]);
+        std::string_view attributes = makeString(format(" x-bergamot-word-index=\"{}\" x-bergamot-word-score=\"{}\"",
+                                                        wordIdx, sentenceQuality.wordScores[wordIdx]));
+        Tag *wordTag = makeTag({Tag::ELEMENT, "font", attributes});
         auto const &range = sentenceQuality.wordRanges[wordIdx];
-        for (size_t tokenIdx = range.begin; tokenIdx < range.end; ++tokenIdx) {
-          targetTokenTags[tagOffset + tokenIdx].push_back(wordTag);
-        }
+        pushTag(sentenceBegin + range.begin, sentenceBegin + range.end, wordTag);
       }
     }
   }
@@ -749,22 +833,26 @@ bool HTML::isContinuation(marian::string_view prev, marian::string_view str) con
 /// `response.source` and writes this selection to `alignments`. The source
 /// token spans are used to also look at the markup applied to each token to
 /// figure out which source token best represents each target token.
-void HTML::hardAlignments(Response const &response, std::vector<std::vector<size_t>> &alignments,
+void HTML::hardAlignments(Response const &response, std::vector<size_t> &alignments,
                           std::vector<SpanIterator> const &sourceTokenSpans) {
   size_t offset = 0;  // sentence offset in sourceTokenSpans
 
+  size_t numTargetWords = 0;
+  for (size_t sentenceIdx = 0; sentenceIdx < response.target.numSentences(); ++sentenceIdx)
+    numTargetWords += response.target.numWords(sentenceIdx);
+  alignments.reserve(numTargetWords);
+
   // For each sentence...
   for (size_t sentenceIdx = 0; sentenceIdx < response.target.numSentences(); ++sentenceIdx) {
-    alignments.emplace_back();
+    // Alignments of this sentence start at this position
+    auto sentence = alignments.size();
 
     // Hard-align: find for each target token the most prevalent source token
     // Note: only search from 0 to N-1 because token N is end-of-sentence token
     // that can only align with the end-of-sentence token of the target
-    for (size_t t = 0; t + 1 < response.target.numWords(sentenceIdx); ++t) {
-      alignments.back().push_back(
-          std::max_element(response.alignments[sentenceIdx][t].begin(), response.alignments[sentenceIdx][t].end()) -
-          response.alignments[sentenceIdx][t].begin());
-    }
+    Alignment const &alignment = response.alignments[sentenceIdx];
+    for (size_t t = 0; t + 1 < response.target.numWords(sentenceIdx); ++t)
+      alignments.push_back(argmax(alignment.row(t), alignment.cols()));
 
     // Next, we try to smooth out these selected alignments with a few heuristics
     for (size_t t = 1; t + 1 < response.target.numWords(sentenceIdx); ++t) {
@@ -773,10 +861,10 @@ void HTML::hardAlignments(Response const &response, std::vector<std::vector<size
       if (isContinuation(response.target.word(sentenceIdx, t - 1), response.target.word(sentenceIdx, t))) {
         // Note: only looking at the previous token since that will already
         // have this treatment applied to it.
-        size_t currSentenceIdx = alignments.back()[t];
-        size_t prevSentenceIdx = alignments.back()[t - 1];
-        float currScore = response.alignments[sentenceIdx][t][currSentenceIdx];
-        float prevScore = response.alignments[sentenceIdx][t - 1][prevSentenceIdx];
+        size_t currSentenceIdx = alignments[sentence + t];
+        size_t prevSentenceIdx = alignments[sentence + t - 1];
+        float currScore = alignment(t, currSentenceIdx);
+        float prevScore = alignment(t - 1, prevSentenceIdx);
 
         TagStack const &currTagStack = sourceTokenSpans[offset + 1 + currSentenceIdx]->tags;
         TagStack const &prevTagStack = sourceTokenSpans[offset + 1 + prevSentenceIdx]->tags;
@@ -788,7 +876,7 @@ void HTML::hardAlignments(Response const &response, std::vector<std::vector<size
         if (extends(currTagStack, prevTagStack) || currScore >= prevScore) {
           // Apply this to all previous tokens in the word
           for (size_t i = t;; --i) {
-            alignments.back()[i] = currSentenceIdx;
+            alignments[sentence + i] = currSentenceIdx;
 
             // Stop if this was the first token or the beginning of the word
             if (i == 0 ||
@@ -796,13 +884,13 @@ void HTML::hardAlignments(Response const &response, std::vector<std::vector<size
               break;
           }
         } else {
-          alignments.back()[t] = prevSentenceIdx;
+          alignments[sentence + t] = prevSentenceIdx;
         }
       }
     }
 
     // Always align target end with source end
-    alignments.back().push_back(response.source.numWords(sentenceIdx) - 1);
+    alignments.push_back(response.source.numWords(sentenceIdx) - 1);
 
     offset += response.source.numWords(sentenceIdx) + 1;  // +1 for prefix gap
   }
@@ -1,7 +1,9 @@
 #ifndef SRC_BERGAMOT_HTML_H_
 #define SRC_BERGAMOT_HTML_H_
 
+#include <deque>
 #include <forward_list>
+#include <memory>
 #include <set>
 #include <stdexcept>
 #include <string>
@@ -112,6 +114,8 @@ class HTML {
 
   /// Represents a tag, or markup that is being applied to a string of text.
   /// We treat all elements except `ELEMENT` as void elements or empty elements.
+  /// The strings are views into memory owned by `HTML`: mostly directly into
+  /// the original HTML source, and otherwise into `strings_`.
   struct Tag {
     enum NodeType {
       ELEMENT,                 // <b>...</b>
@@ -121,25 +125,61 @@ class HTML {
       WHITESPACE,              // A \n\n we inserted to break a sentence.
     };
 
-    NodeType type;           // Type of the node
-    std::string name;        // Tag name (if type is ELEMENT or VOID_ELEMENT)
-    std::string attributes;  // Tag attributes (as raw HTML string, including
-                             // entities and prefix whitespace)
-    std::string data;        // Raw data of an element that just needs to be
-                             // copied as is, e.g. <script> or <style>
+    NodeType type;                // Type of the node
+    std::string_view name;        // Tag name (if type is ELEMENT or VOID_ELEMENT)
+    std::string_view attributes;  // Tag attributes (as raw HTML string, including
+                                  // entities and prefix whitespace)
+    std::string_view data;        // Raw data of an element that just needs to be
+                                  // copied as is, e.g. <script> or <style>
   };
 
   /// Representation of markup that is being applied to a string of text. Order
-  /// matters as this represents how the tags are nested. The `Tag` objects
-  /// themselves are owned by `pool_`.
-  using TagStack = std::vector<Tag *>;
+  /// matters as this represents how the tags are nested. A TagStack is a
+  /// pointer to the innermost node of a parent-pointer tree: pushing a tag
+  /// makes a new node that refers to the stack it extends, so all spans that
+  /// share outer markup share the nodes that describe it, and copying a
+  /// TagStack is free. Nodes are created by `HTML::push()`, and both the nodes
+  /// and the `Tag` objects are owned by the `HTML` instance.
+  class TagStack {
+   public:
+    struct Node {
+      Tag *tag;
+      Node const *parent;
+      size_t size;  // number of tags in the stack ending in this node
+    };
+
+    TagStack() : top_(nullptr) {}
+    explicit TagStack(Node const *top) : top_(top) {}
+
+    bool empty() const { return top_ == nullptr; }
+    size_t size() const { return top_ ? top_->size : 0; }
+
+    /// Innermost tag. Stack must not be empty.
+    Tag *back() const { return top_->tag; }
+
+    /// Stack without its innermost tag. Stack must not be empty.
+    TagStack pop() const { return TagStack(top_->parent); }
+
+    /// Identity comparison: equal stacks share the same node. Stacks built
+    /// separately with the same tags compare unequal; use `commonSize()` to
+    /// compare them tag by tag.
+    bool operator==(TagStack const &other) const { return top_ == other.top_; }
+    bool operator!=(TagStack const &other) const { return top_ != other.top_; }
+
+    /// Number of outer tags that `a` and `b` have in common.
+    static size_t commonSize(TagStack a, TagStack b);
+
+   private:
+    friend class HTML;  // for HTML::push()
+    Node const *top_;
+  };
 
   /// Span of text, with which a `TagStack` is associated. A span may be empty,
   /// for example to represent the presence of an empty or VOID element.
   struct Span {
     size_t begin;   // Start offset in (plain text) source
     size_t end;     // end offset in source
-    TagStack tags;  // Note: free pointers to memory owned by `pool_`.
+    TagStack tags;  // Note: free pointers to memory owned by `HTML`.
     inline size_t size() const { return end - begin; }
   };
 
@@ -185,9 +225,9 @@ class HTML {
   bool isContinuation(std::string_view prev, std::string_view str) const;
 
   /// Copies span pointers from the subwords/tokens from the source text to the
-  /// subwords of the target text in `targetTokenSpans` using alignment
-  /// information in `response`.
-  void copyTagStack(Response const &response, std::vector<std::vector<size_t>> const &alignments,
+  /// subwords of the target text in `targetTokenSpans` using the hard
+  /// `alignments` made by `hardAlignments()`.
+  void copyTagStack(Response const &response, std::vector<size_t> const &alignments,
                     std::vector<HTML::SpanIterator> const &sourceTokenSpans,
                     std::vector<HTML::SpanIterator> &targetTokenSpans);
 
@@ -198,25 +238,51 @@ class HTML {
   /// per target token. Has some heuristics to keep all target tokens of a
   /// single word pointing to the same span, and prefers spans with more markup
   /// over spans with less to try to retain as much of the input markup as
-  /// possible.
-  void hardAlignments(Response const &response, std::vector<std::vector<size_t>> &alignments,
+  /// possible. `alignments` holds the tokens of all sentences one after the
+  /// other, in a single vector.
+  void hardAlignments(Response const &response, std::vector<size_t> &alignments,
                       std::vector<HTML::SpanIterator> const &sourceTokenSpans);
 
   /// Allocates a tag in `pool_` (which then owns it) and gives a pointer to be
   /// used in TagStacks. Pointer is valid as long as this HTML instance lives on.
   Tag *makeTag(Tag &&tag);
 
+  /// Returns a new stack that is `stack` with `tag` nested inside it. `stack`
+  /// itself is unchanged.
+  TagStack push(TagStack stack, Tag *tag);
+
+  /// Appends attribute ` name="value"` to `tag`. If the attribute is written
+  /// like that in the source (and directly follows the previous attribute)
+  /// this just extends the view into the source. Otherwise the attributes are
+  /// copied into `*owned`, which is allocated in `strings_` when needed.
+  void appendAttribute(Tag &tag, std::string_view name, std::string_view value, std::string *&owned);
+
+  /// Copies `str` into `strings_` and returns a view of the copy.
+  std::string_view makeString(std::string &&str);
+
   /// HTML options associated with this parse.
   Options options_;
 
+  /// The original HTML source. Most `Tag` strings point into this. Kept behind
+  /// a pointer so moving `HTML` does not move (and invalidate) the characters.
+  std::unique_ptr<std::string const> original_;
+
   /// List of spans of text in plain text `source`, and which tags are applied
   /// to them.
   std::vector<Span> spans_;
 
-  /// A pool of tags. `std::forward_list` because we do not want pointers to it
-  /// to be invalidated when new tags are allocated. This way it is easy to
-  /// deallocate them all when `HTML` goes out of scope.
-  std::forward_list<Tag> pool_;
+  /// A pool of tags. `std::deque` because we do not want pointers to it to be
+  /// invalidated when new tags are allocated, while still allocating them in
+  /// chunks. This way it is easy to deallocate them all when `HTML` goes out
+  /// of scope.
+  std::deque<Tag> pool_;
+
+  /// Storage for the nodes that make up all `TagStack`s, same as `pool_`.
+  std::deque<TagStack::Node> nodes_;
+
+  /// Storage for the few tag strings that could not point into `original_`,
+  /// e.g. attributes that had to be normalised.
+  std::forward_list<std::string> strings_;
 };
 
 }  // namespace marian::bergamot
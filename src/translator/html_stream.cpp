@@ -0,0 +1,398 @@
+#include "html_stream.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <memory>
+
+#include "common/logging.h"
+#include "service.h"
+#include "xh_scanner.h"
+
+namespace {
+
+/// The unit in which `HTMLSplitter` consumes input: a run of text, a tag, or a
+/// comment or processing instruction. A `<script>`-like element, including its
+/// contents and closing tag, counts as a single open tag.
+struct Construct {
+  enum Kind { NONE, TEXT, OPEN_TAG, CLOSE_TAG, COMMENT };
+
+  Kind kind;
+  const char *begin;         // position of the first character
+  std::string name;          // lowercase tag name for OPEN_TAG and CLOSE_TAG
+  bool special{false};       // OPEN_TAG whose content is not scanned, see `markup::Scanner::isSpecial()`
+  bool selfClosing{false};   // OPEN_TAG written as `<tag/>`
+  bool closed{false};        // COMMENT or special OPEN_TAG of which the end is seen
+
+  /// Whether all tokens of this construct have been scanned, given that the
+  /// scanner's last token started at `start`.
+  bool complete(const char *start) const {
+    switch (kind) {
+      case OPEN_TAG:
+        // For normal tags, the scanner only updates start() once it moves
+        // past the '>' to the next bit of text or markup.
+        return special ? closed : selfClosing || start != begin;
+      case COMMENT:
+        return closed;
+      default:
+        return true;
+    }
+  }
+};
+
+bool isWhitespace(std::string_view text) {
+  return std::all_of(text.begin(), text.end(), [](unsigned char c) { return std::isspace(c); });
+}
+
+void toLowerCase(std::string_view input, std::string &out) {
+  out.resize(input.size());
+  std::transform(input.begin(), input.end(), out.begin(), [](unsigned char c) { return std::tolower(c); });
+}
+
+bool contains(marian::bergamot::HTML::TagNameSet const &set, std::string_view name) {
+  return set.find(name) != set.end();
+}
+
+}  // namespace
+
+namespace marian::bergamot {
+
+void HTMLSplitter::write(std::string_view input, std::vector<Segment> &segments) {
+  buffer_.append(input);
+  split(false, segments);
+}
+
+void HTMLSplitter::close(std::vector<Segment> &segments) { split(true, segments); }
+
+void HTMLSplitter::split(bool last, std::vector<Segment> &segments) {
+  std::vector<Segment> out;
+
+  // An incomplete comment or special element is only scanned again once its
+  // end has arrived, so one that spans many pieces of input is not rescanned
+  // from its start for every piece.
+  bool scan = tail_.empty() || skipToTail(last, out);
+
+  const char *data = buffer_.data();
+  markup::instream in(data + scanned_, data + buffer_.size());
+  markup::Scanner scanner(in);
+
+  Construct current{Construct::NONE, nullptr};
+
+  // Applies `current`, which ends at `end`, to the state and marks everything
+  // up to `end` as scanned.
+  auto finish = [&](const char *end) {
+    size_t begin = current.begin - data;
+    size_t size = end - current.begin;
+    switch (current.kind) {
+      case Construct::TEXT:
+        if (ignored_.empty() && !isWhitespace(std::string_view(current.begin, size))) hasText_ = true;
+        break;
+      case Construct::OPEN_TAG:
+        openTag(current.name, current.special || current.selfClosing, begin, begin + size, out);
+        break;
+      case Construct::CLOSE_TAG:
+        closeTag(current.name, begin, begin + size, out);
+        break;
+      default:
+        break;
+    }
+    scanned_ = end - data;
+
+    // Bound the size of the buffer by cutting off what is scanned so far, where
+    // that does not change how the input is translated, or otherwise between
+    // words.
+    if (scanned_ - emitted_ <= maxBuffered_) return;
+    if (!ignored_.empty()) {
+      emit(scanned_, false, out);
+    } else if (current.kind == Construct::TEXT && depth_ == 0) {
+      size_t space = std::string_view(current.begin, size).find_last_of(" \t\n\r\f");
+      if (space != std::string_view::npos) {
+        std::string_view rest(current.begin + space + 1, size - space - 1);
+        emit(begin + space + 1, hasText_, out);
+        hasText_ = !isWhitespace(rest);
+      }
+    }
+  };
+
+  bool stop = !scan;
+  while (!stop) {
+    auto token = scanner.next();
+
+    // Tokens that continue the current construct
+    switch (token) {
+      case markup::Scanner::TT_ATTRIBUTE:
+      case markup::Scanner::TT_DATA:
+        continue;
+      case markup::Scanner::TT_COMMENT_END:
+      case markup::Scanner::TT_PROCESSING_INSTRUCTION_END:
+        current.closed = true;
+        continue;
+      case markup::Scanner::TT_TAG_END:
+        if (current.kind == Construct::OPEN_TAG && current.special && !current.closed) {
+          current.closed = true;  // </script>
+          continue;
+        }
+        if (current.kind == Construct::OPEN_TAG && scanner.start() == current.begin) {
+          current.selfClosing = true;  // <tag/>
+          continue;
+        }
+        break;
+      default:
+        break;
+    }
+
+    // Any other token ends the current construct, but we only know whether it
+    // was complete if the input did not end in the middle of it.
+    if (token == markup::Scanner::TT_EOF || token == markup::Scanner::TT_ERROR) {
+      // An error can only go away with more input if the scanner ran into the end of it, e.g. inside a quoted
+      // attribute value. Anything else would be rescanned in vain on every write(), while the buffer keeps growing.
+      ABORT_IF(token == markup::Scanner::TT_ERROR && (last || in.pos() < in.end), "HTML parse error");
+      if (token == markup::Scanner::TT_EOF && current.kind != Construct::NONE && current.complete(scanner.start())) {
+        finish(scanner.start());
+      } else if (token == markup::Scanner::TT_EOF && scanner.inContent()) {
+        // Wait for the end of this comment or special element, searching from
+        // where its content starts.
+        if (current.kind == Construct::COMMENT)
+          tail_ = current.begin[1] == '?' ? "?>" : "-->";
+        else
+          tail_ = "</" + current.name + ">";
+        searched_ = scanner.start() - data;
+      }
+      // Otherwise the current construct will be scanned again from its start
+      // once more input has arrived.
+      stop = true;
+      continue;
+    }
+
+    if (current.kind != Construct::NONE) finish(scanner.start());
+
+    current = Construct{Construct::NONE, scanner.start()};
+    switch (token) {
+      case markup::Scanner::TT_TEXT:
+        current.kind = Construct::TEXT;
+        break;
+      case markup::Scanner::TT_TAG_START:
+        current.kind = Construct::OPEN_TAG;
+        current.special = markup::Scanner::isSpecial(scanner.tag());
+        toLowerCase(scanner.tag(), current.name);
+        break;
+      case markup::Scanner::TT_TAG_END:
+        current.kind = Construct::CLOSE_TAG;
+        toLowerCase(scanner.tag(), current.name);
+        break;
+      case markup::Scanner::TT_COMMENT_START:
+      case markup::Scanner::TT_PROCESSING_INSTRUCTION_START:
+        current.kind = Construct::COMMENT;
+        break;
+      default:
+        ABORT("Unsupported scanner token type");
+    }
+  }
+
+  if (last) {
+    // Whatever is left is a segment of its own. Anything that was not scanned
+    // completely is left to `HTML` to make sense of (or to complain about).
+    std::string_view rest(data + scanned_, buffer_.size() - scanned_);
+    if (ignored_.empty())
+      emit(buffer_.size(), hasText_ || !isWhitespace(rest), out);
+    else
+      emit(buffer_.size(), false, out);
+
+    depth_ = 0;
+    ignored_.clear();
+    ignoredDepth_ = 0;
+    scanned_ = buffer_.size();
+    tail_.clear();
+    copying_ = false;
+  }
+
+  buffer_.erase(0, emitted_);
+  scanned_ -= emitted_;
+  searched_ -= std::min(searched_, emitted_);
+  emitted_ = 0;
+
+  std::move(out.begin(), out.end(), std::back_inserter(segments));
+}
+
+bool HTMLSplitter::skipToTail(bool last, std::vector<Segment> &segments) {
+  // Like `markup::Scanner::scanSpecial()`, match the closing tag case-insensitively. `tail_` is lowercase.
+  auto it = std::search(buffer_.begin() + searched_, buffer_.end(), tail_.begin(), tail_.end(),
+                        [](char a, char b) { return std::tolower(static_cast<unsigned char>(a)) == b; });
+  if (it != buffer_.end()) {
+    size_t end = it - buffer_.begin() + tail_.size();
+    if (tail_[0] == '<') openTag(tail_.substr(2, tail_.size() - 3), true, scanned_, end, segments);
+    scanned_ = end;
+    tail_.clear();
+    copying_ = false;
+    return true;
+  }
+
+  // The tail may start in the last few bytes, so search those again next time.
+  searched_ = std::max(searched_, buffer_.size() - std::min(buffer_.size(), tail_.size() - 1));
+
+  bool full = buffer_.size() - emitted_ > maxBuffered_;
+  if (full && !copying_ && copiedAsIs()) {
+    emit(scanned_, hasText_, segments);
+    copying_ = true;
+  }
+  if (copying_ && (full || last)) {
+    scanned_ = last ? buffer_.size() : searched_;
+    emit(scanned_, false, segments);
+  }
+
+  // Without more input, the rest is scanned once more to make a segment of it.
+  return last && !copying_;
+}
+
+bool HTMLSplitter::copiedAsIs() const {
+  if (!ignored_.empty()) return true;
+  if (depth_ > 0) return false;
+  // Between blocks, or a block-level special element, e.g. <script>, that `openTag()` cuts around.
+  return !hasText_ || (tail_[0] == '<' && !contains(options_.inlineTags, tail_.substr(2, tail_.size() - 3)));
+}
+
+void HTMLSplitter::openTag(std::string_view name, bool balanced, size_t begin, size_t end,
+                           std::vector<Segment> &segments) {
+  bool isVoid = contains(options_.voidTags, name);
+
+  if (!ignored_.empty()) {
+    // Only count nested elements with the same name, like `consumeIgnoredTag()` in html.cpp
+    if (name == ignored_ && !balanced && !isVoid) ++ignoredDepth_;
+  } else if (depth_ > 0 || contains(options_.inlineTags, name)) {
+    // Inline elements, or anything inside them, are part of the text
+    if (!balanced && !isVoid) ++depth_;
+  } else if (contains(options_.ignoredTags, name) && !balanced && !isVoid) {
+    // Block-level element that we copy as is, including its contents
+    emit(begin, hasText_, segments);
+    ignored_ = name;
+    ignoredDepth_ = 1;
+  } else {
+    // Block-level element: cut before and after the tag
+    emit(begin, hasText_, segments);
+    emit(end, false, segments);
+  }
+}
+
+void HTMLSplitter::closeTag(std::string_view name, size_t begin, size_t end, std::vector<Segment> &segments) {
+  if (!ignored_.empty()) {
+    if (name == ignored_ && --ignoredDepth_ == 0) {
+      ignored_.clear();
+      emit(end, false, segments);
+    }
+  } else if (contains(options_.voidTags, name)) {
+    // `HTML` ignores these as well, e.g. </br>
+  } else if (depth_ > 0) {
+    --depth_;
+  } else {
+    emit(begin, hasText_, segments);
+    emit(end, false, segments);
+  }
+}
+
+void HTMLSplitter::emit(size_t end, bool translate, std::vector<Segment> &segments) {
+  if (end > emitted_) {
+    std::string_view html(buffer_.data() + emitted_, end - emitted_);
+    if (!translate && !segments.empty() && !segments.back().translate)
+      segments.back().html.append(html);
+    else
+      segments.push_back(Segment{std::string(html), translate});
+    emitted_ = end;
+  }
+  hasText_ = false;
+}
+
+StreamTranslator::StreamTranslator(AsyncService &service, Ptr<TranslationModel> translationModel,
+                                   OutputCallback output, const ResponseOptions &responseOptions, size_t maxPending)
+    : service_(service),
+      translationModel_(translationModel),
+      output_(std::move(output)),
+      responseOptions_(responseOptions),
+      maxPending_(maxPending) {
+  ABORT_IF(maxPending_ == 0, "StreamTranslator needs to be able to have at least one text pending");
+}
+
+void StreamTranslator::translate(std::string &&text) {
+  size_t index = reserve();
+
+  // Not holding the lock here: a request that is fully cached calls back before translate() returns. Whichever of the
+  // callback and the error handler below comes first completes the index.
+  auto claimed = std::make_shared<std::atomic<bool>>(false);
+  auto callback = [this, index, claimed](Response &&response) {
+    if (!claimed->exchange(true)) complete(index, std::move(response.target.text));
+  };
+
+  try {
+    service_.translate(translationModel_, std::move(text), callback, responseOptions_);
+  } catch (...) {
+    // Otherwise output would wait for this index forever, and so would the destructor.
+    if (!claimed->exchange(true)) complete(index, std::string());
+    throw;
+  }
+}
+
+void StreamTranslator::copy(std::string &&text) { complete(reserve(), std::move(text)); }
+
+void StreamTranslator::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  progress_.wait(lock, [&] { return written_ == enqueued_; });
+}
+
+size_t StreamTranslator::reserve() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  progress_.wait(lock, [&] { return enqueued_ - written_ < maxPending_; });
+  return enqueued_++;
+}
+
+void StreamTranslator::complete(size_t index, std::string &&text) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  done_.emplace(index, std::move(text));
+
+  // Output is called with the lock held to keep the calls in order.
+  bool progress = false;
+  for (auto it = done_.begin(); it != done_.end() && it->first == written_; it = done_.erase(it)) {
+    output_(std::move(it->second));
+    ++written_;
+    progress = true;
+  }
+
+  if (progress) progress_.notify_all();
+}
+
+namespace {
+
+ResponseOptions withHTML(ResponseOptions responseOptions) {
+  responseOptions.HTML = true;
+  return responseOptions;
+}
+
+}  // namespace
+
+HTMLStreamTranslator::HTMLStreamTranslator(AsyncService &service, Ptr<TranslationModel> translationModel,
+                                           OutputCallback output, const ResponseOptions &responseOptions,
+                                           size_t maxPending)
+    : stream_(service, translationModel, std::move(output), withHTML(responseOptions), maxPending) {}
+
+void HTMLStreamTranslator::write(std::string_view input) {
+  std::vector<HTMLSplitter::Segment> segments;
+  splitter_.write(input, segments);
+  enqueue(std::move(segments));
+}
+
+void HTMLStreamTranslator::close() {
+  std::vector<HTMLSplitter::Segment> segments;
+  splitter_.close(segments);
+  enqueue(std::move(segments));
+  stream_.flush();
+}
+
+void HTMLStreamTranslator::enqueue(std::vector<HTMLSplitter::Segment> &&segments) {
+  for (auto &segment : segments) {
+    if (segment.translate) {
+      stream_.translate(std::move(segment.html));
+    } else {
+      stream_.copy(std::move(segment.html));
+    }
+  }
+}
+
+}  // namespace marian::bergamot
@@ -0,0 +1,184 @@
+#ifndef SRC_BERGAMOT_HTML_STREAM_H_
+#define SRC_BERGAMOT_HTML_STREAM_H_
+
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "html.h"
+#include "response_options.h"
+
+namespace marian::bergamot {
+
+class AsyncService;
+class TranslationModel;
+
+/// Cuts HTML that arrives in pieces into segments that can be translated
+/// independently. This way a large document does not need to be in memory as
+/// a whole, and does not have to be translated as a single request.
+///
+/// Cuts are made around block-level elements (i.e. elements that are not in
+/// `HTML::Options::inlineTags`) that are not nested inside an inline element.
+/// `HTML` treats those as sentence breaks already, so text on either side of
+/// them would never be translated as part of the same sentence. The block-level
+/// tags themselves, whitespace and comments in between them, and block-level
+/// ignored elements such as `<code>` and `<script>` are copied as is. What
+/// remains are runs of text and inline markup with balanced tags that can be
+/// parsed by `HTML` on their own.
+///
+/// Memory use is bounded by `maxBuffered` bytes of input that is not emitted
+/// yet. Past that, comments and the contents of elements that are copied as is
+/// are emitted in parts, and text outside of inline elements is cut after the
+/// last word that arrived, which at worst splits a sentence. A single tag, or
+/// an inline element with all its contents, is always kept whole.
+///
+/// Concatenating all segments, in order, yields the input again.
+class HTMLSplitter {
+ public:
+  struct Segment {
+    std::string html;  ///< Raw HTML of this part of the input.
+    bool translate;    ///< Whether this segment has text to translate, or can be copied as is.
+  };
+
+  explicit HTMLSplitter(HTML::Options const &options = HTML::Options(), size_t maxBuffered = 1 << 20)
+      : options_(options), maxBuffered_(maxBuffered) {}
+
+  /// Adds the next piece of the input and appends the segments that are now
+  /// complete to `segments`. Consecutive segments that do not need translating
+  /// are merged into one.
+  void write(std::string_view input, std::vector<Segment> &segments);
+
+  /// Marks the end of the input and appends any remaining segments.
+  void close(std::vector<Segment> &segments);
+
+ private:
+  /// Scans `buffer_` from `scanned_` and cuts off the complete segments. If
+  /// `last` is false, anything that might continue in the next piece of input
+  /// is kept for the next call.
+  void split(bool last, std::vector<Segment> &segments);
+
+  /// Looks for `tail_` in the input that arrived since the last call, and
+  /// completes the construct at `scanned_` if it is found. Otherwise, emits the
+  /// part of it that is copied as is if `buffer_` is full. Returns whether
+  /// `split()` should scan on from `scanned_`.
+  bool skipToTail(bool last, std::vector<Segment> &segments);
+
+  /// Whether the pending comment or special element at `scanned_` would be
+  /// copied as is, so it can be emitted before it is complete.
+  bool copiedAsIs() const;
+
+  /// Updates the state for an open tag `name` at `buffer_[begin, end)`, and
+  /// cuts around it if it is a block-level element. `balanced` if the element
+  /// is closed as well, i.e. `<tag/>` or `<script>...</script>`.
+  void openTag(std::string_view name, bool balanced, size_t begin, size_t end, std::vector<Segment> &segments);
+
+  /// Same as `openTag()`, but for closing tags.
+  void closeTag(std::string_view name, size_t begin, size_t end, std::vector<Segment> &segments);
+
+  /// Moves `buffer_[emitted_, end)` into `segments`.
+  void emit(size_t end, bool translate, std::vector<Segment> &segments);
+
+  HTML::Options options_;
+  size_t maxBuffered_;
+
+  std::string buffer_;      // Input that is not part of an emitted segment yet.
+  size_t emitted_{0};       // Offset in buffer_ up to which segments are emitted (only non-zero during split()).
+  size_t scanned_{0};       // Offset in buffer_ up to which input is scanned. At a token boundary unless copying_.
+  std::string tail_;        // End of the comment or special element at scanned_ that is incomplete, e.g. "</script>".
+  size_t searched_{0};      // Offset in buffer_ from which to look for tail_.
+  bool copying_{false};     // Whether the start of that comment or element is emitted already.
+  size_t depth_{0};         // Number of open elements in the current segment.
+  bool hasText_{false};     // Whether the current segment contains text other than whitespace.
+  std::string ignored_;     // Name of the block-level ignored element being copied, if any.
+  size_t ignoredDepth_{0};  // Nesting of `ignored_` elements.
+};
+
+/// Translates a stream of texts, e.g. the lines of a file too large to hold in memory, as separate requests on an
+/// AsyncService. Translations are passed to `output` in input order, each as soon as it and everything before it is
+/// done. Adding texts blocks while `maxPending` of them are waiting to be translated or written out, which bounds
+/// memory use independent of the length of the stream.
+class StreamTranslator {
+ public:
+  using OutputCallback = std::function<void(std::string &&)>;
+
+  /// @param [in] service: AsyncService to translate with. Must outlive this instance.
+  /// @param [in] translationModel: TranslationModel to use for each text.
+  /// @param [in] output: Called with the translation of each text, in order. Calls do not overlap, but can come from
+  /// any thread, including worker threads of `service`.
+  /// @param [in] responseOptions: Options for each request.
+  /// @param [in] maxPending: Number of texts that may be in flight before `translate()` blocks.
+  StreamTranslator(AsyncService &service, Ptr<TranslationModel> translationModel, OutputCallback output,
+                   const ResponseOptions &responseOptions = ResponseOptions(), size_t maxPending = 64);
+
+  /// Queues the next text for translation. If the service throws, e.g. on malformed HTML, the exception is passed on
+  /// and the text is left out of the output, so that the texts after it still come through.
+  void translate(std::string &&text);
+
+  /// Passes the next text to `output` as is, in turn with the translations around it.
+  void copy(std::string &&text);
+
+  /// Waits until everything queued so far has been passed to `output`.
+  void flush();
+
+  /// Waits for pending translations, as their callbacks refer to this instance.
+  ~StreamTranslator() { flush(); }
+
+ private:
+  /// Waits for room for one more text and returns its index.
+  size_t reserve();
+
+  /// Stores the result for text `index` and outputs everything that is now complete in order.
+  void complete(size_t index, std::string &&text);
+
+  AsyncService &service_;
+  Ptr<TranslationModel> translationModel_;
+  OutputCallback output_;
+  ResponseOptions responseOptions_;
+  size_t maxPending_;
+
+  std::mutex mutex_;
+  std::condition_variable progress_;    ///< Notified whenever texts have been output.
+  size_t enqueued_{0};                  ///< Number of texts enqueued so far. Also the index of the next one.
+  size_t written_{0};                   ///< Number of texts passed to output so far.
+  std::map<size_t, std::string> done_;  ///< Texts that are done but wait for an earlier one to finish.
+};
+
+/// Translates an HTML document that is written to it piece by piece, e.g. while it is being read from disk or network.
+/// The input is cut by HTMLSplitter into segments (roughly paragraphs) which are translated as separate requests on an
+/// AsyncService through a StreamTranslator. Translated HTML is passed to `output` in document order as soon as
+/// everything before it is translated. Writing blocks while `maxPending` segments are waiting to be translated or
+/// written out, which bounds memory use independent of the size of the document.
+class HTMLStreamTranslator {
+ public:
+  using OutputCallback = StreamTranslator::OutputCallback;
+
+  /// @param [in] service: AsyncService to translate segments with. Must outlive this instance.
+  /// @param [in] translationModel: TranslationModel to use for each segment.
+  /// @param [in] output: Called with consecutive parts of the translated document, in order. Calls do not overlap,
+  /// but can come from any thread, including worker threads of `service`.
+  /// @param [in] responseOptions: Options for each segment's request. HTML processing is always enabled.
+  /// @param [in] maxPending: Number of segments that may be in flight before `write()` blocks.
+  HTMLStreamTranslator(AsyncService &service, Ptr<TranslationModel> translationModel, OutputCallback output,
+                       const ResponseOptions &responseOptions = ResponseOptions(), size_t maxPending = 64);
+
+  /// Adds the next piece of the document. Segments that are complete are queued for translation.
+  void write(std::string_view input);
+
+  /// Marks the end of the document, and waits until all of it has been passed to `output`.
+  void close();
+
+ private:
+  /// Queues segments for translation, or directly for output if there is nothing to translate.
+  void enqueue(std::vector<HTMLSplitter::Segment> &&segments);
+
+  HTMLSplitter splitter_;
+  StreamTranslator stream_;
+};
+
+}  // namespace marian::bergamot
+
+#endif  // SRC_BERGAMOT_HTML_STREAM_H_
@@ -0,0 +1,69 @@
+#include "metrics.h"
+
+#include <algorithm>
+
+#include "batch.h"
+
+namespace marian {
+namespace bergamot {
+
+void BatchingCounters::enqueued(size_t sentences) {
+  enqueuedSentences_.fetch_add(sentences, std::memory_order_relaxed);
+  pendingSentences_.fetch_add(sentences, std::memory_order_relaxed);
+}
+
+void BatchingCounters::batched(const Batch &batch, size_t miniBatchWords) {
+  size_t numTokens = 0, maxLength = 0;
+  for (auto &sentence : batch.sentences()) {
+    numTokens += sentence.numTokens();
+    maxLength = std::max(maxLength, sentence.numTokens());
+  }
+
+  batched(batch.size(), numTokens, batch.size() * maxLength, miniBatchWords);
+}
+
+void BatchingCounters::batched(size_t sentences, size_t tokens, size_t paddedTokens, size_t miniBatchWords) {
+  pendingSentences_.fetch_sub(sentences, std::memory_order_relaxed);
+  batches_.fetch_add(1, std::memory_order_relaxed);
+  batchedSentences_.fetch_add(sentences, std::memory_order_relaxed);
+  batchedTokens_.fetch_add(tokens, std::memory_order_relaxed);
+  paddedTokens_.fetch_add(paddedTokens, std::memory_order_relaxed);
+  capacity_.fetch_add(miniBatchWords, std::memory_order_relaxed);
+}
+
+void BatchingCounters::cleared() { pendingSentences_.store(0, std::memory_order_relaxed); }
+
+BatchingMetrics BatchingCounters::snapshot() const {
+  BatchingMetrics metrics;
+  metrics.enqueuedSentences = enqueuedSentences_.load(std::memory_order_relaxed);
+  metrics.pendingSentences = pendingSentences_.load(std::memory_order_relaxed);
+  metrics.batches = batches_.load(std::memory_order_relaxed);
+  metrics.batchedSentences = batchedSentences_.load(std::memory_order_relaxed);
+  metrics.batchedTokens = batchedTokens_.load(std::memory_order_relaxed);
+  metrics.paddedTokens = paddedTokens_.load(std::memory_order_relaxed);
+  metrics.capacity = capacity_.load(std::memory_order_relaxed);
+  return metrics;
+}
+
+void WorkerCounters::startBatch(Clock::duration idle) {
+  idleNanoseconds_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(idle).count(),
+                             std::memory_order_relaxed);
+  busy_.store(true, std::memory_order_relaxed);
+}
+
+void WorkerCounters::finishBatch(Clock::duration busy) {
+  busyNanoseconds_.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(busy).count(),
+                             std::memory_order_relaxed);
+  busy_.store(false, std::memory_order_relaxed);
+}
+
+WorkerMetrics WorkerCounters::snapshot() const {
+  WorkerMetrics metrics;
+  metrics.busySeconds = busyNanoseconds_.load(std::memory_order_relaxed) * 1e-9;
+  metrics.idleSeconds = idleNanoseconds_.load(std::memory_order_relaxed) * 1e-9;
+  metrics.busy = busy_.load(std::memory_order_relaxed);
+  return metrics;
+}
+
+}  // namespace bergamot
+}  // namespace marian
@@ -0,0 +1,108 @@
+#ifndef SRC_BERGAMOT_METRICS_H_
+#define SRC_BERGAMOT_METRICS_H_
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "timing.h"
+
+namespace marian {
+namespace bergamot {
+
+class Batch;
+
+/// Snapshot of the sentences queued and the batches made from them, either by the BatchingPool of a single
+/// TranslationModel or by all of them together. All counts are since construction, except pendingSentences.
+struct BatchingMetrics {
+  uint64_t enqueuedSentences{0};  ///< Sentences queued for translation. Cache hits are not queued.
+  uint64_t pendingSentences{0};   ///< Sentences queued but not yet in a batch, i.e. the queue depth right now.
+  uint64_t batches{0};            ///< Batches made.
+  uint64_t batchedSentences{0};   ///< Sentences in those batches.
+  uint64_t batchedTokens{0};      ///< Tokens in those batches.
+  uint64_t paddedTokens{0};       ///< Tokens in those batches including padding up to the longest sentence of each.
+  uint64_t capacity{0};           ///< Sum of `mini-batch-words` over the batches, i.e. what would fit in them.
+
+  /// How full batches are on average, as the fraction of `mini-batch-words` taken up by tokens including padding.
+  double fill() const { return capacity > 0 ? static_cast<double>(paddedTokens) / capacity : 0.0; }
+
+  /// Fraction of the tokens in batches that are padding.
+  double paddingWaste() const {
+    return paddedTokens > 0 ? 1.0 - static_cast<double>(batchedTokens) / paddedTokens : 0.0;
+  }
+};
+
+/// Counters behind BatchingMetrics. Updated by the batching pools under their lock, but can be read without it.
+class BatchingCounters {
+ public:
+  /// Records that `sentences` sentences were queued.
+  void enqueued(size_t sentences);
+
+  /// Records a batch that was made, for a model with the given `mini-batch-words`.
+  void batched(const Batch &batch, size_t miniBatchWords);
+
+  /// Same, for a batch of `sentences` sentences with `tokens` tokens, which take up `paddedTokens` when padded up to
+  /// the longest sentence.
+  void batched(size_t sentences, size_t tokens, size_t paddedTokens, size_t miniBatchWords);
+
+  /// Records that all pending sentences were dropped.
+  void cleared();
+
+  BatchingMetrics snapshot() const;
+
+ private:
+  std::atomic<uint64_t> enqueuedSentences_{0};
+  std::atomic<uint64_t> pendingSentences_{0};
+  std::atomic<uint64_t> batches_{0};
+  std::atomic<uint64_t> batchedSentences_{0};
+  std::atomic<uint64_t> batchedTokens_{0};
+  std::atomic<uint64_t> paddedTokens_{0};
+  std::atomic<uint64_t> capacity_{0};
+};
+
+/// Snapshot of how a worker spent its time since the service started.
+struct WorkerMetrics {
+  double busySeconds{0.0};  ///< Time spent translating, up to the last completed batch.
+  double idleSeconds{0.0};  ///< Time spent waiting for a batch, up to the last batch it got.
+  bool busy{false};         ///< Whether the worker is translating a batch right now.
+
+  /// Fraction of the time accounted for that the worker was translating.
+  double utilization() const {
+    double total = busySeconds + idleSeconds;
+    return total > 0.0 ? busySeconds / total : 0.0;
+  }
+};
+
+/// Counters behind WorkerMetrics, written by the worker only.
+class WorkerCounters {
+ public:
+  /// Called by the worker when it got a batch after waiting for `idle`.
+  void startBatch(Clock::duration idle);
+
+  /// Called by the worker when it finished a batch that took `busy`.
+  void finishBatch(Clock::duration busy);
+
+  WorkerMetrics snapshot() const;
+
+ private:
+  std::atomic<int64_t> busyNanoseconds_{0};
+  std::atomic<int64_t> idleNanoseconds_{0};
+  std::atomic<bool> busy_{false};
+};
+
+/// Snapshot of the state of an AsyncService, see AsyncService::metrics(). Meant for scaling on how saturated the
+/// service actually is: a long queue, full batches and busy workers, rather than on CPU usage.
+struct ServiceMetrics {
+  double uptimeSeconds{0.0};    ///< Time since the service was constructed.
+  uint64_t translateCalls{0};   ///< Calls to translate(), pivot() and translateChain().
+  BatchingMetrics batching;     ///< Over all models.
+  std::vector<WorkerMetrics> workers;
+
+  /// Average number of calls per second since the service was constructed.
+  double translateCallRate() const { return uptimeSeconds > 0.0 ? translateCalls / uptimeSeconds : 0.0; }
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_METRICS_H_
@@ -0,0 +1,63 @@
+#include "parallel_split.h"
+
+#include <algorithm>
+
+#ifndef WASM_COMPATIBLE_SOURCE
+#include <thread>
+#endif
+
+namespace marian {
+namespace bergamot {
+
+std::vector<std::string_view> cutAtParagraphs(std::string_view text, size_t maxParts) {
+  size_t partBytes = text.size() / std::max<size_t>(maxParts, 1);
+
+  std::vector<std::string_view> parts;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t cut = text.npos;
+    if (parts.size() + 1 < maxParts && begin + partBytes < text.size()) {
+      cut = text.find("\n\n", begin + partBytes);
+    }
+    cut = (cut == text.npos) ? text.size() : cut + 2;
+    parts.push_back(text.substr(begin, cut - begin));
+    begin = cut;
+  }
+  if (parts.empty()) parts.push_back(text);
+  return parts;
+}
+
+HelperThreads::Slots &HelperThreads::Slots::operator=(Slots &&other) {
+  if (this != &other) {
+    if (owner_) owner_->release(count_);
+    owner_ = other.owner_;
+    count_ = other.count_;
+    other.count_ = 0;
+  }
+  return *this;
+}
+
+HelperThreads::Slots::~Slots() {
+  if (owner_) owner_->release(count_);
+}
+
+HelperThreads::Slots HelperThreads::acquire(size_t wanted) {
+  size_t used = used_.load(std::memory_order_relaxed);
+  size_t count;
+  do {
+    count = std::min(wanted, limit_ > used ? limit_ - used : 0);
+  } while (count > 0 && !used_.compare_exchange_weak(used, used + count, std::memory_order_relaxed));
+  return Slots(*this, count);
+}
+
+HelperThreads &HelperThreads::global() {
+#ifndef WASM_COMPATIBLE_SOURCE
+  static HelperThreads helpers(std::thread::hardware_concurrency());
+#else
+  static HelperThreads helpers(0);  // No threads to spare.
+#endif
+  return helpers;
+}
+
+}  // namespace bergamot
+}  // namespace marian
@@ -0,0 +1,59 @@
+#ifndef SRC_BERGAMOT_PARALLEL_SPLIT_H_
+#define SRC_BERGAMOT_PARALLEL_SPLIT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+namespace marian {
+namespace bergamot {
+
+/// Cuts text at blank lines into at most maxParts parts of about equal size. Every part but the last ends with the
+/// blank line it was cut at, so the parts put back together are text again. Sentences never span a blank line in any
+/// ssplit mode, so the parts split into the same sentences as the whole.
+std::vector<std::string_view> cutAtParagraphs(std::string_view text, size_t maxParts);
+
+/// Threads that split and tokenize parts of large inputs next to the thread that asked for it, counted over all
+/// TextProcessors and concurrent requests. Without a shared limit, every large request would start a thread per core
+/// on top of the service's workers.
+class HelperThreads {
+ public:
+  /// Slots taken by acquire(), which are free again once this goes out of scope.
+  class Slots {
+   public:
+    Slots() = default;
+    Slots(HelperThreads &owner, size_t count) : owner_(&owner), count_(count) {}
+    Slots(Slots &&other) : owner_(other.owner_), count_(other.count_) { other.count_ = 0; }
+    Slots &operator=(Slots &&other);
+    ~Slots();
+
+    size_t size() const { return count_; }
+
+   private:
+    HelperThreads *owner_{nullptr};
+    size_t count_{0};
+  };
+
+  explicit HelperThreads(size_t limit) : limit_(limit) {}
+
+  /// Takes as many as `wanted` of the free slots.
+  Slots acquire(size_t wanted);
+
+  /// Number of slots taken.
+  size_t used() const { return used_.load(std::memory_order_relaxed); }
+
+  /// Shared by all TextProcessors in the process, with a slot for every core.
+  static HelperThreads &global();
+
+ private:
+  void release(size_t count) { used_.fetch_sub(count, std::memory_order_relaxed); }
+
+  size_t limit_;
+  std::atomic<size_t> used_{0};
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_PARALLEL_SPLIT_H_
@@ -39,8 +39,20 @@ std::shared_ptr<marian::Options> parseOptionsFromString(const std::string &confi
   configParser.addOption<std::string>("--ssplit-mode", "Bergamot Options", "[paragraph, sentence, wrapped_text]",
                                       "paragraph");
 
+  configParser.addOption<std::string>("--wrap-mode", "Bergamot Options",
+                                      "How sentences longer than max-length-break are cut: [fixed, balanced]", "fixed");
+
+  configParser.addOption<size_t>("--tokenization-cache-size", "Bergamot Options",
+                                 "Tokenized sentences to keep, so repeated ones skip tokenization. 0 disables.", 0);
+
   configParser.addOption<std::string>("--quality", "Bergamot Options", "File considering Quality Estimation model");
 
+  configParser.addOption<size_t>("--ssplit-parallel-bytes", "Bergamot Options",
+                                 "Inputs of at least this many bytes are cut at blank lines and the parts are split "
+                                 "into sentences and tokenized in parallel, on at most one extra thread per core over "
+                                 "all requests. 0, the default, disables this. Ignored in WASM builds.",
+                                 0);
+
   // Parse configs onto defaultConfig. The preliminary merge sets the YAML internal representation with legal values.
   const YAML::Node &defaultConfig = configParser.getConfig();
   options.merge(defaultConfig);
@@ -29,6 +29,41 @@ struct CLIConfig {
 
   ServiceConfig serviceConfig;
 
+  /// How applications that translate a text stream read their input: all of it as a single request ("all"), or a line
+  /// or paragraph (lines up to an empty one) at a time ("line", "paragraph") with up to maxPending requests in flight.
+  struct StreamConfig {
+    std::string unit{"all"};
+    size_t maxPending{256};
+
+    template <class App>
+    static void addOptions(App &app, StreamConfig &config) {
+      app.add_option("--stream", config.unit,
+                     "Translate the input all at once (all), or stream it by line or paragraph (line, paragraph)");
+      app.add_option("--max-pending", config.maxPending,
+                     "Lines or paragraphs in flight while streaming, including those waiting to be written in order");
+    }
+  };
+
+  StreamConfig stream;
+
+  /// Files or directory trees to translate instead of the standard input. Each file is cut into shards of about
+  /// shardSize bytes at line boundaries, which are translated concurrently. Translations are written to a file at the
+  /// same relative path under outputDir. Shards and files that are already there from an earlier run are skipped.
+  struct FilesConfig {
+    std::vector<std::string> inputs;
+    std::string outputDir;
+    size_t shardSize{1 << 20};
+
+    template <class App>
+    static void addOptions(App &app, FilesConfig &config) {
+      app.add_option("--input-files", config.inputs, "Files or directories to translate instead of stdin");
+      app.add_option("--output-dir", config.outputDir, "Directory to write translations of --input-files to");
+      app.add_option("--shard-size", config.shardSize, "Approximate size in bytes of the parts files are cut into");
+    }
+  };
+
+  FilesConfig files;
+
   /// All config in bergamot has the following templated addOptions(...) method hierarchically placing parse actions on
   /// "option-groups" in nested structs. This allows to keep additional documentation and information on defaults
   /// alongside. Since this is templated with App, we don't add a CLI11 dependency in any configs, thus CLI11 not coming
@@ -42,6 +77,8 @@ struct CLIConfig {
                    "Configuration files list, can be used for pivoting multiple models or multiple model workflows");
 
     ServiceConfig::addOptions(app, config.serviceConfig);
+    StreamConfig::addOptions(app, config.stream);
+    FilesConfig::addOptions(app, config.files);
   };
 };
 
@@ -1,21 +1,26 @@
 #include "quality_estimator.h"
 
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
 namespace marian::bergamot {
 
-void UnsupervisedQualityEstimator::computeQualityScores(const Histories& histories, Response& response) const {
+void UnsupervisedQualityEstimator::computeQualityScores(
+    const Histories& histories, const std::vector<std::vector<SubwordRange>>& words,
+    std::vector<Response::SentenceQualityScore>& qualityScores) const {
   for (size_t i = 0; i < histories.size(); ++i) {
     const Result result = histories[i]->top();
     const Hypothesis::PtrType& hypothesis = std::get<1>(result);
     const std::vector<float> logProbs = hypothesis->tracebackWordScores();
-    response.qualityScores.push_back(std::move(computeSentenceScores(logProbs, response.target, i)));
+    qualityScores.push_back(std::move(computeSentenceScores(logProbs, words[i])));
   }
 }
 
-Response::SentenceQualityScore UnsupervisedQualityEstimator::computeSentenceScores(const std::vector<float>& logProbs,
-                                                                                   const AnnotatedText& target,
-                                                                                   const size_t sentenceIdx) const {
-  const std::vector<SubwordRange> wordIndices = mapWords(logProbs, target, sentenceIdx);
-
+Response::SentenceQualityScore UnsupervisedQualityEstimator::computeSentenceScores(
+    const std::vector<float>& logProbs, const std::vector<SubwordRange>& wordIndices) const {
   std::vector<float> wordScores;
 
   for (const SubwordRange& wordIndice : wordIndices) {
@@ -37,11 +42,15 @@ LogisticRegressorQualityEstimator::Matrix::Matrix(Matrix&& other)
     : rows(other.rows), cols(other.cols), data_(std::move(other.data_)) {}
 
 const float& LogisticRegressorQualityEstimator::Matrix::at(const size_t row, const size_t col) const {
-  return data_[row * cols + col];
+  return data_[col * rows + row];
 }
 
 float& LogisticRegressorQualityEstimator::Matrix::at(const size_t row, const size_t col) {
-  return data_[row * cols + col];
+  return data_[col * rows + row];
+}
+
+const float* LogisticRegressorQualityEstimator::Matrix::column(const size_t col) const {
+  return data_.data() + col * rows;
 }
 
 LogisticRegressorQualityEstimator::LogisticRegressorQualityEstimator(Scale&& scale, Array&& coefficients,
@@ -139,43 +148,59 @@ AlignedMemory LogisticRegressorQualityEstimator::toAlignedMemory() const {
   return memory;
 }
 
-void LogisticRegressorQualityEstimator::computeQualityScores(const Histories& histories, Response& response) const {
+void LogisticRegressorQualityEstimator::computeQualityScores(
+    const Histories& histories, const std::vector<std::vector<SubwordRange>>& words,
+    std::vector<Response::SentenceQualityScore>& qualityScores) const {
+  // Collect the log probabilities of all sentences first, so the features of all words in the batch end up in a single
+  // matrix and the model only needs to be applied once.
+  std::vector<std::vector<float>> logProbs;
+  logProbs.reserve(histories.size());
+
+  size_t numWords = 0;
   for (size_t i = 0; i < histories.size(); ++i) {
     const Result result = histories[i]->top();
     const Hypothesis::PtrType& hypothesis = std::get<1>(result);
-    const std::vector<float> logProbs = hypothesis->tracebackWordScores();
-
-    response.qualityScores.push_back(std::move(computeSentenceScores(logProbs, response.target, i)));
+    logProbs.push_back(hypothesis->tracebackWordScores());
+    numWords += words[i].size();
   }
-}
 
-Response::SentenceQualityScore LogisticRegressorQualityEstimator::computeSentenceScores(
-    const std::vector<float>& logProbs, const AnnotatedText& target, const size_t sentenceIdx) const
+  // The number of features (numFeatures), which is currently must be 4
+  Matrix features(numWords, /*numFeatures =*/4);
+  for (size_t i = 0, row = 0; i < histories.size(); row += words[i].size(), ++i) {
+    extractFeatures(words[i], logProbs[i], features, row);
+  }
 
-{
-  const std::vector<SubwordRange> wordIndices = mapWords(logProbs, target, sentenceIdx);
+  const std::vector<float> scores = predict(features);
 
-  const std::vector<float> wordScores = predict(extractFeatures(wordIndices, logProbs));
+  qualityScores.reserve(qualityScores.size() + histories.size());
+  for (size_t i = 0, row = 0; i < histories.size(); row += words[i].size(), ++i) {
+    std::vector<float> wordScores(scores.begin() + row, scores.begin() + row + words[i].size());
 
-  const float sentenceScore =
-      std::accumulate(std::begin(wordScores), std::end(wordScores), float(0.0)) / wordScores.size();
+    const float sentenceScore =
+        std::accumulate(std::begin(wordScores), std::end(wordScores), float(0.0)) / wordScores.size();
 
-  return {wordScores, wordIndices, sentenceScore};
+    qualityScores.push_back({std::move(wordScores), words[i], sentenceScore});
+  }
 }
 
 std::vector<float> LogisticRegressorQualityEstimator::predict(const Matrix& features) const {
-  std::vector<float> scores(features.rows);
-
-  for (int i = 0; i < features.rows; ++i) {
-    for (int j = 0; j < features.cols; ++j) {
-      scores[i] += features.at(i, j) * coefficientsByStds_[j];
+  // Start off with the part of the linear model that does not depend on the features
+  std::vector<float> scores(features.rows, intercept_ - constantFactor_);
+  float* out = scores.data();
+
+  // Scaling and dot product, one feature at a time. Both the feature column and the scores are contiguous, so this
+  // vectorizes.
+  for (size_t j = 0; j < features.cols; ++j) {
+    const float* column = features.column(j);
+    const float coefficient = coefficientsByStds_[j];
+    for (size_t i = 0; i < features.rows; ++i) {
+      out[i] += column[i] * coefficient;
     }
   }
 
-  /// Applies the linear model followed by a sigmoid function to each element
-
-  for (int i = 0; i < features.rows; ++i) {
-    scores[i] = std::log(1 - (1 / (1 + std::exp(-(scores[i] - constantFactor_ + intercept_)))));
+  /// Applies the sigmoid function to each element. log(1 - sigmoid(x)) is the same as -log(1 + exp(x)).
+  for (size_t i = 0; i < features.rows; ++i) {
+    out[i] = -std::log1p(std::exp(out[i]));
   }
 
   return scores;
@@ -184,14 +209,13 @@ std::vector<float> LogisticRegressorQualityEstimator::predict(const Matrix& feat
 // four features: mean of the log probability for a given word (remember that a word is made of a few subword tokens);
 // the minimum log probability of the subword level tokens that a given word is made of; the number of subword level
 // tokens that a word is made of and the overall log probability mean of the entire sequence
-LogisticRegressorQualityEstimator::Matrix LogisticRegressorQualityEstimator::extractFeatures(
-    const std::vector<SubwordRange>& wordIndices, const std::vector<float>& logProbs) const {
+void LogisticRegressorQualityEstimator::extractFeatures(const std::vector<SubwordRange>& wordIndices,
+                                                        const std::vector<float>& logProbs, Matrix& features,
+                                                        const size_t firstRow) const {
   if (wordIndices.empty()) {
-    return std::move(Matrix(0, 0));
+    return;
   }
-  // The number of features (numFeatures), which is currently must be 4
-  Matrix features(wordIndices.size(), /*numFeatures =*/4);
-  size_t featureRow = 0;
+  size_t featureRow = firstRow;
   // I_MEAN = index position in the feature vector hat represents the mean of log probability of a given word
   // I_MIN = index position  in the feature vector that represents the minimum of log probability of a given word
   // I_NUM_SUBWORDS = index position in the feature vector that represents the number of subwords that compose a given
@@ -200,7 +224,6 @@ LogisticRegressorQualityEstimator::Matrix LogisticRegressorQualityEstimator::ext
   const size_t I_MEAN{0}, I_MIN{1}, I_NUM_SUBWORDS{2}, I_OVERALL_MEAN{3};
 
   float overallMean = 0.0;
-  size_t numlogProbs = 0;
 
   for (const SubwordRange& wordIndice : wordIndices) {
     if (wordIndice.begin == wordIndice.end) {
@@ -208,40 +231,339 @@ LogisticRegressorQualityEstimator::Matrix LogisticRegressorQualityEstimator::ext
       continue;
     }
 
+    float sum = 0.0;
     float minScore = std::numeric_limits<float>::max();
 
     for (size_t i = wordIndice.begin; i < wordIndice.end; ++i) {
-      ++numlogProbs;
-      overallMean += logProbs[i];
-      features.at(featureRow, I_MEAN) += logProbs[i];
-
+      sum += logProbs[i];
       minScore = std::min<float>(logProbs[i], minScore);
     }
 
-    features.at(featureRow, I_MEAN) /= static_cast<float>(wordIndice.size());
+    overallMean += sum;
+    features.at(featureRow, I_MEAN) = sum / static_cast<float>(wordIndice.size());
     features.at(featureRow, I_MIN) = minScore;
     features.at(featureRow, I_NUM_SUBWORDS) = wordIndice.size();
 
     ++featureRow;
   }
 
-  if (numlogProbs == 0) {
-    return std::move(Matrix(0, 0));
-  }
-
   overallMean /= wordIndices.rbegin()->end;
 
-  for (int i = 0; i < features.rows; ++i) {
+  for (size_t i = firstRow; i < featureRow; ++i) {
     features.at(i, I_OVERALL_MEAN) = overallMean;
   }
+}
+
+namespace {
+
+// Entropy of the distribution over source tokens for a single target token
+float alignmentEntropy(const std::vector<float>& distribution) {
+  float entropy = 0.0;
+  for (const float p : distribution) {
+    if (p > 0.0f) {
+      entropy -= p * std::log(p);
+    }
+  }
+  return entropy;
+}
+
+}  // namespace
+
+MLPQualityEstimator::MLPQualityEstimator(Parameters&& parameters) : parameters_(std::move(parameters)) {
+  const size_t numFeatures = parameters_.features.size();
+  const size_t hiddenSize = parameters_.hiddenSize;
+  const size_t numInputs = hiddenSize > 0 ? hiddenSize : numFeatures;
+
+  ABORT_IF(numFeatures == 0, "The number of features cannot be zero");
+  ABORT_IF(parameters_.means.size() != numFeatures || parameters_.stds.size() != numFeatures,
+           "Expected a mean and std for each of the {} features", numFeatures);
+  ABORT_IF(parameters_.hiddenWeights.size() != hiddenSize * numFeatures ||
+               parameters_.hiddenBiases.size() != hiddenSize,
+           "Hidden layer parameters do not match a hidden size of {}", hiddenSize);
+  ABORT_IF(parameters_.outputWeights.size() != numInputs, "Expected {} output weights", numInputs);
+
+  for (const QualityFeature feature : parameters_.features) {
+    ABORT_IF(feature >= NUM_QUALITY_FEATURES, "Unknown quality estimation feature {}", static_cast<uint32_t>(feature));
+    needsAlignments_ |= feature == WORD_ATTENTION_ENTROPY;
+  }
+
+  for (const float std : parameters_.stds) {
+    ABORT_IF(std == 0.0, "Invalid stds");
+  }
+
+  // Fold the scaling (x - mean) / std into the weights and biases of the first layer
+  const std::vector<float>& weights = hiddenSize > 0 ? parameters_.hiddenWeights : parameters_.outputWeights;
+  const size_t numUnits = hiddenSize > 0 ? hiddenSize : 1;
+
+  scaledWeights_.resize(weights.size());
+  scaledBiases_.resize(numUnits);
+
+  for (size_t k = 0; k < numUnits; ++k) {
+    scaledBiases_[k] = hiddenSize > 0 ? parameters_.hiddenBiases[k] : parameters_.outputBias;
+    for (size_t j = 0; j < numFeatures; ++j) {
+      scaledWeights_[k * numFeatures + j] = weights[k * numFeatures + j] / parameters_.stds[j];
+      scaledBiases_[k] -= scaledWeights_[k * numFeatures + j] * parameters_.means[j];
+    }
+  }
+}
+
+MLPQualityEstimator MLPQualityEstimator::fromAlignedMemory(const AlignedMemory& alignedMemory) {
+  LOG(info, "[data] Loading Quality Estimator model from buffer");
+
+  const char* ptr = alignedMemory.begin();
+  const size_t blobSize = alignedMemory.size();
+
+  ABORT_IF(blobSize < sizeof(Header), "Quality estimation file too small");
+  const Header& header = *reinterpret_cast<const Header*>(ptr);
+
+  ABORT_IF(header.magic != BINARY_QE_CONTAINER_MAGIC, "Incorrect magic bytes for quality estimation file");
+  ABORT_IF(header.version != VERSION, "Unsupported quality estimation file version {}, expected version {}",
+           header.version, VERSION);
+  ABORT_IF(header.numFeatures == 0, "The number of features cannot be zero");
+
+  const size_t numFeatures = header.numFeatures;
+  const size_t hiddenSize = header.hiddenSize;
+  const size_t numInputs = hiddenSize > 0 ? hiddenSize : numFeatures;
+
+  const uint64_t expectedSize =
+      sizeof(Header) + numFeatures * sizeof(uint32_t) +
+      (2 * numFeatures + hiddenSize * numFeatures + hiddenSize + numInputs + /*outputBias=*/1) * sizeof(float);
+  ABORT_IF(expectedSize != blobSize, "QE header claims file size should be {} bytes but file is {} bytes", expectedSize,
+           blobSize);
+
+  ptr += sizeof(Header);
+  const uint32_t* features = reinterpret_cast<const uint32_t*>(ptr);
+  const float* memoryIndex = reinterpret_cast<const float*>(features + numFeatures);
+
+  auto read = [&memoryIndex](size_t size) {
+    std::vector<float> values(memoryIndex, memoryIndex + size);
+    memoryIndex += size;
+    return values;
+  };
+
+  Parameters parameters;
+  for (size_t i = 0; i < numFeatures; ++i) {
+    ABORT_IF(features[i] >= NUM_QUALITY_FEATURES, "Unknown quality estimation feature {}", features[i]);
+    parameters.features.push_back(static_cast<QualityFeature>(features[i]));
+  }
+
+  parameters.means = read(numFeatures);
+  parameters.stds = read(numFeatures);
+  parameters.hiddenSize = hiddenSize;
+  parameters.hiddenWeights = read(hiddenSize * numFeatures);
+  parameters.hiddenBiases = read(hiddenSize);
+  parameters.outputWeights = read(numInputs);
+  parameters.outputBias = *memoryIndex;
 
-  return std::move(features);
+  return MLPQualityEstimator(std::move(parameters));
 }
 
-std::vector<SubwordRange> mapWords(const std::vector<float>& logProbs, const AnnotatedText& target,
-                                   const size_t sentenceIdx) {
+AlignedMemory MLPQualityEstimator::toAlignedMemory() const {
+  const size_t numFeatures = parameters_.features.size();
+
+  Header header = {BINARY_QE_CONTAINER_MAGIC, VERSION, static_cast<uint32_t>(numFeatures),
+                   static_cast<uint32_t>(parameters_.hiddenSize), /*reserved=*/0};
+
+  const size_t size = sizeof(header) + numFeatures * sizeof(uint32_t) +
+                      (parameters_.means.size() + parameters_.stds.size() + parameters_.hiddenWeights.size() +
+                       parameters_.hiddenBiases.size() + parameters_.outputWeights.size() + 1) *
+                          sizeof(float);
+  AlignedMemory memory(size);
+
+  char* buffer = memory.begin();
+
+  auto write = [&buffer](const void* data, size_t size) {
+    memcpy(buffer, data, size);
+    buffer += size;
+  };
+
+  write(&header, sizeof(header));
+
+  for (const QualityFeature feature : parameters_.features) {
+    const uint32_t value = feature;
+    write(&value, sizeof(value));
+  }
+
+  for (const std::vector<float>* values : {&parameters_.means, &parameters_.stds, &parameters_.hiddenWeights,
+                                           &parameters_.hiddenBiases, &parameters_.outputWeights}) {
+    write(values->data(), values->size() * sizeof(float));
+  }
+
+  write(&parameters_.outputBias, sizeof(parameters_.outputBias));
+
+  return memory;
+}
+
+void MLPQualityEstimator::computeQualityScores(const Histories& histories,
+                                               const std::vector<std::vector<SubwordRange>>& words,
+                                               std::vector<Response::SentenceQualityScore>& qualityScores) const {
+  // Same as LogisticRegressorQualityEstimator: collect the features of all words in the batch, and apply the model to
+  // all of them at once.
+  std::vector<std::vector<float>> logProbs;
+  std::vector<std::vector<std::vector<float>>> alignments;
+  logProbs.reserve(histories.size());
+  alignments.reserve(histories.size());
+
+  size_t numWords = 0;
+  for (size_t i = 0; i < histories.size(); ++i) {
+    const Result result = histories[i]->top();
+    const Hypothesis::PtrType& hypothesis = std::get<1>(result);
+    logProbs.push_back(hypothesis->tracebackWordScores());
+    numWords += words[i].size();
+
+    if (needsAlignments_) {
+      alignments.push_back(hypothesis->tracebackAlignment());
+      // Without alignment enabled in the translation model there is a row for each token, but they are all empty. The
+      // TranslationModel checks that it is enabled when it loads.
+      assert(alignments.back().size() == logProbs.back().size() &&
+             (alignments.back().empty() || !alignments.back().front().empty()));
+    } else {
+      alignments.emplace_back();
+    }
+  }
+
+  Matrix features(numWords, parameters_.features.size());
+  for (size_t i = 0, row = 0; i < histories.size(); row += words[i].size(), ++i) {
+    extractFeatures(words[i], logProbs[i], alignments[i], features, row);
+  }
+
+  const std::vector<float> scores = predict(features);
+
+  qualityScores.reserve(qualityScores.size() + histories.size());
+  for (size_t i = 0, row = 0; i < histories.size(); row += words[i].size(), ++i) {
+    std::vector<float> wordScores(scores.begin() + row, scores.begin() + row + words[i].size());
+
+    const float sentenceScore =
+        std::accumulate(std::begin(wordScores), std::end(wordScores), float(0.0)) / wordScores.size();
+
+    qualityScores.push_back({std::move(wordScores), words[i], sentenceScore});
+  }
+}
+
+std::vector<float> MLPQualityEstimator::predict(const Matrix& features) const {
+  const size_t numFeatures = parameters_.features.size();
+  ABORT_IF(features.cols != numFeatures, "Expected {} features, got {}", numFeatures, features.cols);
+
+  std::vector<float> scores;
+
+  if (parameters_.hiddenSize == 0) {
+    // Just the output unit, which works like the logistic regressor
+    scores.assign(features.rows, scaledBiases_[0]);
+    for (size_t j = 0; j < numFeatures; ++j) {
+      const float* column = features.column(j);
+      const float weight = scaledWeights_[j];
+      for (size_t i = 0; i < features.rows; ++i) {
+        scores[i] += column[i] * weight;
+      }
+    }
+  } else {
+    // One hidden unit at a time for all rows: the unit's activation, then its contribution to the output.
+    scores.assign(features.rows, parameters_.outputBias);
+    std::vector<float> hidden(features.rows);
+    for (size_t k = 0; k < parameters_.hiddenSize; ++k) {
+      std::fill(hidden.begin(), hidden.end(), scaledBiases_[k]);
+      for (size_t j = 0; j < numFeatures; ++j) {
+        const float* column = features.column(j);
+        const float weight = scaledWeights_[k * numFeatures + j];
+        for (size_t i = 0; i < features.rows; ++i) {
+          hidden[i] += column[i] * weight;
+        }
+      }
+
+      const float weight = parameters_.outputWeights[k];
+      for (size_t i = 0; i < features.rows; ++i) {
+        scores[i] += std::max(hidden[i], 0.0f) * weight;
+      }
+    }
+  }
+
+  // Same as LogisticRegressorQualityEstimator: log(1 - sigmoid(x))
+  for (size_t i = 0; i < features.rows; ++i) {
+    scores[i] = -std::log1p(std::exp(scores[i]));
+  }
+
+  return scores;
+}
+
+void MLPQualityEstimator::extractFeatures(const std::vector<SubwordRange>& wordIndices,
+                                          const std::vector<float>& logProbs,
+                                          const std::vector<std::vector<float>>& alignment, Matrix& features,
+                                          const size_t firstRow) const {
+  if (wordIndices.empty()) {
+    return;
+  }
+
+  // Words cover all subwords but the EOS token.
+  const size_t numSubwords = wordIndices.back().end;
+  const float sentenceMean = std::accumulate(logProbs.begin(), logProbs.begin() + numSubwords, float(0.0)) /
+                             static_cast<float>(numSubwords);
+
+  for (size_t w = 0; w < wordIndices.size(); ++w) {
+    const SubwordRange& word = wordIndices[w];
+
+    // Like LogisticRegressorQualityEstimator, words without subwords only get the sentence level features.
+    float sum = 0.0, minScore = 0.0, entropy = 0.0;
+    if (word.size() > 0) {
+      minScore = std::numeric_limits<float>::max();
+      for (size_t i = word.begin; i < word.end; ++i) {
+        sum += logProbs[i];
+        minScore = std::min<float>(logProbs[i], minScore);
+        if (needsAlignments_) {
+          entropy += alignmentEntropy(alignment[i]);
+        }
+      }
+    }
+
+    const float size = std::max<float>(word.size(), 1.0f);
+
+    for (size_t col = 0; col < features.cols; ++col) {
+      float& value = features.at(firstRow + w, col);
+      switch (parameters_.features[col]) {
+        case WORD_MEAN_LOGPROB:
+          value = sum / size;
+          break;
+        case WORD_MIN_LOGPROB:
+          value = minScore;
+          break;
+        case WORD_NUM_SUBWORDS:
+          value = word.size();
+          break;
+        case SENTENCE_MEAN_LOGPROB:
+          value = sentenceMean;
+          break;
+        case WORD_ATTENTION_ENTROPY:
+          value = entropy / size;
+          break;
+        default:
+          ABORT("Unknown quality estimation feature {}", static_cast<uint32_t>(parameters_.features[col]));
+      }
+    }
+  }
+}
+
+std::shared_ptr<QualityEstimator> createQualityEstimator(const AlignedMemory& qualityFileMemory) {
+  // If no quality file return simple model
+  if (qualityFileMemory.size() == 0) {
+    return std::make_shared<UnsupervisedQualityEstimator>();
+  }
+
+  uint64_t magic = 0;
+  if (qualityFileMemory.size() >= sizeof(magic)) {
+    memcpy(&magic, qualityFileMemory.begin(), sizeof(magic));
+  }
+
+  if (magic == BINARY_QE_CONTAINER_MAGIC) {
+    return std::make_shared<MLPQualityEstimator>(MLPQualityEstimator::fromAlignedMemory(qualityFileMemory));
+  }
+
+  // Checks the magic bytes itself, and aborts if they do not match either.
+  return std::make_shared<LogisticRegressorQualityEstimator>(
+      LogisticRegressorQualityEstimator::fromAlignedMemory(qualityFileMemory));
+}
+
+std::vector<SubwordRange> mapWords(const std::vector<string_view>& subwords) {
   // Ignore empty target
-  if ((logProbs.size() < 2) || (target.numWords(sentenceIdx) == 0)) {
+  if (subwords.size() < 2) {
     return {};
   }
   // It is expected that translated words will have at least one word
@@ -249,20 +571,18 @@ std::vector<SubwordRange> mapWords(const std::vector<float>& logProbs, const Ann
 
   /// The LogisticRegressorQualityEstimator model ignores the presence of the EOS token, and hence we only need to
   /// iterate n-1 positions.
-  for (size_t subwordIdx = 0; subwordIdx < (logProbs.size() - 1); ++subwordIdx) {
-    ByteRange subword = target.wordAsByteRange(sentenceIdx, subwordIdx);
-
-    const char firstLetter = target.text.at(subword.begin);
+  for (size_t subwordIdx = 0; subwordIdx < (subwords.size() - 1); ++subwordIdx) {
+    const string_view& subword = subwords[subwordIdx];
 
     // if the first character is whitespace, it's a beginning of a new word
-    if (isspace(firstLetter)) {
+    if (!subword.empty() && isspace(static_cast<unsigned char>(subword.front()))) {
       wordIndices.back().end = subwordIdx;
       wordIndices.emplace_back();
       wordIndices.back().begin = subwordIdx;
     }
   }
 
-  wordIndices.back().end = logProbs.size() - 1;
+  wordIndices.back().end = subwords.size() - 1;
 
   return wordIndices;
 }
@@ -11,14 +11,17 @@ namespace marian::bergamot {
 
 class QualityEstimator {
  public:
-  /// Computes quality-scores using values from Histories and subword tokens which comes from Response
+  /// Computes quality-scores using values from Histories and subword tokens which comes from the decoded target
   ///
   ///
-  /// @param [in] histories: Histories obtained from translating a blob of source-text
-  /// @param [in] response: Partially constructed response, holding tokenization info
-  /// for source and target. The quality-scores for each sentence obtained from source-text blob
-  /// are written out as SentenceQualityEstimate into response.
-  virtual void computeQualityScores(const Histories &histories, Response &response) const = 0;
+  /// @param [in] histories: Histories obtained from translating a batch of sentences
+  /// @param [in] words: Words of the decoded translation of each history, as given by `mapWords`.
+  /// @param [out] qualityScores: The quality-scores for each sentence are appended as SentenceQualityScore.
+  virtual void computeQualityScores(const Histories &histories, const std::vector<std::vector<SubwordRange>> &words,
+                                    std::vector<Response::SentenceQualityScore> &qualityScores) const = 0;
+
+  /// Whether the histories need to hold alignments, i.e. the translation model has to be run with `alignment` set.
+  virtual bool needsAlignments() const { return false; }
 };
 
 /// Unsupervised Quality Estimator model. It uses the translator model's log probabilities (log probs) as a proxy for
@@ -26,11 +29,12 @@ class QualityEstimator {
 /// tokens that make it up. The sentence score is the mean of all word's log probs.
 class UnsupervisedQualityEstimator : public QualityEstimator {
  public:
-  void computeQualityScores(const Histories &histories, Response &response) const override;
+  void computeQualityScores(const Histories &histories, const std::vector<std::vector<SubwordRange>> &words,
+                            std::vector<Response::SentenceQualityScore> &qualityScores) const override;
 
  private:
-  Response::SentenceQualityScore computeSentenceScores(const std::vector<float> &logProbs, const AnnotatedText &target,
-                                                       const size_t sentenceIdx) const;
+  Response::SentenceQualityScore computeSentenceScores(const std::vector<float> &logProbs,
+                                                       const std::vector<SubwordRange> &wordIndices) const;
 };
 
 // ASCII and Unicode text files never start with the following 64 bits
@@ -62,6 +66,9 @@ class LogisticRegressorQualityEstimator : public QualityEstimator {
   /// Matrix is an internal data structure that was created only to be used in LogisticRegressorQualityEstimator
   /// methods. It intends to represent a matrix, so it receives row and column values as a constructor. Furthermore, the
   /// method `at` can access specific data given a row and col position.
+  ///
+  /// Data is stored column by column, so all values of one feature are contiguous in memory. This way the scaling and
+  /// the dot product in `predict` run over plain arrays and can be vectorized by the compiler.
   class Matrix {
    public:
     /// Number of rows
@@ -81,6 +88,10 @@ class LogisticRegressorQualityEstimator : public QualityEstimator {
     const float &at(const size_t row, const size_t col) const;
     float &at(const size_t row, const size_t col);
 
+    /// Return the `rows` values of column `col`
+    /// @param [in] col: col position
+    const float *column(const size_t col) const;
+
    private:
     std::vector<float> data_;
   };
@@ -105,7 +116,8 @@ class LogisticRegressorQualityEstimator : public QualityEstimator {
   static LogisticRegressorQualityEstimator fromAlignedMemory(const AlignedMemory &alignedMemory);
   AlignedMemory toAlignedMemory() const;
 
-  void computeQualityScores(const Histories &histories, Response &response) const override;
+  void computeQualityScores(const Histories &histories, const std::vector<std::vector<SubwordRange>> &words,
+                            std::vector<Response::SentenceQualityScore> &qualityScores) const override;
   /// Given an input matrix \f$\mathbf{X}\f$, the usual Logistic Regression calculus can be seen as the following:
   ///
   /// 1) Standardize it, returning in \f$\mathbf{Z} = \frac{(\mathbf{X}-\mu)}{\sigma}\f$, where \f$\mu\f$ stands for the
@@ -130,7 +142,8 @@ class LogisticRegressorQualityEstimator : public QualityEstimator {
   /// the variable \f$\textit{constantFactor_}\f$ and \f$\textit{intercept_}\f$ in the code.
   ///
   /// @param [in] features: A Matrix struct of features. For a defintion what features currently means, please refer to
-  /// `extractFeatures` method in `quality_estimator.cpp`
+  /// `extractFeatures` method in `quality_estimator.cpp`. `computeQualityScores` passes in the features of all words in
+  /// a batch at once.
   std::vector<float> predict(const Matrix &features) const;
 
  private:
@@ -145,14 +158,101 @@ class LogisticRegressorQualityEstimator : public QualityEstimator {
   // Number of intercept values
   static constexpr const size_t numIntercept_ = 1;
 
-  /// construct the struct SentenceQualityEstimate
+  /// Writes the features of the words in `wordIndices` to the rows of `features` starting at `firstRow`
+  /// @param [in] wordIndices: the words of a sentence as given by `mapWords`
   /// @param [in] logProbs: the log probabilities given by an translation model
-  /// @param [in] target: AnnotatedText target value
-  /// @param [in] sentenceIdx: the id of a candidate sentence
-  Response::SentenceQualityScore computeSentenceScores(const std::vector<float> &logProbs, const AnnotatedText &target,
-                                                       const size_t sentenceIdx) const;
+  /// @param [out] features: Matrix with at least `firstRow + wordIndices.size()` rows
+  /// @param [in] firstRow: row of the first word in `wordIndices`
+  void extractFeatures(const std::vector<SubwordRange> &wordIndices, const std::vector<float> &logProbs,
+                       Matrix &features, const size_t firstRow) const;
+};
+
+// Signature of the versioned quality estimator container format, see `MLPQualityEstimator`. Like the one above, no
+// text file starts with these 64 bits.
+constexpr std::uint64_t BINARY_QE_CONTAINER_MAGIC = 0x5fcc336f1d54b181;
+
+/// Features a quality estimator model can be trained on. Each is computed per word, where a word consists of one or
+/// more subword tokens. The values are part of the binary format, so never change or reuse them.
+enum QualityFeature : uint32_t {
+  WORD_MEAN_LOGPROB = 0,       ///< Mean log probability of the subwords of the word
+  WORD_MIN_LOGPROB = 1,        ///< Minimum log probability of the subwords of the word
+  WORD_NUM_SUBWORDS = 2,       ///< Number of subwords the word consists of
+  SENTENCE_MEAN_LOGPROB = 3,   ///< Mean log probability of all subwords in the sentence
+  WORD_ATTENTION_ENTROPY = 4,  ///< Mean entropy of the alignment of the subwords of the word over the source tokens
+  NUM_QUALITY_FEATURES
+};
+
+/// Quality estimator with a configurable set of features and a small multi-layer perceptron: the standardized
+/// features go through a hidden layer with ReLU activations, followed by a single output unit. With a hidden layer of
+/// size 0 it is a logistic regressor over the configured features. Like `LogisticRegressorQualityEstimator`, the
+/// score of a word is log(1 - sigmoid(output)).
+///
+/// The binary format is versioned. It consists of, in order:
+/// - a `Header`
+/// - `numFeatures` uint32 `QualityFeature` values, describing the columns of the feature matrix
+/// - `numFeatures` means, then `numFeatures` standard deviations for scaling the features
+/// - if `hiddenSize` > 0: `hiddenSize` x `numFeatures` hidden layer weights (row by row) and `hiddenSize` biases
+/// - the weights of the output unit, one for each input to it (`hiddenSize`, or `numFeatures` if there is no hidden
+///   layer), and its bias.
+///
+/// All values are floats unless noted otherwise. Standardization is folded into the weights of the first layer when
+/// loading, so evaluating the model is a few multiply-add loops over contiguous feature columns.
+class MLPQualityEstimator : public QualityEstimator {
+ public:
+  using Matrix = LogisticRegressorQualityEstimator::Matrix;
+
+  static constexpr uint32_t VERSION = 1;
+
+  struct Header {
+    uint64_t magic;        ///< BINARY_QE_CONTAINER_MAGIC
+    uint32_t version;      ///< Version of the format, currently VERSION
+    uint32_t numFeatures;  ///< Number of features the model uses
+    uint32_t hiddenSize;   ///< Number of units in the hidden layer, 0 for none
+    uint32_t reserved;     ///< Keeps the header a multiple of 8 bytes, must be 0
+  };
 
-  Matrix extractFeatures(const std::vector<SubwordRange> &wordIndices, const std::vector<float> &logProbs) const;
+  /// Model parameters, as they are stored in the binary format.
+  struct Parameters {
+    std::vector<QualityFeature> features;
+    std::vector<float> means;
+    std::vector<float> stds;
+    size_t hiddenSize{0};
+    std::vector<float> hiddenWeights;  ///< hiddenSize x features.size(), row-major
+    std::vector<float> hiddenBiases;   ///< hiddenSize
+    std::vector<float> outputWeights;  ///< hiddenSize, or features.size() if hiddenSize is 0
+    float outputBias{0.0f};
+  };
+
+  explicit MLPQualityEstimator(Parameters &&parameters);
+
+  /// Parses the binary format described above. Aborts if the memory does not hold a model of a supported version.
+  static MLPQualityEstimator fromAlignedMemory(const AlignedMemory &alignedMemory);
+  AlignedMemory toAlignedMemory() const;
+
+  void computeQualityScores(const Histories &histories, const std::vector<std::vector<SubwordRange>> &words,
+                            std::vector<Response::SentenceQualityScore> &qualityScores) const override;
+
+  /// True if the model uses WORD_ATTENTION_ENTROPY.
+  bool needsAlignments() const override { return needsAlignments_; }
+
+  /// Scores each row of `features`, which has a column for each of the model's features, in the same order.
+  std::vector<float> predict(const Matrix &features) const;
+
+ private:
+  Parameters parameters_;
+
+  // First layer with the standardization folded in: hiddenSize x numFeatures weights, or numFeatures weights of the
+  // output unit if there is no hidden layer.
+  std::vector<float> scaledWeights_;
+  std::vector<float> scaledBiases_;
+
+  bool needsAlignments_{false};
+
+  /// Writes the model's features of the words in `wordIndices` to the rows of `features` starting at `firstRow`.
+  /// `alignment` is only used if the model uses WORD_ATTENTION_ENTROPY.
+  void extractFeatures(const std::vector<SubwordRange> &wordIndices, const std::vector<float> &logProbs,
+                       const std::vector<std::vector<float>> &alignment, Matrix &features,
+                       const size_t firstRow) const;
 };
 
 /// createQualityEstimator model takes an `AlignedMemory`, which is the return from `getQualityEstimatorModel`.
@@ -165,17 +265,12 @@ class LogisticRegressorQualityEstimator : public QualityEstimator {
 /// If a value is passed to the `quality` argument, the model file is read and converted into an `AlignedMemory`
 /// structure, which instantiates a QualityEstimator object.
 
+/// The first 64 bits of the file tell which kind of model it is: `BINARY_QE_MODEL_MAGIC` for a
+/// `LogisticRegressorQualityEstimator`, or `BINARY_QE_CONTAINER_MAGIC` for the versioned `MLPQualityEstimator` format.
+///
 /// @param [in] qualityFileMemory: An `AlignedMemory` which is created by parsing a QE model binary file through
 /// getQualityEstimatorModel
-inline std::shared_ptr<QualityEstimator> createQualityEstimator(const AlignedMemory &qualityFileMemory) {
-  // If no quality file return simple model
-  if (qualityFileMemory.size() == 0) {
-    return std::make_shared<UnsupervisedQualityEstimator>();
-  }
-
-  return std::make_shared<LogisticRegressorQualityEstimator>(
-      LogisticRegressorQualityEstimator::fromAlignedMemory(qualityFileMemory));
-}
+std::shared_ptr<QualityEstimator> createQualityEstimator(const AlignedMemory &qualityFileMemory);
 
 /// A word is composed of multiple subtokens. Entire words are tokens splitted by whitespace.
 /// This method takes a sequence of sublevel tokens (given by AnnotatedText) as well aligned with their log
@@ -200,11 +295,11 @@ inline std::shared_ptr<QualityEstimator> createQualityEstimator(const AlignedMem
 /// a vector where each position corresponds to the SubwordRange of the following words: marian
 /// es un buen servicio de traducción. Hence, its length is 7. The value of the first element would be [0,3)
 
-/// @param [in] logProbs: the log probabilities of byte pair encodings (BPE) that comes from the tracebackWordScores
-/// method (which belongs to hypothesis.h in Marian)
-/// @param [in] target: AnnotatedText target value
-/// @param [in] sentenceIdx: the id of a candidate sentence
-std::vector<SubwordRange> mapWords(const std::vector<float> &logProbs, const AnnotatedText &target,
-                                   const size_t sentenceIdx);
+/// This is done once by the worker while decoding a translation, the result is kept with the translated sentence and
+/// handed to the quality estimator and the Response, so none of them needs to look at the text again.
+///
+/// @param [in] subwords: the decoded subword tokens of a sentence, one for each log probability that comes from the
+/// tracebackWordScores method (which belongs to hypothesis.h in Marian), so ending with the EOS token
+std::vector<SubwordRange> mapWords(const std::vector<string_view> &subwords);
 
 }  // namespace marian::bergamot
@@ -1,5 +1,6 @@
 #include "request.h"
 
+#include <algorithm>
 #include <string>
 
 #include "annotation.h"
@@ -22,25 +23,33 @@ size_t hashForCache(const TranslationModel &model, const marian::Words &words) {
 }
 
 // -----------------------------------------------------------------
-Request::Request(size_t Id, const TranslationModel &model, Segments &&segments, ResponseBuilder &&responseBuilder,
-                 std::optional<TranslationCache> &cache)
+Request::Request(size_t Id, const TranslationModel &model, Segments &&segments, TranslationsCallback &&responseBuilder,
+                 std::optional<TranslationCache> &cache, SentenceCallback sentenceCallback,
+                 Ptr<StageTimings> timings)
     : Id_(Id),
       model_(model),
       segments_(std::move(segments)),
       responseBuilder_(std::move(responseBuilder)),
-      cache_(cache) {
+      sentenceCallback_(std::move(sentenceCallback)),
+      cache_(cache),
+      timings_(std::move(timings)) {
   counter_ = segments_.size();
-  histories_.resize(segments_.size(), nullptr);
+  translations_.resize(segments_.size(), nullptr);
+
+  if (timings_) {
+    timings_->sentences.resize(segments_.size());
+    queued_ = Clock::now();
+  }
 
   // 1. If there are no segments_, we are never able to trigger the responseBuilder calls from a different thread. This
   // happens when the use provides empty input, or the sentence and subword preprocessing deems no translatable units
   // present. However, in this case we want an empty valid response. There's no need to do any additional processing
   // here.
   if (segments_.size() == 0) {
-    responseBuilder_(std::move(histories_));
+    respond();
   } else {
     counter_ = segments_.size();
-    histories_.resize(segments_.size());
+    translations_.resize(segments_.size());
 
     if (cache_) {
       // Iterate through segments, see if any can be prefilled from cache. If prefilled, mark the particular segments as
@@ -48,16 +57,19 @@ Request::Request(size_t Id, const TranslationModel &model, Segments &&segments,
       // less segment to translate.
       for (size_t idx = 0; idx < segments_.size(); idx++) {
         size_t key = hashForCache(model_, getSegment(idx));
-        auto [found, history] = cache_->find(key);
+        auto [found, translation] = cache_->find(key);
         if (found) {
-          histories_[idx] = history;
+          translations_[idx] = translation;
           --counter_;
+          if (sentenceCallback_) {
+            sentenceCallback_(idx, translation);
+          }
         }
       }
       // 2. Also, if cache somehow manages to decrease all counter prefilling histories, then we'd have to trigger
-      // ResponseBuilder as well. No segments go into batching and therefore no processHistory triggers.
+      // ResponseBuilder as well. No segments go into batching and therefore no processTranslation triggers.
       if (counter_.load() == 0) {
-        responseBuilder_(std::move(histories_));
+        respond();
       }
     }
   }
@@ -69,23 +81,47 @@ size_t Request::segmentTokens(size_t index) const { return (segments_[index].siz
 
 Segment Request::getSegment(size_t index) const { return segments_[index]; }
 
-void Request::processHistory(size_t index, Ptr<History> history) {
-  // Concurrently called by multiple workers as a history from translation is
-  // ready. The container storing histories is set with the value obtained.
+void Request::processTranslation(size_t index, Ptr<TranslatedSentence const> translation,
+                                 const WorkerTimings &share) {
+  // Concurrently called by multiple workers as a translation is ready. The
+  // container storing translations is set with the value obtained.
 
-  // Fill in placeholder from History obtained by freshly translating. Since this was a cache-miss to have got through,
-  // update cache if available to store the result.
-  histories_[index] = history;
+  if (timings_) {
+    StageTimings::Sentence &sentence = timings_->sentences[index];
+    sentence.queueWait = std::chrono::duration<double>(share.started - queued_).count();
+    sentence.translate = share.translate;
+    sentence.qualityEstimate = share.qualityEstimate;
+  }
+
+  // Fill in placeholder from translation obtained by freshly translating. Since this was a cache-miss to have got
+  // through, update cache if available to store the result.
+  translations_[index] = translation;
   if (cache_) {
     size_t key = hashForCache(model_, getSegment(index));
-    cache_->store(key, histories_[index]);
+    cache_->store(key, translations_[index]);
+  }
+
+  if (sentenceCallback_) {
+    sentenceCallback_(index, translation);
   }
 
   // In case this is last request in, completeRequest is called, which sets the
   // value of the promise.
   if (--counter_ == 0) {
-    responseBuilder_(std::move(histories_));
+    respond();
+  }
+}
+
+void Request::respond() {
+  if (timings_) {
+    StageTimings &timings = *timings_;
+    for (auto &sentence : timings.sentences) {
+      timings[Stage::QUEUE] = std::max(timings[Stage::QUEUE], sentence.queueWait);
+      timings[Stage::TRANSLATE] += sentence.translate;
+      timings[Stage::QUALITY_ESTIMATE] += sentence.qualityEstimate;
+    }
   }
+  responseBuilder_(std::move(translations_));
 }
 
 bool Request::operator<(const Request &b) const {
@@ -99,10 +135,10 @@ RequestSentence::RequestSentence(size_t index, Ptr<Request> request) : index_(in
 
 size_t RequestSentence::numTokens() const { return (request_->segmentTokens(index_)); }
 
-void RequestSentence::completeSentence(Ptr<History> history) {
-  // Relays completeSentence into request's processHistory, using index
+void RequestSentence::completeSentence(Ptr<TranslatedSentence const> translation, const WorkerTimings &share) {
+  // Relays completeSentence into request's processTranslation, using index
   // information.
-  request_->processHistory(index_, history);
+  request_->processTranslation(index_, translation, share);
 }
 
 Segment RequestSentence::getUnderlyingSegment() const { return request_->getSegment(index_); }
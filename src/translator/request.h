@@ -2,6 +2,7 @@
 #define SRC_BERGAMOT_REQUEST_H_
 
 #include <cassert>
+#include <functional>
 #include <future>
 #include <vector>
 
@@ -12,6 +13,7 @@
 #include "definitions.h"
 #include "response.h"
 #include "response_builder.h"
+#include "timing.h"
 #include "translator/beam_search.h"
 
 namespace marian {
@@ -19,6 +21,14 @@ namespace bergamot {
 
 class TranslationModel;
 
+/// Called with the translations of all sentences of a Request once the last one is complete. Usually a
+/// ResponseBuilder.
+typedef std::function<void(TranslatedSentences &&)> TranslationsCallback;
+
+/// Called with the translation of a single sentence of a Request as soon as it is available, along with its index in
+/// the Request. Sentences complete in no particular order, and calls can come from any worker thread.
+typedef std::function<void(size_t, Ptr<TranslatedSentence const>)> SentenceCallback;
+
 /// A Request is an internal representation used to represent a request after
 /// processed by TextProcessor into sentences constituted by marian::Words.
 ///
@@ -30,13 +40,15 @@ class TranslationModel;
 /// ```cpp
 ///   Batch::completeBatch(...)
 ///       -> RequestSentence::completeSentence(..)
-///          -> Request::processHistory(...)
+///          -> Request::processTranslation(...)
 /// ```
 ///
 /// When all sentences in a Request are completed, responseBuilder is
-/// triggered with the compiled Histories, to construct the Response
+/// triggered with the compiled TranslatedSentences, to construct the Response
 /// corresponding to the Request and set value of the promise which triggers the
-/// future at client.
+/// future at client. An optional sentenceCallback is triggered with each
+/// sentence as soon as it is complete, which allows pivoting to start on the
+/// second model without waiting for the whole Request.
 class Request {
  public:
   /// Constructs an internal representation of the Request identified by Id,
@@ -53,8 +65,13 @@ class Request {
   /// Request.
   /// @param [in] cache: Cache supplied externally to attempt to fetch translations or store them after completion for
   /// reuse later.
-  Request(size_t Id, const TranslationModel &model, Segments &&segments, ResponseBuilder &&responseBuilder,
-          std::optional<TranslationCache> &cache);
+  /// @param [in] sentenceCallback: Optional callback triggered with each sentence as it completes, including those
+  /// found in the cache, before responseBuilder is triggered for the last one.
+  /// @param [in] timings: Optional timings to fill in with the queueing and translation of each sentence, before
+  /// responseBuilder is triggered. Expected to be shared with the responseBuilder.
+  Request(size_t Id, const TranslationModel &model, Segments &&segments, TranslationsCallback &&responseBuilder,
+          std::optional<TranslationCache> &cache, SentenceCallback sentenceCallback = nullptr,
+          Ptr<StageTimings> timings = nullptr);
 
   /// Obtain the count of tokens in the segment correponding to index. Used to
   /// insert sentence from multiple requests into the corresponding size bucket.
@@ -71,13 +88,18 @@ class Request {
   /// BatchingPool.
   bool operator<(const Request &request) const;
 
-  /// Processes a history obtained after translating in a heterogenous batch
-  /// compiled from requests.
-  void processHistory(size_t index, Ptr<History> history);
+  /// Processes a translation obtained after translating in a heterogenous batch
+  /// compiled from requests. `share` is the time the worker spent on this
+  /// sentence, recorded if this Request is timed.
+  void processTranslation(size_t index, Ptr<TranslatedSentence const> translation,
+                          const WorkerTimings &share = WorkerTimings());
 
-  bool cacheHitPrefilled(size_t index) const { return histories_[index] != nullptr; }
+  bool cacheHitPrefilled(size_t index) const { return translations_[index] != nullptr; }
 
  private:
+  /// Triggers responseBuilder_ once all sentences are translated, after adding up the timings of the sentences.
+  void respond();
+
   size_t Id_;
 
   /// TranslationModel associated with this request
@@ -92,16 +114,26 @@ class Request {
   /// input string.
   Segments segments_;
 
-  /// histories_ is a buffer which eventually stores the translations of each
+  /// translations_ is a buffer which eventually stores the translations of each
   /// segment in the corresponding index.
-  std::vector<Ptr<History>> histories_;
+  TranslatedSentences translations_;
 
   /// Constructing Response requires the vocabs_ used to generate Request.
   /// std::vector<Ptr<Vocab const>> *vocabs_;
-  ResponseBuilder responseBuilder_;
+  TranslationsCallback responseBuilder_;
+
+  /// Triggered with each sentence as it completes, if set.
+  SentenceCallback sentenceCallback_;
 
   /// Cache used to hold unit translations. If nullopt, means no-caching.
   std::optional<TranslationCache> &cache_;
+
+  /// Timings of this request, if requested. Workers fill in the entry of the sentence they translated, which is only
+  /// added up in respond().
+  Ptr<StageTimings> timings_;
+
+  /// When the request was queued, to compute how long its sentences waited for a worker.
+  Clock::time_point queued_;
 };
 
 /// A RequestSentence provides a view to a sentence within a Request. Existence
@@ -119,9 +151,9 @@ class RequestSentence {
   /// Accessor to the segment represented by the RequestSentence.
   Segment getUnderlyingSegment() const;
 
-  /// Forwards history to Request to set history corresponding to this
-  /// RequestSentence.
-  void completeSentence(Ptr<History> history);
+  /// Forwards translation to Request to set translation corresponding to this
+  /// RequestSentence, along with the time the worker spent on it.
+  void completeSentence(Ptr<TranslatedSentence const> translation, const WorkerTimings &share = WorkerTimings());
 
   friend bool operator<(const RequestSentence &a, const RequestSentence &b);
 
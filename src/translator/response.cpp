@@ -5,16 +5,37 @@
 
 namespace marian::bergamot {
 
+Alignment::Alignment(std::vector<std::vector<float>> const &rows)
+    : rows_(rows.size()), cols_(rows.empty() ? 0 : rows.front().size()) {
+  data_.reserve(rows_ * cols_);
+  for (auto const &row : rows) {
+    ABORT_IF(row.size() != cols_, "Alignment rows are expected to be of equal length");
+    data_.insert(data_.end(), row.begin(), row.end());
+  }
+}
+
+namespace {
+
+/// Entry of the sparse matrix relating the tokenization of the pivot on the target side (q', input of the second
+/// model) to the one on the source side (q, output of the first model): `weight` is the share of the probability of
+/// q'_j' that goes to q_j.
+struct PivotOverlap {
+  size_t targetSidePivot;  // j'
+  size_t sourceSidePivot;  // j
+  float weight;
+};
+
 // We're marginalizing q out of p(s | q) x p( q | t). However, we have different representations of q on source side to
 // intermediate - p(s_i | q_j) and intermediate to target side - p(q'_j' | t_k).
 //
 // The matrix p(q'_j' | t_k) is rewritten into p(q_j | t_k) by means of spreading the probability in the former over
-// bytes and collecting it at the ranges specified by latter, using a two pointer accumulation strategy.
-Alignment transferThroughCharacters(const std::vector<ByteRange> &sourceSidePivots,
-                                    const std::vector<ByteRange> &targetSidePivots,
-                                    const Alignment &pivotGivenTargets) {
-  // Initialize an empty alignment matrix.
-  Alignment remapped(pivotGivenTargets.size(), std::vector<float>(sourceSidePivots.size(), 0.0f));
+// bytes and collecting it at the ranges specified by latter, using a two pointer accumulation strategy. That
+// rewriting does not depend on t_k, so it is done once for the sentence, as a sparse matrix W(j', j) that holds the
+// overlaps. The output is then (P(t, q') x W) x P(q, s), with both products computed row by row over contiguous memory.
+std::vector<PivotOverlap> overlapPivots(const std::vector<ByteRange> &sourceSidePivots,
+                                        const std::vector<ByteRange> &targetSidePivots) {
+  std::vector<PivotOverlap> overlaps;
+  overlaps.reserve(sourceSidePivots.size() + targetSidePivots.size());
 
   size_t sq, qt;
   for (sq = 0, qt = 0; sq < sourceSidePivots.size() && qt < targetSidePivots.size();
@@ -22,9 +43,7 @@ Alignment transferThroughCharacters(const std::vector<ByteRange> &sourceSidePivo
     auto &sourceSidePivot = sourceSidePivots[sq];
     auto &targetSidePivot = targetSidePivots[qt];
     if (sourceSidePivot.begin == targetSidePivot.begin && sourceSidePivot.end == targetSidePivot.end) {
-      for (size_t t = 0; t < pivotGivenTargets.size(); t++) {
-        remapped[t][sq] += pivotGivenTargets[t][qt];
-      }
+      overlaps.push_back({qt, sq, 1.0f});
 
       // Perfect match, move pointer from both.
       sq++, qt++;
@@ -37,9 +56,7 @@ Alignment transferThroughCharacters(const std::vector<ByteRange> &sourceSidePivo
 
       size_t charCount = right - left;
       size_t probSpread = targetSidePivot.size();
-      for (size_t t = 0; t < pivotGivenTargets.size(); t++) {
-        remapped[t][sq] += charCount * pivotGivenTargets[t][qt] / static_cast<float>(probSpread);
-      }
+      overlaps.push_back({qt, sq, charCount / static_cast<float>(probSpread)});
 
       // Which one is ahead? sq or qt or both end at same point?
       if (sourceSidePivot.end == targetSidePivot.end) {
@@ -64,89 +81,110 @@ Alignment transferThroughCharacters(const std::vector<ByteRange> &sourceSidePivo
 
     // assert in DEBUG, that this is only EOS - occuring at the end and with zero-surface.
     assert(qt == targetSidePivots.size() - 1 && targetSidePivots[qt].size() == 0);
-    for (size_t t = 0; t < pivotGivenTargets.size(); t++) {
-      float gift = pivotGivenTargets[t][qt] / sourceSidePivots.size();
-      for (size_t sq = 0; sq < sourceSidePivots.size(); sq++) {
-        remapped[t][sq] += gift;
-      }
+    float gift = 1.0f / sourceSidePivots.size();
+    for (size_t sq = 0; sq < sourceSidePivots.size(); sq++) {
+      overlaps.push_back({qt, sq, gift});
     }
 
     qt++;
   }
 
 #ifdef DEBUG
-  // The following sanity check ensures when DEBUG is enabled that we have successfully transferred all probabily mass
-  // available over pivot tokens given a target token in our original input to the new remapped representation.
-  //
-  // It's been discovered that floating point arithmetic before we get the Alignment matrix can have values such that
-  // the distribution does not sum upto 1.
+  // The following sanity check ensures when DEBUG is enabled that we transfer all probabily mass available over a pivot
+  // token on the target side to the pivot tokens on the source side.
   const float EPS = 1e-6;
-  for (size_t t = 0; t < pivotGivenTargets.size(); t++) {
-    float sum = 0.0f, expectedSum = 0.0f;
-    for (size_t qt = 0; qt < targetSidePivots.size(); qt++) {
-      expectedSum += pivotGivenTargets[t][qt];
-    }
-    for (size_t sq = 0; sq < sourceSidePivots.size(); sq++) {
-      sum += remapped[t][sq];
-    }
-    std::cerr << fmt::format("Sum @ token {} = {} to be compared with expected {}.", t, sum, expectedSum) << std::endl;
-    ABORT_IF(std::abs(sum - expectedSum) > EPS, "Haven't accumulated probabilities, re-examine");
+  std::vector<float> sums(targetSidePivots.size(), 0.0f);
+  for (auto &overlap : overlaps) {
+    sums[overlap.targetSidePivot] += overlap.weight;
+  }
+  for (size_t qt = 0; qt < targetSidePivots.size(); qt++) {
+    std::cerr << fmt::format("Sum @ pivot token {} = {} to be compared with expected 1.", qt, sums[qt]) << std::endl;
+    ABORT_IF(std::abs(sums[qt] - 1.0f) > EPS, "Haven't accumulated probabilities, re-examine");
   }
 #endif  // DEBUG
 
-  return remapped;
+  return overlaps;
 }
 
+}  // namespace
+
 std::vector<Alignment> remapAlignments(const Response &first, const Response &second) {
   std::vector<Alignment> alignments;
+  alignments.reserve(first.source.numSentences());
+
+  // Extracts ByteRanges corresponding to a words constituting a sentence from an annotation.
+  auto extractWordByteRanges = [](const AnnotatedText &annotatedText, size_t sentenceId,
+                                  std::vector<ByteRange> &output) {
+    size_t N = annotatedText.numWords(sentenceId);
+    output.clear();
+    output.reserve(N);
+    for (size_t i = 0; i < N; i++) {
+      output.push_back(annotatedText.wordAsByteRange(sentenceId, i));
+    }
+  };
+
+  std::vector<ByteRange> sourceSidePivots, targetSidePivots;
+
   for (size_t sentenceId = 0; sentenceId < first.source.numSentences(); sentenceId++) {
     const Alignment &sourceGivenPivots = first.alignments[sentenceId];
     const Alignment &pivotGivenTargets = second.alignments[sentenceId];
 
-    // TODO: Allow range iterators and change algorithm, directly tapping into AnnotatedText
-    // Extracts ByteRanges corresponding to a words constituting a sentence from an annotation.
-    auto extractWordByteRanges = [](const AnnotatedText &annotatedText,
-                                    size_t sentenceId) -> std::vector<marian::bergamot::ByteRange> {
-      size_t N = annotatedText.numWords(sentenceId);
-      std::vector<ByteRange> output;
-
-      for (size_t i = 0; i < N; i++) {
-        output.push_back(annotatedText.wordAsByteRange(sentenceId, i));
-      }
-      return output;
-    };
+    extractWordByteRanges(first.target, sentenceId, sourceSidePivots);
+    extractWordByteRanges(second.source, sentenceId, targetSidePivots);
 
-    auto sourceSidePivots = extractWordByteRanges(first.target, sentenceId);
-    auto targetSidePivots = extractWordByteRanges(second.source, sentenceId);
+    size_t sourceTokenCount = first.source.numWords(sentenceId);
+    size_t targetTokenCount = second.target.numWords(sentenceId);
 
-    // Reintrepret probability p(q'_j' | t_k) as p(q_j | t_k)
-    Alignment remappedPivotGivenTargets =
-        transferThroughCharacters(sourceSidePivots, targetSidePivots, pivotGivenTargets);
+    // Reintrepret probability p(q'_j' | t_k) as p(q_j | t_k), multiplying each row with the sparse matrix of overlaps.
+    const std::vector<PivotOverlap> overlaps = overlapPivots(sourceSidePivots, targetSidePivots);
+    Alignment remappedPivotGivenTargets(targetTokenCount, sourceSidePivots.size(), 0.0f);
+    for (size_t idt = 0; idt < targetTokenCount; idt++) {
+      float *remappedRow = remappedPivotGivenTargets.row(idt);
+      float const *pivotGivenTarget = pivotGivenTargets.row(idt);
+      for (const PivotOverlap &overlap : overlaps) {
+        remappedRow[overlap.sourceSidePivot] += pivotGivenTarget[overlap.targetSidePivot] * overlap.weight;
+      }
+    }
 
     // Marginalize out q_j.
     // p(s_i | t_k) = \sum_{j} p(s_i | q_j) x p(q_j | t_k)
-    size_t sourceTokenCount = first.source.numWords(sentenceId);
-    size_t targetTokenCount = second.target.numWords(sentenceId);
-    Alignment output(targetTokenCount, std::vector<float>(sourceTokenCount, 0.0f));
+    Alignment output(targetTokenCount, sourceTokenCount, 0.0f);
     for (size_t idt = 0; idt < targetTokenCount; idt++) {
-      for (size_t idq = 0; idq < sourceSidePivots.size(); idq++) {
+      float *outputRow = output.row(idt);
+      float const *pivotGivenTarget = remappedPivotGivenTargets.row(idt);
+      // Matrices are of form p(s | t) = P(t, s), hence idq appears on the extremes. Four rows of p(s | q) are added
+      // at a time, so the output row is loaded and stored a quarter as often.
+      size_t idq = 0;
+      for (; idq + 4 <= sourceSidePivots.size(); idq += 4) {
+        float const *sourceGivenPivot0 = sourceGivenPivots.row(idq);
+        float const *sourceGivenPivot1 = sourceGivenPivots.row(idq + 1);
+        float const *sourceGivenPivot2 = sourceGivenPivots.row(idq + 2);
+        float const *sourceGivenPivot3 = sourceGivenPivots.row(idq + 3);
+        const float p0 = pivotGivenTarget[idq], p1 = pivotGivenTarget[idq + 1], p2 = pivotGivenTarget[idq + 2],
+                    p3 = pivotGivenTarget[idq + 3];
+        for (size_t ids = 0; ids < sourceTokenCount; ids++) {
+          outputRow[ids] += sourceGivenPivot0[ids] * p0 + sourceGivenPivot1[ids] * p1 + sourceGivenPivot2[ids] * p2 +
+                            sourceGivenPivot3[ids] * p3;
+        }
+      }
+      for (; idq < sourceSidePivots.size(); idq++) {
+        float const *sourceGivenPivot = sourceGivenPivots.row(idq);
         for (size_t ids = 0; ids < sourceTokenCount; ids++) {
-          // Matrices are of form p(s | t) = P[t][s], hence idq appears on the extremes.
-          output[idt][ids] += sourceGivenPivots[idq][ids] * remappedPivotGivenTargets[idt][idq];
+          outputRow[ids] += sourceGivenPivot[ids] * pivotGivenTarget[idq];
         }
       }
     }
 
-    alignments.push_back(output);
+    alignments.push_back(std::move(output));
   }
   return alignments;
 }
 
 std::vector<ByteRange> getWordByteRanges(const Response &response, size_t sentenceIdx) {
   std::vector<ByteRange> wordByteRanges;
-  wordByteRanges.reserve(response.qualityScores[sentenceIdx].wordRanges.size());
+  wordByteRanges.reserve(response.targetWords[sentenceIdx].size());
 
-  for (auto &&word : response.qualityScores[sentenceIdx].wordRanges) {
+  for (auto &&word : response.targetWords[sentenceIdx]) {
     size_t wordBegin = response.target.wordAsByteRange(sentenceIdx, word.begin).begin;
     size_t wordEnd = response.target.wordAsByteRange(sentenceIdx, word.end).begin;
 
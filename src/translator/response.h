@@ -2,6 +2,8 @@
 #define SRC_BERGAMOT_RESPONSE_H_
 
 #include <cassert>
+#include <initializer_list>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -9,12 +11,57 @@
 #include "data/alignment.h"
 #include "data/types.h"
 #include "definitions.h"
+#include "timing.h"
 #include "translator/beam_search.h"
 
 namespace marian {
 namespace bergamot {
 
-typedef std::vector<std::vector<float>> Alignment;
+/// Dense matrix of alignment scores for a single sentence, stored row-major
+/// in a single allocation:
+///    alignment(t, s) = p(source-token s | target token t)
+/// There is a row for each target token, and a column for each source token.
+class Alignment {
+ public:
+  Alignment() = default;
+
+  /// Creates a `rows` x `cols` matrix with all scores set to `value`.
+  Alignment(size_t rows, size_t cols, float value = 0.0f) : rows_(rows), cols_(cols), data_(rows * cols, value) {}
+
+  /// Copies scores from a matrix stored as a vector of rows, such as the soft
+  /// alignments marian produces. All rows need to have the same length.
+  Alignment(std::vector<std::vector<float>> const &rows);
+  Alignment(std::initializer_list<std::vector<float>> rows) : Alignment(std::vector<std::vector<float>>(rows)) {}
+
+  /// Number of target tokens.
+  size_t rows() const { return rows_; }
+
+  /// Number of source tokens.
+  size_t cols() const { return cols_; }
+
+  float &operator()(size_t t, size_t s) {
+    assert(t < rows_ && s < cols_);
+    return data_[t * cols_ + s];
+  }
+
+  float operator()(size_t t, size_t s) const {
+    assert(t < rows_ && s < cols_);
+    return data_[t * cols_ + s];
+  }
+
+  /// Scores of all source tokens for target token `t`, `cols()` of them.
+  float *row(size_t t) { return data_.data() + t * cols_; }
+  float const *row(size_t t) const { return data_.data() + t * cols_; }
+
+  /// All scores, `rows() * cols()` of them.
+  float *data() { return data_.data(); }
+  float const *data() const { return data_.data(); }
+
+ private:
+  size_t rows_{0};
+  size_t cols_{0};
+  std::vector<float> data_;
+};
 
 /// Response holds AnnotatedText(s) of source-text and translated text,
 /// alignment information between source and target sub-words and sentences.
@@ -55,10 +102,18 @@ struct Response {
   /// source or target.
   std::vector<SentenceQualityScore> qualityScores;
 
+  /// Words of each translated sentence, as ranges of the subwords in target that make them up. A word starts at a
+  /// subword beginning with whitespace, the end-of-sentence token is left out. Always set, unlike the word ranges in
+  /// qualityScores which are the same but only there if requested.
+  std::vector<std::vector<SubwordRange>> targetWords;
+
   /// Alignments between source and target. This is a collection of dense matrices providing
-  ///    P[t][s] = p(source-token s  | target token t)
+  ///    P(t, s) = p(source-token s  | target token t)
   /// with an alignment matrix for each sentence.
-  std::vector<std::vector<std::vector<float>>> alignments;
+  std::vector<Alignment> alignments;
+
+  /// Where the time went while translating, by stage. Only set if requested through `ResponseOptions::timings`.
+  std::optional<StageTimings> timings;
 
   /// Returns the source sentence (in terms of byte range) corresponding to sentenceIdx.
   ///
@@ -77,6 +132,8 @@ struct Response {
 
 std::vector<Alignment> remapAlignments(const Response &first, const Response &second);
 
+/// Returns the byte ranges in `response.target` of the words of a translated sentence, without the whitespace before
+/// them. Uses the word index in `response.targetWords`, so it does not need quality scores.
 std::vector<ByteRange> getWordByteRanges(Response const &response, size_t sentenceIdx);
 
 }  // namespace bergamot
@@ -5,40 +5,45 @@
 namespace marian {
 namespace bergamot {
 
-void ResponseBuilder::buildQualityScores(Histories &histories, Response &response) {
-  qualityEstimator_.computeQualityScores(histories, response);
+void ResponseBuilder::buildQualityScores(const TranslatedSentences &sentences, Response &response) {
+  response.qualityScores.reserve(sentences.size());
+  for (auto &sentence : sentences) {
+    response.qualityScores.push_back(sentence->qualityScore);
+  }
 }
 
-void ResponseBuilder::buildAlignments(Histories &histories, Response &response) {
-  for (auto &history : histories) {
+void ResponseBuilder::buildAlignments(const TranslatedSentences &sentences, Response &response) {
+  response.alignments.reserve(sentences.size());
+  for (auto &sentence : sentences) {
     // TODO(jerin): Change hardcode of nBest = 1
-    NBestList onebest = history->nBest(1);
+    NBestList onebest = sentence->history->nBest(1);
 
     Result result = onebest[0];  // Expecting only one result;
-    Words words = std::get<0>(result);
     auto hyp = std::get<1>(result);
-    auto softAlignment = hyp->tracebackAlignment();
-    response.alignments.push_back(std::move(softAlignment));
+    response.alignments.emplace_back(hyp->tracebackAlignment());
   }
 }
 
-void ResponseBuilder::buildTranslatedText(Histories &histories, Response &response) {
+void ResponseBuilder::buildTranslatedText(const TranslatedSentences &sentences, Response &response) {
   // Reserving length at least as much as source_ seems like a reasonable
   // thing to do to avoid reallocations.
   response.target.text.reserve(response.source.text.size());
 
-  for (size_t sentenceIdx = 0; sentenceIdx < histories.size(); sentenceIdx++) {
-    // TODO(jerin): Change hardcode of nBest = 1
+  size_t numWords = 0;
+  for (auto &sentence : sentences) numWords += sentence->target.numWords(0);
+  response.target.reserve(sentences.size(), numWords);
+  response.targetWords.reserve(sentences.size());
 
-    auto &history = histories[sentenceIdx];
-    NBestList onebest = history->nBest(1);
+  for (size_t sentenceIdx = 0; sentenceIdx < sentences.size(); sentenceIdx++) {
+    // The worker already decoded the sentence, we only need to copy it over.
+    const AnnotatedText &decoded = sentences[sentenceIdx]->target;
+    response.targetWords.push_back(sentences[sentenceIdx]->words);
 
-    Result result = onebest[0];  // Expecting only one result;
-    Words words = std::get<0>(result);
-
-    std::string decoded;
     std::vector<string_view> targetSentenceMappings;
-    vocabs_.target()->decodeWithByteRanges(words, decoded, targetSentenceMappings, /*ignoreEOS=*/false);
+    targetSentenceMappings.reserve(decoded.numWords(0));
+    for (size_t wordIdx = 0; wordIdx < decoded.numWords(0); wordIdx++) {
+      targetSentenceMappings.push_back(decoded.word(0, wordIdx));
+    }
 
     switch (responseOptions_.concatStrategy) {
       case ConcatStrategy::FAITHFUL: {
@@ -50,7 +55,7 @@ void ResponseBuilder::buildTranslatedText(Histories &histories, Response &respon
         // If this is the last history to be decoded and translated-text
         // constructed, append the text till the end, which could be spaces or
         // empty.
-        if (sentenceIdx + 1 == histories.size()) {
+        if (sentenceIdx + 1 == sentences.size()) {
           response.target.appendEndingWhitespace(response.source.gap(sentenceIdx + 1));
         }
         break;
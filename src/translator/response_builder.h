@@ -5,10 +5,10 @@
 
 #include "data/types.h"
 #include "html.h"
-#include "quality_estimator.h"
 #include "response.h"
 #include "response_options.h"
-#include "vocabs.h"
+#include "timing.h"
+#include "translator/history.h"
 
 // For now we will work with this, to avoid complaints another structure is hard
 // to operate with.
@@ -16,6 +16,19 @@
 namespace marian {
 namespace bergamot {
 
+/// A translated sentence along with what can be derived from it regardless of
+/// the request it is part of: the decoded target sentence and its quality
+/// scores. These are made by the worker right after translating a batch (see
+/// `TranslationModel::translateBatch`), and are stored in the cache as a whole.
+struct TranslatedSentence {
+  Ptr<History> history;                         ///< Translation, used for alignments.
+  AnnotatedText target;                         ///< Decoded target, a single sentence with subword annotations.
+  std::vector<SubwordRange> words;              ///< Words of target as ranges of its subwords, see `mapWords`.
+  Response::SentenceQualityScore qualityScore;  ///< Quality scores of the words in target.
+};
+
+typedef std::vector<Ptr<TranslatedSentence const>> TranslatedSentences;
+
 /// ResponseBuilder is a callback functor. It is expected to be bound to a
 /// Request after giving it the context of options, vocabs and promise to set.
 /// It constructs the Response and it's members based on options
@@ -26,75 +39,74 @@ class ResponseBuilder {
  public:
   /// @param [in] responseOptions: ResponseOptions, indicating what to include
   /// or not in the response and any additional configurable parameters.
-  /// @param [in] vocabs: marian vocab object (used in decoding)
+  /// @param [in] source: Source text of the Request, which is moved into the Response.
   /// @param [in] callback: callback with operates on the constructed Response.
-  /// @param [in] qualityEstimator: the QualityEstimator model that can be used
-  /// to provide translation quality probability.
-  ResponseBuilder(ResponseOptions responseOptions, AnnotatedText &&source, const Vocabs &vocabs,
-                  std::function<void(Response &&)> callback, const QualityEstimator &qualityEstimator)
+  /// @param [in] timings: Timings of the Request so far, completed with the time it takes to build the Response and
+  /// moved into it. Only if `responseOptions.timings` is set.
+  ResponseBuilder(ResponseOptions responseOptions, AnnotatedText &&source, std::function<void(Response &&)> callback,
+                  Ptr<StageTimings> timings = nullptr)
       : responseOptions_(responseOptions),
         source_(std::move(source)),
-        vocabs_(vocabs),
         callback_(std::move(callback)),
-        qualityEstimator_(qualityEstimator) {}
+        timings_(std::move(timings)) {}
 
   /// Constructs and sets the promise of a Response object from obtained
-  /// histories after translating.
-  /// @param [in] histories: Histories obtained after translating the Request
-  /// from which this functor is called.
-  void operator()(Histories &&histories) {
+  /// translations.
+  /// @param [in] sentences: Translated sentences of the Request from which
+  /// this functor is called.
+  void operator()(TranslatedSentences &&sentences) {
     // TODO(jerinphilip) load ResponseOptions into options and turn build
     // functions on or off.
     // responseOptions_ is unused, but we can try something here.
-    ABORT_IF(source_.numSentences() != histories.size(), "Mismatch in source and translated sentences");
+    ABORT_IF(source_.numSentences() != sentences.size(), "Mismatch in source and translated sentences");
+    Stopwatch stopwatch;
     Response response;
 
     // Move source_ into response.
     response.source = std::move(source_);
 
     // Should be after source is set
-    buildTranslatedText(histories, response);
+    buildTranslatedText(sentences, response);
 
-    // Should always be after buildTranslatedText
     if (responseOptions_.qualityScores) {
-      buildQualityScores(histories, response);
+      buildQualityScores(sentences, response);
     }
 
     if (responseOptions_.alignment || responseOptions_.HTML) {
-      buildAlignments(histories, response);
+      buildAlignments(sentences, response);
+    }
+
+    if (timings_) {
+      (*timings_)[Stage::BUILD_RESPONSE] = stopwatch.lap();
+      response.timings = std::move(*timings_);
     }
 
     callback_(std::move(response));
   }
 
  private:
-  /// Builds qualityScores from histories and writes to response. expects
-  /// buildTranslatedText to be run before to be able to obtain target text and
-  /// subword information.
-  /// @param histories [in]
+  /// Copies the quality scores of the translated sentences to response.
+  /// @param sentences [in]
   /// @param response [out]
-  void buildQualityScores(Histories &histories, Response &response);
+  void buildQualityScores(const TranslatedSentences &sentences, Response &response);
 
   /// Builds alignments from histories and writes onto response.
-  /// @param histories [in]
+  /// @param sentences [in]
   /// @param response [out]
-  void buildAlignments(Histories &histories, Response &response);
+  void buildAlignments(const TranslatedSentences &sentences, Response &response);
 
   /// Builds translated text and subword annotations and writes onto response.
-  /// @param histories [in]
+  /// @param sentences [in]
   /// @param response [out]
-  void buildTranslatedText(Histories &histories, Response &response);
+  void buildTranslatedText(const TranslatedSentences &sentences, Response &response);
 
   // Data members are context/curried args for the functor.
 
   ResponseOptions responseOptions_;
-  const Vocabs &vocabs_;                       // vocabs are required for decoding
-                                               // and any source validation checks.
   std::function<void(Response &&)> callback_;  //  To be set when callback triggered and
                                                //  after Response constructed.
   AnnotatedText source_;
-
-  const QualityEstimator &qualityEstimator_;
+  Ptr<StageTimings> timings_;  ///< Shared with the Request, which fills in the stages before this one.
 };
 }  // namespace bergamot
 }  // namespace marian
@@ -27,6 +27,10 @@ struct ResponseOptions {
   bool sentenceMappings{false};
 
   ConcatStrategy concatStrategy{ConcatStrategy::FAITHFUL};
+
+  /// Whether to include a breakdown of the time spent in each stage of the request, see `Response::timings`. Requires
+  /// a build with ENABLE_STAGE_TIMING.
+  bool timings{false};
 };
 
 }  // namespace bergamot
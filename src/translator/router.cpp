@@ -0,0 +1,78 @@
+#include "router.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+#include "common/logging.h"
+
+namespace marian::bergamot {
+
+void Router::add(const std::string &source, const std::string &target, Ptr<TranslationModel> model, float cost) {
+  ABORT_IF(cost < 0.0f, "Cost of a model from {} to {} must not be negative", source, target);
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<Edge> &edges = edges_[source];
+  auto existing =
+      std::find_if(edges.begin(), edges.end(), [&target](const Edge &edge) { return edge.target == target; });
+  if (existing != edges.end()) {
+    existing->model = std::move(model);
+    existing->cost = cost;
+  } else {
+    edges.push_back(Edge{target, std::move(model), cost});
+  }
+}
+
+std::vector<Ptr<TranslationModel>> Router::route(const std::string &source, const std::string &target) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  // Dijkstra from source. For every language reached, keep the cheapest cost and the edge it was reached through.
+  struct Reached {
+    float cost;
+    std::string previous;
+    const Edge *edge;
+  };
+  std::map<std::string, Reached> reached{{source, Reached{0.0f, std::string(), nullptr}}};
+
+  typedef std::pair<float, std::string> Entry;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+  queue.emplace(0.0f, source);
+
+  while (!queue.empty()) {
+    auto [cost, language] = queue.top();
+    queue.pop();
+    if (language == target) break;
+    if (cost > reached[language].cost) continue;  // Stale entry, language was reached cheaper since.
+
+    auto outgoing = edges_.find(language);
+    if (outgoing == edges_.end()) continue;
+    for (const Edge &edge : outgoing->second) {
+      float next = cost + edge.cost;
+      auto known = reached.find(edge.target);
+      if (known == reached.end() || next < known->second.cost) {
+        reached[edge.target] = Reached{next, language, &edge};
+        queue.emplace(next, edge.target);
+      }
+    }
+  }
+
+  std::vector<Ptr<TranslationModel>> models;
+  auto found = reached.find(target);
+  if (source == target || found == reached.end()) return models;
+
+  for (const Reached *step = &found->second; step->edge != nullptr; step = &reached[step->previous]) {
+    models.push_back(step->edge->model);
+  }
+  std::reverse(models.begin(), models.end());
+  return models;
+}
+
+void Router::translate(const std::string &source, const std::string &target, std::string &&text,
+                       ChainCallback callback, const ResponseOptions &options) {
+  std::vector<Ptr<TranslationModel>> models = route(source, target);
+  ABORT_IF(models.empty(), "No route from {} to {}", source, target);
+  service_.translateChain(models, std::move(text), std::move(callback), options);
+}
+
+}  // namespace marian::bergamot
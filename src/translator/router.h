@@ -0,0 +1,55 @@
+#ifndef SRC_BERGAMOT_ROUTER_H_
+#define SRC_BERGAMOT_ROUTER_H_
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "data/types.h"
+#include "response_options.h"
+#include "service.h"
+#include "translation_model.h"
+
+namespace marian::bergamot {
+
+/// Translates between any two languages that are connected through the TranslationModels added to it, e.g. xx→yy
+/// through English with only xx→en and en→yy models available.
+///
+/// The languages and models form a graph with a directed edge per model. A translation takes the path with the lowest
+/// total cost, where the cost of a model defaults to 1 so that the path with the fewest legs wins. The models along
+/// that path are chained with AsyncService::translateChain, which pipelines the legs sentence by sentence and uses the
+/// cache of the service for all of them.
+class Router {
+ public:
+  explicit Router(AsyncService &service) : service_(service) {}
+
+  /// Registers a model that translates from language `source` to language `target`. Languages are opaque strings, and
+  /// only need to be consistent across the calls to add(). Adding a second model for the same pair replaces the first.
+  void add(const std::string &source, const std::string &target, Ptr<TranslationModel> model, float cost = 1.0f);
+
+  /// Returns the models on the cheapest path from `source` to `target`, in order, or an empty vector if there is no
+  /// such path (or if source and target are the same language).
+  std::vector<Ptr<TranslationModel>> route(const std::string &source, const std::string &target) const;
+
+  /// Translates `text` from `source` to `target` along the path returned by route(). See
+  /// AsyncService::translateChain for the callback and options.
+  void translate(const std::string &source, const std::string &target, std::string &&text, ChainCallback callback,
+                 const ResponseOptions &options = ResponseOptions());
+
+ private:
+  struct Edge {
+    std::string target;
+    Ptr<TranslationModel> model;
+    float cost;
+  };
+
+  AsyncService &service_;
+
+  mutable std::mutex mutex_;
+  std::map<std::string, std::vector<Edge>> edges_;  ///< Outgoing edges, by source language.
+};
+
+}  // namespace marian::bergamot
+
+#endif  // SRC_BERGAMOT_ROUTER_H_
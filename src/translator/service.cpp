@@ -1,5 +1,7 @@
 #include "service.h"
 
+#include <chrono>
+#include <mutex>
 #include <string>
 #include <utility>
 
@@ -25,6 +27,7 @@ Response combine(Response &&first, Response &&second) {
 
   combined.source = std::move(first.source);
   combined.target = std::move(second.target);
+  combined.targetWords = std::move(second.targetWords);
   combined.qualityScores = std::move(second.qualityScores);
 
   return combined;
@@ -34,8 +37,146 @@ std::optional<TranslationCache> makeOptionalCache(size_t size, size_t mutexBucke
   return size > 0 ? std::make_optional<TranslationCache>(size, mutexBuckets) : std::nullopt;
 }
 
+std::optional<ResponseCache> makeOptionalResponseCache(size_t size, size_t mutexBuckets) {
+  return size > 0 ? std::make_optional<ResponseCache>(size, mutexBuckets) : std::nullopt;
+}
+
+size_t hashForResponseCache(const TranslationModel &model, const std::string &source, const ResponseOptions &options) {
+  size_t seed = model.modelId();
+  util::hash_combine<size_t>(seed, std::hash<std::string>()(source));
+  size_t flags = (options.qualityScores << 0) | (options.alignment << 1) | (options.HTML << 2) |
+                 (options.sentenceMappings << 3) | (static_cast<size_t>(options.concatStrategy) << 4);
+  util::hash_combine<size_t>(seed, flags);
+  return seed;
+}
+
 }  // namespace
 
+/// Joins the legs of a chain of translations that is pipelined sentence by sentence: every sentence a model completes
+/// is translated by the next model in the chain right away, while the earlier models continue with the rest of the
+/// text. Once the Response of the first model and the translations of all its sentences by each of the other models
+/// are in, these are put together into the final Response, by whichever thread delivers the last part.
+class ChainJoin {
+ public:
+  ChainJoin(const std::vector<Ptr<TranslationModel>> &models, size_t requestId, const ResponseOptions &responseOptions,
+            Ptr<HTML> html, ChainCallback callback)
+      : models_(models),
+        requestId_(requestId),
+        responseOptions_(responseOptions),
+        html_(std::move(html)),
+        callback_(std::move(callback)),
+        start_(std::chrono::steady_clock::now()),
+        completed_(models.size(), start_),
+        legs_(models.size()) {
+    for (size_t leg = 1; leg < models_.size(); leg++) {
+      reuseWords_.push_back(models_[leg]->acceptsOutputOf(*models_[leg - 1]));
+    }
+  }
+
+  const std::vector<Ptr<TranslationModel>> &models() const { return models_; }
+
+  /// Identifier shared by the single-sentence requests of all legs after the first.
+  size_t requestId() const { return requestId_; }
+
+  /// Whether the model of `leg` takes the words output by the model of the previous leg as they are.
+  bool reuseWords(size_t leg) const { return reuseWords_[leg - 1]; }
+
+  /// Called with the Response of the first model.
+  void completeFirst(Response &&response) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      first_ = std::move(response);
+      completed_[0] = std::chrono::steady_clock::now();
+      if (!complete()) return;
+    }
+    finish();
+  }
+
+  /// Called with the translation of sentence `index` by the model of `leg` (> 0), and the ranges of the tokens that
+  /// model split its input sentence into, relative to the start of the sentence.
+  void complete(size_t leg, size_t index, Ptr<TranslatedSentence const> translation,
+                std::vector<ByteRange> &&wordRanges) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      Leg &state = legs_[leg];
+      if (index >= state.translations.size()) {
+        state.translations.resize(index + 1);
+        state.wordRanges.resize(index + 1);
+      }
+      state.translations[index] = std::move(translation);
+      state.wordRanges[index] = std::move(wordRanges);
+      ++state.numTranslated;
+      completed_[leg] = std::chrono::steady_clock::now();
+      if (!complete()) return;
+    }
+    finish();
+  }
+
+ private:
+  struct Leg {
+    TranslatedSentences translations;                 ///< Translations of the sentences by the model of this leg.
+    std::vector<std::vector<ByteRange>> wordRanges;  ///< Tokens of the input sentences for the model of this leg.
+    size_t numTranslated{0};
+  };
+
+  bool complete() const {
+    if (!first_) return false;
+    for (size_t leg = 1; leg < legs_.size(); leg++) {
+      if (legs_[leg].numTranslated != first_->source.numSentences()) return false;
+    }
+    return true;
+  }
+
+  void finish() {
+    Response combined = std::move(*first_);
+
+    for (size_t leg = 1; leg < legs_.size(); leg++) {
+      Leg &state = legs_[leg];
+
+      // The input of this leg as its model sees it: the text output by the previous leg, split into its tokens. The
+      // text is moved rather than copied, combine only needs the byte ranges left behind in combined.target.
+      AnnotatedText input(std::move(combined.target.text));
+      std::vector<string_view> tokens;
+      for (size_t s = 0; s < state.wordRanges.size(); s++) {
+        const char *sentence = input.text.data() + combined.target.sentenceAsByteRange(s).begin;
+        tokens.clear();
+        for (auto &range : state.wordRanges[s]) {
+          tokens.emplace_back(sentence + range.begin, range.size());
+        }
+        input.recordExistingSentence(tokens.begin(), tokens.end(), tokens.begin()->data());
+      }
+
+      Response response;
+      ResponseBuilder responseBuilder(responseOptions_, std::move(input),
+                                      [&response](Response &&built) { response = std::move(built); });
+      responseBuilder(std::move(state.translations));
+
+      combined = combine(std::move(combined), std::move(response));
+    }
+
+    html_->restore(combined);
+
+    LegTimings timings;
+    for (auto &completed : completed_) {
+      timings.push_back(completed - start_);
+    }
+    callback_(std::move(combined), std::move(timings));
+  }
+
+  std::vector<Ptr<TranslationModel>> models_;
+  std::vector<bool> reuseWords_;
+  size_t requestId_;
+  ResponseOptions responseOptions_;
+  Ptr<HTML> html_;
+  ChainCallback callback_;
+
+  std::mutex mutex_;
+  std::chrono::steady_clock::time_point start_;
+  std::vector<std::chrono::steady_clock::time_point> completed_;  ///< When each leg last completed a sentence.
+  std::optional<Response> first_;
+  std::vector<Leg> legs_;  ///< State of the legs after the first, indexed by leg.
+};
+
 BlockingService::BlockingService(const BlockingService::Config &config)
     : config_(config),
       requestId_(0),
@@ -60,14 +201,30 @@ std::vector<Response> BlockingService::translateMultiple(std::shared_ptr<Transla
 
 std::vector<Response> BlockingService::translateMultipleRaw(std::shared_ptr<TranslationModel> translationModel,
                                                             std::vector<std::string> &&sources,
-                                                            const std::vector<ResponseOptions> &responseOptions) {
+                                                            const std::vector<ResponseOptions> &responseOptions,
+                                                            std::vector<TranslatedSentences> *translations) {
   std::vector<Response> responses;
   responses.resize(sources.size());
 
+  if (translations) {
+    translations->resize(sources.size());
+  }
+
   for (size_t i = 0; i < sources.size(); i++) {
     auto callback = [i, &responses](Response &&response) { responses[i] = std::move(response); };  //
-    Ptr<Request> request =
-        translationModel->makeRequest(requestId_++, std::move(sources[i]), callback, responseOptions[i], cache_);
+
+    SentenceCallback sentenceCallback = nullptr;
+    if (translations) {
+      sentenceCallback = [&sentences = (*translations)[i]](size_t index, Ptr<TranslatedSentence const> translation) {
+        if (index >= sentences.size()) {
+          sentences.resize(index + 1);
+        }
+        sentences[index] = std::move(translation);
+      };
+    }
+
+    Ptr<Request> request = translationModel->makeRequest(requestId_++, std::move(sources[i]), callback,
+                                                         responseOptions[i], cache_, sentenceCallback);
     batchingPool_.enqueueRequest(translationModel, request);
   }
 
@@ -89,9 +246,14 @@ std::vector<Response> BlockingService::pivotMultiple(std::shared_ptr<Translation
     htmls.emplace_back(std::move(sources[i]), responseOptions[i].HTML);
   }
 
+  // If second takes the words first outputs as they are, we keep those to skip tokenizing the pivot text again.
+  bool reuseWords = second->acceptsOutputOf(*first);
+  std::vector<TranslatedSentences> pivotTranslations;
+
   // Translate source to pivots. This is same as calling translateMultiple.
   std::vector<Response> sourcesToPivots;
-  sourcesToPivots = translateMultipleRaw(first, std::move(sources), responseOptions);
+  sourcesToPivots =
+      translateMultipleRaw(first, std::move(sources), responseOptions, reuseWords ? &pivotTranslations : nullptr);
 
   // Translate pivots to targets, after we have outputs at pivot from first round. We cannot use translateMultiple here
   // because need consistency at pivot on both sides.
@@ -104,8 +266,8 @@ std::vector<Response> BlockingService::pivotMultiple(std::shared_ptr<Translation
                                     // it in allows further use in makePivotRequest
     auto callback = [i, &pivotsToTargets](Response &&response) { pivotsToTargets[i] = std::move(response); };  //
 
-    Ptr<Request> request =
-        second->makePivotRequest(requestId_++, std::move(intermediate), callback, responseOptions[i], cache_);
+    Ptr<Request> request = second->makePivotRequest(requestId_++, std::move(intermediate), callback, responseOptions[i],
+                                                    cache_, reuseWords ? &pivotTranslations[i] : nullptr);
     batchingPool_.enqueueRequest(second, request);
   }
 
@@ -134,7 +296,10 @@ AsyncService::AsyncService(const AsyncService::Config &config)
       config_(config),
       safeBatchingPool_(),
       cache_(makeOptionalCache(config_.cacheSize, /*mutexBuckets=*/config_.numWorkers)),
-      logger_(config.logger) {
+      logger_(config.logger),
+      responseCache_(makeOptionalResponseCache(config_.responseCacheSize, /*mutexBuckets=*/config_.numWorkers)),
+      started_(Clock::now()),
+      workerCounters_(config_.numWorkers) {
   ABORT_IF(config_.numWorkers == 0, "Number of workers should be at least 1 in a threaded workflow");
   workers_.reserve(config_.numWorkers);
   for (size_t cpuId = 0; cpuId < config_.numWorkers; cpuId++) {
@@ -143,13 +308,30 @@ AsyncService::AsyncService(const AsyncService::Config &config)
       // shutdown, which happens in the destructor for this class.
       Batch batch;
       Ptr<TranslationModel> translationModel{nullptr};
+      WorkerCounters &counters = workerCounters_[cpuId];
+      Clock::time_point idleSince = Clock::now();
       while (safeBatchingPool_.generateBatch(translationModel, batch)) {
+        Clock::time_point busySince = Clock::now();
+        counters.startBatch(busySince - idleSince);
         translationModel->translateBatch(cpuId, batch);
+        idleSince = Clock::now();
+        counters.finishBatch(idleSince - busySince);
       }
     });
   }
 }
 
+ServiceMetrics AsyncService::metrics() const {
+  ServiceMetrics metrics;
+  metrics.uptimeSeconds = std::chrono::duration<double>(Clock::now() - started_).count();
+  metrics.translateCalls = translateCalls_.load(std::memory_order_relaxed);
+  metrics.batching = safeBatchingPool_.metrics();
+  for (auto &counters : workerCounters_) {
+    metrics.workers.push_back(counters.snapshot());
+  }
+  return metrics;
+}
+
 void AsyncService::clear() { safeBatchingPool_.clear(); }
 
 AsyncService::~AsyncService() {
@@ -163,48 +345,107 @@ AsyncService::~AsyncService() {
 
 void AsyncService::pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second,
                          std::string &&source, CallbackType clientCallback, const ResponseOptions &responseOptions) {
-  Ptr<HTML> html = std::make_shared<HTML>(std::move(source), responseOptions.HTML);
-  // This is callback chaining or CPS due to async.
-
-  // We create a callback which feeds the result of first into a second translation (internalCallback), which is
-  // supplied with a callback (joiningCallback) which merges both results and creates our final response.
-  //
+  translateChain({first, second}, std::move(source),
+                 [clientCallback](Response &&response, LegTimings &&) { clientCallback(std::move(response)); },
+                 responseOptions);
+}
 
-  auto internalCallback = [this, clientCallback, second, responseOptions, html](Response &&sourceToPivot) {
-    // We cannot eliminate the following copy, as we need two versions of intermediate. Holding
-    // it in a copy allows moving the response into the lambda below.
+void AsyncService::translateChain(const std::vector<Ptr<TranslationModel>> &models, std::string &&source,
+                                  ChainCallback callback, const ResponseOptions &responseOptions) {
+  ABORT_IF(models.empty(), "Translating requires at least one model");
+  translateCalls_.fetch_add(1, std::memory_order_relaxed);
+  Ptr<HTML> html = std::make_shared<HTML>(std::move(source), responseOptions.HTML);
 
-    AnnotatedText intermediate = sourceToPivot.target;
+  // Rather than waiting for the complete Response of a model, each sentence is handed to the next model as soon as it
+  // is translated, so that all models in the chain keep the workers busy. ChainJoin puts the Responses together when
+  // all legs are done. The single sentence requests of the later legs share an identifier, which is taken here because
+  // the callbacks that create them run on worker threads.
+  size_t chainRequestId = requestId_++;
+  auto join = std::make_shared<ChainJoin>(models, chainRequestId, responseOptions, html, std::move(callback));
+
+  SentenceCallback sentenceCallback = nullptr;
+  if (models.size() > 1) {
+    sentenceCallback = [this, join](size_t index, Ptr<TranslatedSentence const> translation) {
+      continueChain(join, /*leg=*/1, index, std::move(translation));
+    };
+  }
 
-    // https://stackoverflow.com/a/65606554/4565794
-    // Move semantics only work on mutable lambdas, and can only be done once. It's only once in our case, so issok.
-    auto joiningCallback = [this, sourceToPivot = std::move(sourceToPivot), clientCallback,
-                            html](Response &&pivotToTarget) mutable {
-      // We have both Responses at this callback, sourceToPivot is moved in, second half will be available when
-      // complete.
-      Response finalResponse = combine(std::move(sourceToPivot), std::move(pivotToTarget));
+  auto internalCallback = [join](Response &&response) { join->completeFirst(std::move(response)); };
 
-      // Sentences should be consistent now, give way to client.
-      html->restore(finalResponse);
-      clientCallback(std::move(finalResponse));
-    };
+  // First call.
+  Ptr<Request> request = models.front()->makeRequest(requestId_++, std::move(source), internalCallback,
+                                                     responseOptions, cache_, sentenceCallback);
+  safeBatchingPool_.enqueueRequest(models.front(), request);
+}
 
-    // Second call.
-    Ptr<Request> request =
-        second->makePivotRequest(requestId_++, std::move(intermediate), joiningCallback, responseOptions, cache_);
-    safeBatchingPool_.enqueueRequest(second, request);
+void AsyncService::continueChain(Ptr<ChainJoin> join, size_t leg, size_t index,
+                                 Ptr<TranslatedSentence const> previous) {
+  auto callback = [this, join, leg, index](Ptr<TranslatedSentence const> translation,
+                                           std::vector<ByteRange> &&wordRanges) {
+    if (leg + 1 < join->models().size()) {
+      continueChain(join, leg + 1, index, translation);
+    }
+    join->complete(leg, index, std::move(translation), std::move(wordRanges));
   };
 
-  // First call.
-  translateRaw(first, std::move(source), internalCallback, responseOptions);
+  const Ptr<TranslationModel> &model = join->models()[leg];
+  Ptr<Request> request =
+      model->makePivotSentenceRequest(join->requestId(), previous, join->reuseWords(leg), callback, cache_);
+  safeBatchingPool_.enqueueRequest(model, request);
 }
 
 void AsyncService::translate(std::shared_ptr<TranslationModel> translationModel, std::string &&source,
                              CallbackType callback, const ResponseOptions &responseOptions) {
   // Producer thread, a call to this function adds new work items. If batches are available, notifies workers waiting.
+  translateCalls_.fetch_add(1, std::memory_order_relaxed);
+
+  // Before any processing, see whether the very same request was answered recently.
+  if (responseCache_ && !responseOptions.timings) {
+    size_t key = hashForResponseCache(*translationModel, source, responseOptions);
+    auto entry = New<CachedResponse>();
+    entry->modelId = translationModel->modelId();
+    entry->sourceHash = CachedResponse::hashSource(source);
+    entry->sourceSize = source.size();
+    entry->stored = std::chrono::steady_clock::now();
+
+    // Records of the cache start out with a null value, which a key of 0 would find.
+    auto [found, cached] = responseCache_->find(key);
+    if (found && cached && cached->matches(*entry, config_.responseCacheTTL)) {
+      Response response = *cached->response;
+      if (cached->sourceFromRequest) response.source.text = std::move(source);
+      callback(std::move(response));
+      return;
+    }
+
+    callback = [this, key, entry, clientCallback = std::move(callback)](Response &&response) {
+      // The client gets this Response, so the cache needs a copy. Leave the source text out of it if that is the
+      // request's own source, which is usually the case.
+      std::string sourceText = std::move(response.source.text);
+      auto copy = New<Response>(response);
+      response.source.text = std::move(sourceText);
+      entry->sourceFromRequest = entry->isSource(response.source.text);
+      if (!entry->sourceFromRequest) copy->source.text = response.source.text;
+
+      entry->stored = std::chrono::steady_clock::now();
+      entry->response = copy;
+      responseCache_->store(key, entry);
+      clientCallback(std::move(response));
+    };
+  }
+
+  Stopwatch stopwatch;
   Ptr<HTML> html = std::make_shared<HTML>(std::move(source), responseOptions.HTML);
-  auto internalCallback = [html, callback](Response &&response) {
+  double htmlParse = stopwatch.lap();
+
+  auto internalCallback = [this, html, htmlParse, callback](Response &&response) {
+    Stopwatch stopwatch;
     html->restore(response);
+    if (response.timings) {
+      StageTimings &timings = *response.timings;
+      timings[Stage::HTML_PARSE] = htmlParse;
+      timings[Stage::HTML_RESTORE] = stopwatch.lap();
+      stageHistograms_.record(timings);
+    }
     callback(std::move(response));
   };
 
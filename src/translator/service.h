@@ -1,6 +1,8 @@
 #ifndef SRC_BERGAMOT_SERVICE_H_
 #define SRC_BERGAMOT_SERVICE_H_
 
+#include <chrono>
+#include <functional>
 #include <queue>
 #include <thread>
 #include <vector>
@@ -8,11 +10,13 @@
 #include "cache.h"
 #include "data/types.h"
 #include "logging.h"
+#include "metrics.h"
 #include "quality_estimator.h"
 #include "response.h"
 #include "response_builder.h"
 #include "text_processor.h"
 #include "threadsafe_batching_pool.h"
+#include "timing.h"
 #include "translation_model.h"
 #include "translator/parser.h"
 #include "vocabs.h"
@@ -22,6 +26,14 @@ namespace bergamot {
 
 class BlockingService;
 class AsyncService;
+class ChainJoin;
+
+/// Time from the call until each leg of a chain of translations completed, indexed by leg. Legs overlap, as every
+/// sentence is handed to the next model as soon as it is translated, so these do not add up to the total.
+typedef std::vector<std::chrono::duration<double>> LegTimings;
+
+/// Callback for AsyncService::translateChain, called with the final Response and the timings of the legs.
+typedef std::function<void(Response &&, LegTimings &&)> ChainCallback;
 
 /// See AsyncService.
 ///
@@ -83,9 +95,12 @@ class BlockingService {
   TranslationCache::Stats cacheStats() { return cache_ ? cache_->stats() : TranslationCache::Stats(); }
 
  private:
+  /// Translates without HTML processing. If `translations` is given, the translated sentences of each source are
+  /// collected in it as well.
   std::vector<Response> translateMultipleRaw(std::shared_ptr<TranslationModel> translationModel,
                                              std::vector<std::string> &&source,
-                                             const std::vector<ResponseOptions> &responseOptions);
+                                             const std::vector<ResponseOptions> &responseOptions,
+                                             std::vector<TranslatedSentences> *translations = nullptr);
 
   ///  Numbering requests processed through this instance. Used to keep account of arrival times of the request. This
   ///  allows for using this quantity in priority based ordering.
@@ -113,10 +128,17 @@ class AsyncService {
                             /// cache in the real world. A value of 0 means no caching.
     Logger::Config logger;  // Configurations for logging
 
+    /// Number of whole Responses to keep, so that a request repeating the source text, ResponseOptions and model of an
+    /// earlier one is answered without any processing. A value of 0 means no caching.
+    size_t responseCacheSize{0};
+    double responseCacheTTL{0.0};  ///< Seconds a cached Response is used for. A value of 0 means no expiry.
+
     template <class App>
     static void addOptions(App &app, Config &config) {
       app.add_option("--cpu-threads", config.numWorkers, "Workers to form translation backend");
       app.add_option("--cache-size", config.cacheSize, "Number of entries to store in cache.");
+      app.add_option("--response-cache-size", config.responseCacheSize, "Number of whole responses to cache.");
+      app.add_option("--response-cache-ttl", config.responseCacheTTL, "Seconds to keep cached responses, 0 for ever.");
       Logger::Config::addOptions(app, config.logger);
     }
   };
@@ -133,7 +155,9 @@ class AsyncService {
 
   /// With the supplied TranslationModel, translate an input. A Response is constructed with optional items set/unset
   /// indicated via ResponseOptions. Upon completion translation of the input, the client supplied callback is
-  /// triggered with the constructed Response. Concurrent-calls to this function are safe.
+  /// triggered with the constructed Response. Concurrent-calls to this function are safe. With a response cache (see
+  /// Config::responseCacheSize), a repeated request is answered with a copy of the earlier Response before this
+  /// returns. Requests for timings are never answered from that cache.
   ///
   /// @param [in] translationModel: TranslationModel to use for the request.
   /// @param [in] source: rvalue reference of the string to be translated. This is available as-is to the client later
@@ -155,9 +179,25 @@ class AsyncService {
   /// consume the Response.
   /// @param[in] options: Options indicating whether or not to include optional members in response and pass additional
   /// configurations. See ResponseOptions.
+  ///
+  /// Each sentence is queued for translation by the second model as soon as the first model has translated it, so the
+  /// two translations overlap rather than run one after the other.
   void pivot(std::shared_ptr<TranslationModel> first, std::shared_ptr<TranslationModel> second, std::string &&source,
              CallbackType clientCallback, const ResponseOptions &options = ResponseOptions());
 
+  /// Generalization of pivot() to any number of models: translates source with the first model, its output with the
+  /// second one and so on, generating a response as if it were translated from the source language of the first model
+  /// to the target language of the last one. Alignments are remapped through every intermediate language.
+  ///
+  /// @param[in] models: TranslationModels to translate with, in order. The target language of each model must be the
+  /// source language of the next one.
+  /// @param[move] source: The source text to be translated
+  /// @param[in] callback: The callback to be called with the constructed Response and the timings of the legs.
+  /// @param[in] options: Options indicating whether or not to include optional members in response and pass additional
+  /// configurations. See ResponseOptions.
+  void translateChain(const std::vector<Ptr<TranslationModel>> &models, std::string &&source, ChainCallback callback,
+                      const ResponseOptions &options = ResponseOptions());
+
   /// Clears all pending requests.
   void clear();
 
@@ -167,10 +207,21 @@ class AsyncService {
 
   TranslationCache::Stats cacheStats() { return cache_ ? cache_->stats() : TranslationCache::Stats(); }
 
+  /// Writes the distribution of the time spent in each stage over all requests made through translate() with
+  /// `ResponseOptions::timings` set so far. See StageHistograms::dump.
+  void dumpStageHistograms(std::ostream &out) const { stageHistograms_.dump(out); }
+
+  /// Snapshot of the queue, batches and workers of this service, read without locking. For the queue and batches of a
+  /// single model, see TranslationModel::batchingMetrics(). Safe to call from any thread.
+  ServiceMetrics metrics() const;
+
  private:
   void translateRaw(std::shared_ptr<TranslationModel> translationModel, std::string &&source, CallbackType callback,
                     const ResponseOptions &options = ResponseOptions());
 
+  /// Queues the translation of sentence `index`, as translated by the previous leg, by the model of `leg` in the chain.
+  void continueChain(Ptr<ChainJoin> join, size_t leg, size_t index, Ptr<TranslatedSentence const> previous);
+
   AsyncService::Config config_;
 
   std::vector<std::thread> workers_;
@@ -190,6 +241,15 @@ class AsyncService {
   // Logger which shuts down cleanly with service.
   Logger logger_;
   std::optional<TranslationCache> cache_;
+  std::optional<ResponseCache> responseCache_;  ///< If Config::responseCacheSize is set.
+
+  /// Stage times of the requests that asked for them, see dumpStageHistograms().
+  StageHistograms stageHistograms_;
+
+  /// Counters for metrics().
+  Clock::time_point started_;
+  std::atomic<uint64_t> translateCalls_{0};
+  std::vector<WorkerCounters> workerCounters_;  ///< One per worker, written only by that worker.
 };
 
 }  // namespace bergamot
@@ -1,12 +1,19 @@
 #include "text_processor.h"
 
+#include <algorithm>
 #include <vector>
 
+#ifndef WASM_COMPATIBLE_SOURCE
+#include <future>
+#include <thread>
+#endif
+
 #include "annotation.h"
 #include "common/cli_helper.h"
 #include "common/options.h"
 #include "data/types.h"
 #include "definitions.h"
+#include "parallel_split.h"
 
 namespace marian {
 namespace bergamot {
@@ -50,11 +57,25 @@ ug::ssplit::SentenceSplitter loadSplitter(const AlignedMemory &memory) {
   return splitter;
 }
 
+/// Parts of an input processed in parallel are at least this large, as a thread per part has to pay off.
+constexpr size_t kMinChunkBytes = 1 << 16;
+
+/// Tokenization happens on the threads calling translate(), and on those splitting a large input. This many locks
+/// keep them from waiting on each other, while costing little memory.
+constexpr size_t kTokenizationCacheMutexBuckets = 64;
+
 }  // namespace
 
 Segment TextProcessor::tokenize(const string_view &segment, std::vector<string_view> &wordRanges) const {
-  // vocabs_->sources().front() is invoked as we currently only support one source vocab
-  return vocabs_.sources().front()->encodeWithByteRanges(segment, wordRanges, /*addEOS=*/false, /*inference=*/true);
+  auto encode = [this](const string_view &sentence, std::vector<string_view> &ranges) {
+    // vocabs_->sources().front() is invoked as we currently only support one source vocab
+    return vocabs_.sources().front()->encodeWithByteRanges(sentence, ranges, /*addEOS=*/false, /*inference=*/true);
+  };
+
+  if (!tokenizationCache_) {
+    return encode(segment, wordRanges);
+  }
+  return tokenizeThroughCache(*tokenizationCache_, segment, wordRanges, encode);
 }
 
 TextProcessor::TextProcessor(Ptr<Options> options, const Vocabs &vocabs, const std::string &ssplit_prefix_file)
@@ -82,16 +103,102 @@ TextProcessor::TextProcessor(Ptr<Options> options, const Vocabs &vocabs, const A
 void TextProcessor::parseCommonOptions(Ptr<Options> options) {
   maxLengthBreak_ = options->get<size_t>("max-length-break");
   ssplitMode_ = string2splitmode(options->get<std::string>("ssplit-mode"));
+  wrapMode_ = parseWrapMode(options->get<std::string>("wrap-mode", "fixed"));
+
+  size_t tokenizationCacheSize = options->get<size_t>("tokenization-cache-size", 0);
+  if (tokenizationCacheSize > 0) {
+    tokenizationCache_.emplace(tokenizationCacheSize, kTokenizationCacheMutexBuckets);
+  }
+#ifdef WASM_COMPATIBLE_SOURCE
+  parallelBytes_ = 0;  // No threads to spare.
+#else
+  // Off unless asked for, with the same default as the option in parser.cpp.
+  parallelBytes_ = options->get<size_t>("ssplit-parallel-bytes", 0);
+#endif
 }
 
-void TextProcessor::process(std::string &&input, AnnotatedText &source, Segments &segments) const {
+void TextProcessor::process(std::string &&input, AnnotatedText &source, Segments &segments,
+                            StageTimings *timings) const {
   source = std::move(AnnotatedText(std::move(input)));
   std::string_view input_converted(source.text.data(), source.text.size());
-  auto sentenceStream = ug::ssplit::SentenceStream(input_converted, ssplit_, ssplitMode_);
+
+  Stopwatch stopwatch;
+  bool timed = timings != nullptr;
+  std::vector<std::string_view> chunks{input_converted};
+  std::vector<TokenizedChunk> tokenized(1);
+
+#ifndef WASM_COMPATIBLE_SOURCE
+  // A large input is cut into a chunk for this thread and one for each helper thread that is free, if any.
+  HelperThreads::Slots helpers;
+  if (parallelBytes_ > 0 && input_converted.size() >= parallelBytes_) {
+    size_t wanted = std::min<size_t>(std::thread::hardware_concurrency(), input_converted.size() / kMinChunkBytes);
+    helpers = HelperThreads::global().acquire(wanted > 1 ? wanted - 1 : 0);
+    chunks = cutAtParagraphs(input_converted, helpers.size() + 1);
+    tokenized.resize(chunks.size());
+  }
+
+  std::vector<std::future<TokenizedChunk>> pending;
+  for (size_t i = 1; i < chunks.size(); i++) {
+    pending.push_back(
+        std::async(std::launch::async, [this, chunk = chunks[i], timed] { return splitAndTokenize(chunk, timed); }));
+  }
+  tokenized.front() = splitAndTokenize(chunks.front(), timed);
+  for (size_t i = 1; i < chunks.size(); i++) {
+    tokenized[i] = pending[i - 1].get();
+  }
+#else
+  tokenized.front() = splitAndTokenize(chunks.front(), timed);
+#endif
+
+  double elapsed = stopwatch.lap();
+
+  // Word ranges point into source.text already, so the chunks need no offsets fixed up when stitched together. Wrap
+  // segments into sentences of at most maxLengthBreak_ tokens and tell source about them, in order. Both wrap modes cut
+  // a segment into the same number of pieces, so the room the annotation needs is known before wrapping.
+  size_t wrapStep = maxLengthBreak_ - 1;
+  size_t numPieces = 0, numWords = 0;
+  for (auto &chunk : tokenized) {
+    for (auto &segment : chunk.segments) {
+      size_t pieces = (segment.size() + wrapStep - 1) / wrapStep;
+      numPieces += pieces;
+      numWords += segment.size() + pieces;  // Every piece gets an EOS.
+    }
+  }
+  source.reserve(numPieces, numWords);
+  segments.reserve(segments.size() + numPieces);
+
+  for (auto &chunk : tokenized) {
+    for (size_t i = 0; i < chunk.segments.size(); i++) {
+      wrap(chunk.segments[i], chunk.wordRanges[i], segments, source);
+    }
+  }
+
+  if (timings) {
+    // Chunks processed in parallel overlap in time, so the time taken is divided up between splitting and tokenizing
+    // in proportion to the time they took over all chunks.
+    double splitting = 0.0, tokenizing = 0.0;
+    for (auto &chunk : tokenized) {
+      splitting += chunk.splitting;
+      tokenizing += chunk.tokenizing;
+    }
+    double scale = (splitting + tokenizing) > 0.0 ? elapsed / (splitting + tokenizing) : 0.0;
+    (*timings)[Stage::SENTENCE_SPLIT] = splitting * scale;
+    (*timings)[Stage::TOKENIZE] = tokenizing * scale + stopwatch.lap();
+  }
+}
+
+TextProcessor::TokenizedChunk TextProcessor::splitAndTokenize(std::string_view chunk, bool timed) const {
+  TokenizedChunk tokenized;
+
+  // Sentence splitting and tokenization take turns, so the time of each is added up sentence by sentence.
+  Stopwatch stopwatch;
+  auto sentenceStream = ug::ssplit::SentenceStream(chunk, ssplit_, ssplitMode_);
 
   std::string_view sentenceStringPiece;
 
   while (sentenceStream >> sentenceStringPiece) {
+    if (timed) tokenized.splitting += stopwatch.lap();
+
     marian::string_view sentence(sentenceStringPiece.data(), sentenceStringPiece.size());
 
     std::vector<string_view> wordRanges;
@@ -100,11 +207,15 @@ void TextProcessor::process(std::string &&input, AnnotatedText &source, Segments
     // There are some cases where SentencePiece or vocab returns no words
     // after normalization. 0 prevents any empty entries from being added.
     if (segment.size() > 0) {
-      // Wrap segment into sentences of at most maxLengthBreak_ tokens and
-      // tell source about them.
-      wrap(segment, wordRanges, segments, source);
+      tokenized.segments.push_back(std::move(segment));
+      tokenized.wordRanges.push_back(std::move(wordRanges));
     }
+
+    if (timed) tokenized.tokenizing += stopwatch.lap();
   }
+
+  if (timed) tokenized.splitting += stopwatch.lap();
+  return tokenized;
 }
 
 void TextProcessor::wrap(Segment &segment, std::vector<string_view> &wordRanges, Segments &segments,
@@ -115,12 +226,25 @@ void TextProcessor::wrap(Segment &segment, std::vector<string_view> &wordRanges,
   Word sourceEosId = vocabs_.sources().front()->getEosId();
   size_t wrapStep = maxLengthBreak_ - 1;
 
-  for (size_t offset = 0; offset < segment.size(); offset += wrapStep) {
+  // Offsets at which the wrapped segments start.
+  std::vector<size_t> starts;
+  if (wrapMode_ == WrapMode::FIXED || segment.size() <= wrapStep) {
+    for (size_t offset = 0; offset < segment.size(); offset += wrapStep) {
+      starts.push_back(offset);
+    }
+  } else {
+    std::vector<std::string_view> tokens;
+    tokens.reserve(wordRanges.size());
+    for (auto &range : wordRanges) tokens.emplace_back(range.data(), range.size());
+    starts = wrapPoints(tokens, wrapStep, wrapMode_);
+  }
+
+  for (size_t i = 0; i < starts.size(); i++) {
+    size_t offset = starts[i];
     auto start = segment.begin() + offset;
 
     // Restrict the range within bounds.
-    size_t left = segment.size() - offset;
-    size_t diff = std::min(wrapStep, left);
+    size_t diff = (i + 1 < starts.size() ? starts[i + 1] : segment.size()) - offset;
 
     segments.emplace_back(start, start + diff);
     segments.back().push_back(sourceEosId);
@@ -139,37 +263,42 @@ void TextProcessor::wrap(Segment &segment, std::vector<string_view> &wordRanges,
 }
 
 void TextProcessor::processFromAnnotation(AnnotatedText &source, Segments &segments) const {
-  std::string copySource = source.text;
-  AnnotatedText replacement(std::move(copySource));
+  // The text is taken over by the replacement rather than copied, only the sentence boundaries are needed from source.
+  Annotation sourceAnnotation = std::move(source.annotation);
+  AnnotatedText replacement(std::move(source.text));
 
-  for (size_t s = 0; s < source.numSentences(); s++) {
+  for (size_t s = 0; s < sourceAnnotation.numSentences(); s++) {
     // This is our sentenceStream
-    ByteRange sentenceByteRange = source.sentenceAsByteRange(s);
+    ByteRange sentenceByteRange = sourceAnnotation.sentence(s);
 
     // Fool tokenization using ByteRanges into looking at replacement. They're same, so okay.
     marian::string_view sentence{&replacement.text[sentenceByteRange.begin], sentenceByteRange.size()};
 
     std::vector<string_view> wordRanges;
-    Segment segment = tokenize(sentence, wordRanges);
+    segments.push_back(processSentence(sentence, wordRanges));
+    replacement.recordExistingSentence(wordRanges.begin(), wordRanges.end(), wordRanges.begin()->data());
+  }
 
-    // Manually add EoS
-    Word sourceEosId = vocabs_.sources().front()->getEosId();
-    segment.push_back(sourceEosId);
-
-    if (!wordRanges.empty()) {
-      string_view &last = wordRanges.back();  // this is a possible segfault if wordRanges is empty. So guard.
-      const char *end = last.data() + last.size();
-      wordRanges.emplace_back(end, 0);
-    } else {
-      const char *end = sentence.data() + sentence.size();
-      wordRanges.emplace_back(end, 0);
-    }
+  source = std::move(replacement);
+}
 
-    segments.push_back(std::move(segment));
-    replacement.recordExistingSentence(wordRanges.begin(), wordRanges.end(), wordRanges.begin()->data());
+Segment TextProcessor::processSentence(const string_view &sentence, std::vector<string_view> &wordRanges) const {
+  Segment segment = tokenize(sentence, wordRanges);
+
+  // Manually add EoS
+  Word sourceEosId = vocabs_.sources().front()->getEosId();
+  segment.push_back(sourceEosId);
+
+  if (!wordRanges.empty()) {
+    string_view &last = wordRanges.back();  // this is a possible segfault if wordRanges is empty. So guard.
+    const char *end = last.data() + last.size();
+    wordRanges.emplace_back(end, 0);
+  } else {
+    const char *end = sentence.data() + sentence.size();
+    wordRanges.emplace_back(end, 0);
   }
 
-  source = replacement;
+  return segment;
 }
 
 }  // namespace bergamot
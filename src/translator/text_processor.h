@@ -1,15 +1,20 @@
 #ifndef SRC_BERGAMOT_TEXT_PROCESSOR_H_
 #define SRC_BERGAMOT_TEXT_PROCESSOR_H_
 
+#include <optional>
+#include <string_view>
 #include <vector>
 
 #include "aligned.h"
 #include "annotation.h"
+#include "cache.h"
 #include "data/types.h"
 #include "data/vocab.h"
 #include "definitions.h"
 #include "ssplit.h"
+#include "timing.h"
 #include "vocabs.h"
+#include "wrap.h"
 
 namespace marian {
 namespace bergamot {
@@ -46,29 +51,54 @@ class TextProcessor {
   /// @param [out] source: AnnotatedText instance holding input and annotations of sentences and pieces
   /// @param [out] segments: marian::Word equivalents of the sentences processed and stored in AnnotatedText for
   /// consumption of marian translation pipeline.
-
-  void process(std::string &&blob, AnnotatedText &source, Segments &segments) const;
+  /// @param [out] timings: If set, the time spent on sentence splitting and tokenization is recorded here.
+  void process(std::string &&blob, AnnotatedText &source, Segments &segments, StageTimings *timings = nullptr) const;
 
   void processFromAnnotation(AnnotatedText &source, Segments &segments) const;
 
+  /// Processes a single sentence that is already split, like a sentence output by another model when pivoting. Unlike
+  /// process(), the sentence is not wrapped.
+  /// @param [in] sentence: Text of the sentence.
+  /// @param [out] tokenRanges: Byte-ranges of the tokens within sentence, ending with an empty one for EOS.
+  /// @returns marian::Word equivalent of the sentence, ending with EOS.
+  Segment processSentence(const string_view &sentence, std::vector<string_view> &tokenRanges) const;
+
  private:
   void parseCommonOptions(Ptr<Options> options);
 
   /// Tokenizes an input string, returns Words corresponding. Loads the
-  /// corresponding byte-ranges into tokenRanges.
+  /// corresponding byte-ranges into tokenRanges. Looks the input up in tokenizationCache_ first, if there is one.
   Segment tokenize(const string_view &input, std::vector<string_view> &tokenRanges) const;
 
-  /// Wrap into sentences of at most maxLengthBreak_ tokens and add to source.
+  /// Sentences of a part of the input, tokenized but not yet wrapped.
+  struct TokenizedChunk {
+    std::vector<Segment> segments;
+    std::vector<std::vector<string_view>> wordRanges;
+    double splitting{0.0};   ///< Seconds spent splitting sentences.
+    double tokenizing{0.0};  ///< Seconds spent tokenizing.
+  };
+
+  /// Splits chunk into sentences and tokenizes them. Sentences that tokenize to nothing are dropped. The time spent
+  /// on either is only measured if `timed`.
+  TokenizedChunk splitAndTokenize(std::string_view chunk, bool timed) const;
+
+  /// Wrap into sentences of at most maxLengthBreak_ tokens, as wrapMode_ says, and add to source.
   void wrap(Segment &sentence, std::vector<string_view> &tokenRanges, Segments &segments, AnnotatedText &source) const;
 
   const Vocabs &vocabs_;   ///< Vocabularies used to tokenize a sentence
   size_t maxLengthBreak_;  ///< Parameter used to wrap sentences to a maximum number of tokens
+  size_t parallelBytes_;   ///< Inputs at least this large are split in parallel parts (see HelperThreads), 0 disables.
+  WrapMode wrapMode_;      ///< How sentences longer than maxLengthBreak_ are cut.
 
   /// SentenceSplitter compatible with moses sentence-splitter
   ug::ssplit::SentenceSplitter ssplit_;
 
   /// Mode of splitting, can be line ('\n') based, paragraph based, also supports a wrapped mode.
   ug::ssplit::SentenceStream::splitmode ssplitMode_;
+
+  /// Tokenizations of recently seen sentences, if `tokenization-cache-size` is set. Repeated sentences, like those of
+  /// navigation menus and footers on web pages, then skip the vocabulary encoder.
+  mutable std::optional<TokenizationCache> tokenizationCache_;
 };
 
 }  // namespace bergamot
@@ -9,6 +9,7 @@
 #include "batching_pool.h"
 #include "common/options.h"
 #include "definitions.h"
+#include "metrics.h"
 #include "translation_model.h"
 
 namespace marian {
@@ -51,6 +52,9 @@ class ThreadsafeBatchingPool {
   // call `clear()` before `shutdown()`.
   void shutdown();
 
+  // Snapshot of the counters of the batching pool, read without taking the lock.
+  BatchingMetrics metrics() const { return backend_.metrics(); }
+
  private:
   BatchingPoolType backend_;
 
@@ -0,0 +1,104 @@
+#include "timing.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+
+namespace marian {
+namespace bergamot {
+
+const char *stageName(Stage stage) {
+  switch (stage) {
+    case Stage::HTML_PARSE:
+      return "html-parse";
+    case Stage::SENTENCE_SPLIT:
+      return "sentence-split";
+    case Stage::TOKENIZE:
+      return "tokenize";
+    case Stage::QUEUE:
+      return "queue";
+    case Stage::TRANSLATE:
+      return "translate";
+    case Stage::QUALITY_ESTIMATE:
+      return "quality-estimate";
+    case Stage::BUILD_RESPONSE:
+      return "build-response";
+    case Stage::HTML_RESTORE:
+      return "html-restore";
+  }
+  return "unknown";
+}
+
+void StageHistograms::record(const StageTimings &timings) {
+  for (size_t s = 0; s < kNumStages; s++) {
+    Stage stage = static_cast<Stage>(s);
+    if (stage == Stage::QUEUE) {
+      for (auto &sentence : timings.sentences) {
+        record(stage, sentence.queueWait);
+      }
+    } else {
+      record(stage, timings[stage]);
+    }
+  }
+}
+
+void StageHistograms::record(Stage stage, double seconds) {
+  uint64_t microseconds = static_cast<uint64_t>(std::max(seconds, 0.0) * 1e6);
+
+  // Index of the highest bit set, plus one: 0 goes in bucket 0, 1 in bucket 1, 2-3 in bucket 2 and so on.
+  size_t bucket = 0;
+  for (uint64_t value = microseconds; value > 0; value >>= 1) ++bucket;
+  bucket = std::min(bucket, kNumBuckets - 1);
+
+  Histogram &histogram = histograms_[static_cast<size_t>(stage)];
+  histogram.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+  histogram.totalMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+  histogram.count.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t StageHistograms::count(Stage stage) const {
+  return histograms_[static_cast<size_t>(stage)].count.load(std::memory_order_relaxed);
+}
+
+double StageHistograms::quantile(Stage stage, double q) const {
+  const Histogram &histogram = histograms_[static_cast<size_t>(stage)];
+
+  // Buckets may be updated while we read them, so count them here rather than relying on histogram.count.
+  uint64_t total = 0;
+  for (auto &bucket : histogram.buckets) total += bucket.load(std::memory_order_relaxed);
+  if (total == 0) return 0.0;
+
+  uint64_t rank = static_cast<uint64_t>(std::ceil(q * total));
+  uint64_t seen = 0;
+  for (size_t b = 0; b < kNumBuckets; b++) {
+    seen += histogram.buckets[b].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return std::ldexp(1.0, static_cast<int>(b)) * 1e-6;
+    }
+  }
+  return std::ldexp(1.0, static_cast<int>(kNumBuckets)) * 1e-6;
+}
+
+void StageHistograms::dump(std::ostream &out) const {
+  std::ios_base::fmtflags flags = out.flags();
+  std::streamsize precision = out.precision();
+
+  out << std::left << std::setw(18) << "stage" << std::right << std::setw(10) << "count" << std::setw(12) << "mean-ms"
+      << std::setw(12) << "p50-ms" << std::setw(12) << "p90-ms" << std::setw(12) << "p99-ms"
+      << "\n";
+  for (size_t s = 0; s < kNumStages; s++) {
+    Stage stage = static_cast<Stage>(s);
+    const Histogram &histogram = histograms_[s];
+    uint64_t count = histogram.count.load(std::memory_order_relaxed);
+    double mean = count > 0 ? histogram.totalMicroseconds.load(std::memory_order_relaxed) / 1e3 / count : 0.0;
+    out << std::left << std::setw(18) << stageName(stage) << std::right << std::setw(10) << count << std::fixed
+        << std::setprecision(3) << std::setw(12) << mean << std::setw(12) << quantile(stage, 0.50) * 1e3
+        << std::setw(12) << quantile(stage, 0.90) * 1e3 << std::setw(12) << quantile(stage, 0.99) * 1e3 << "\n";
+  }
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+}  // namespace bergamot
+}  // namespace marian
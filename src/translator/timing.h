@@ -0,0 +1,127 @@
+#ifndef SRC_BERGAMOT_TIMING_H_
+#define SRC_BERGAMOT_TIMING_H_
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace marian {
+namespace bergamot {
+
+typedef std::chrono::steady_clock Clock;
+
+/// Whether timing is compiled in. Without ENABLE_STAGE_TIMING, Stopwatch always reads 0 and requesting
+/// `ResponseOptions::timings` aborts.
+#ifdef ENABLE_STAGE_TIMING
+constexpr bool kStageTimingEnabled = true;
+#else
+constexpr bool kStageTimingEnabled = false;
+#endif
+
+/// Stages a request goes through, in order.
+enum class Stage : size_t {
+  HTML_PARSE,        ///< Taking the HTML out of the source, see HTML.
+  SENTENCE_SPLIT,    ///< Splitting the source into sentences.
+  TOKENIZE,          ///< Splitting sentences into subwords.
+  QUEUE,             ///< Waiting in the BatchingPool until a worker starts on a batch with the sentence.
+  TRANSLATE,         ///< Beam search and decoding of the translation.
+  QUALITY_ESTIMATE,  ///< Estimating the quality of the translation.
+  BUILD_RESPONSE,    ///< Putting the translated sentences together, see ResponseBuilder.
+  HTML_RESTORE,      ///< Putting the HTML back into the Response, see HTML::restore.
+};
+
+constexpr size_t kNumStages = static_cast<size_t>(Stage::HTML_RESTORE) + 1;
+
+/// Short name of a stage, e.g. "html-parse".
+const char *stageName(Stage stage);
+
+/// Measures time between laps. Reads 0 if timing is not compiled in, in which case it does not touch the clock.
+class Stopwatch {
+ public:
+  Stopwatch() { reset(); }
+
+  void reset() {
+    if constexpr (kStageTimingEnabled) start_ = Clock::now();
+  }
+
+  /// Seconds since construction or the previous lap.
+  double lap() {
+    if constexpr (kStageTimingEnabled) {
+      Clock::time_point now = Clock::now();
+      std::chrono::duration<double> elapsed = now - start_;
+      start_ = now;
+      return elapsed.count();
+    }
+    return 0.0;
+  }
+
+ private:
+  Clock::time_point start_;
+};
+
+/// Time a worker spent on a batch, or the share of it of a single sentence.
+struct WorkerTimings {
+  Clock::time_point started;    ///< When the worker started on the batch.
+  double translate{0.0};        ///< Seconds of beam search and decoding.
+  double qualityEstimate{0.0};  ///< Seconds of quality estimation.
+};
+
+/// Breakdown of where the time of a request went, see `ResponseOptions::timings`.
+struct StageTimings {
+  /// Time spent on a single sentence.
+  struct Sentence {
+    double queueWait{0.0};        ///< From the request being queued until a worker started on the sentence.
+    double translate{0.0};        ///< Share of beam search and decoding of the batch of the sentence.
+    double qualityEstimate{0.0};  ///< Share of quality estimation of the batch of the sentence.
+  };
+
+  /// Seconds spent in each stage, indexed by Stage. Workers translate sentences in batches, mixing requests, so
+  /// TRANSLATE and QUALITY_ESTIMATE are the share of this request: the time of each batch is split evenly across its
+  /// sentences. QUEUE is the longest wait of any sentence. Sentences found in the cache count as no time at all.
+  std::array<double, kNumStages> seconds{};
+
+  /// Per sentence of the request, in the order of the source.
+  std::vector<Sentence> sentences;
+
+  double &operator[](Stage stage) { return seconds[static_cast<size_t>(stage)]; }
+  double operator[](Stage stage) const { return seconds[static_cast<size_t>(stage)]; }
+};
+
+/// Distribution of stage times over many requests, with power of two buckets in microseconds. Safe to record into
+/// from multiple threads. QUEUE records the wait of every sentence, the other stages one value per request.
+class StageHistograms {
+ public:
+  static constexpr size_t kNumBuckets = 40;  ///< Bucket b holds times in [2^(b-1), 2^b) microseconds.
+
+  /// Adds the stages of a single request.
+  void record(const StageTimings &timings);
+
+  /// Adds a single time for a stage.
+  void record(Stage stage, double seconds);
+
+  /// Number of times recorded for a stage.
+  size_t count(Stage stage) const;
+
+  /// Upper bound of the bucket that holds quantile `q` (0 < q <= 1) of the times recorded for a stage, in seconds.
+  double quantile(Stage stage, double q) const;
+
+  /// Writes a line per stage with count, mean and the 50th, 90th and 99th percentiles in milliseconds.
+  void dump(std::ostream &out) const;
+
+ private:
+  struct Histogram {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalMicroseconds{0};
+    std::array<std::atomic<uint64_t>, kNumBuckets> buckets{};
+  };
+
+  std::array<Histogram, kNumStages> histograms_;
+};
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_TIMING_H_
@@ -13,6 +13,17 @@
 namespace marian {
 namespace bergamot {
 
+namespace {
+
+/// Gets the words of a translation for passing them on as they are to a model with the same vocabulary when pivoting.
+/// Like the output of TextProcessor, they need to end in EOS, which they do not if the translation was cut off.
+bool reusableWords(const TranslatedSentence &translation, Word eos, Words &words) {
+  words = std::get<0>(translation.history->top());
+  return !words.empty() && words.back() == eos;
+}
+
+}  // namespace
+
 std::atomic<size_t> TranslationModel::modelCounter_ = 0;
 
 TranslationModel::TranslationModel(const Config &options, MemoryBundle &&memory /*=MemoryBundle{}*/,
@@ -25,6 +36,10 @@ TranslationModel::TranslationModel(const Config &options, MemoryBundle &&memory
       batchingPool_(options),
       qualityEstimator_(createQualityEstimator(getQualityEstimatorModel(memory, options))) {
   ABORT_IF(replicas == 0, "At least one replica needs to be created.");
+  // Checked here rather than for each batch on the workers, where there is no one to report the error to.
+  ABORT_IF(qualityEstimator_->needsAlignments() && !options_->hasAndNotEmpty("alignment"),
+           "Quality estimation model uses attention entropy, which requires alignments from the translation model, "
+           "set alignment: soft");
   backend_.resize(replicas);
 
   // Try to load shortlist from memory-bundle. If not available, try to load from options_;
@@ -102,30 +117,94 @@ void TranslationModel::loadBackend(size_t idx) {
 // Make request process is shared between Async and Blocking workflow of translating.
 Ptr<Request> TranslationModel::makeRequest(size_t requestId, std::string &&source, CallbackType callback,
                                            const ResponseOptions &responseOptions,
-                                           std::optional<TranslationCache> &cache) {
+                                           std::optional<TranslationCache> &cache, SentenceCallback sentenceCallback) {
   Segments segments;
   AnnotatedText annotatedSource;
 
-  textProcessor_.process(std::move(source), annotatedSource, segments);
-  ResponseBuilder responseBuilder(responseOptions, std::move(annotatedSource), vocabs_, callback, *qualityEstimator_);
+  ABORT_IF(responseOptions.timings && !kStageTimingEnabled,
+           "Stage timings requested without enabling in builds. Please use -DENABLE_STAGE_TIMING with cmake.");
+  Ptr<StageTimings> timings = responseOptions.timings ? New<StageTimings>() : nullptr;
+
+  textProcessor_.process(std::move(source), annotatedSource, segments, timings.get());
+  ResponseBuilder responseBuilder(responseOptions, std::move(annotatedSource), callback, timings);
 
-  Ptr<Request> request =
-      New<Request>(requestId, /*model=*/*this, std::move(segments), std::move(responseBuilder), cache);
+  Ptr<Request> request = New<Request>(requestId, /*model=*/*this, std::move(segments), std::move(responseBuilder),
+                                      cache, std::move(sentenceCallback), timings);
   return request;
 }
 
 Ptr<Request> TranslationModel::makePivotRequest(size_t requestId, AnnotatedText &&previousTarget, CallbackType callback,
                                                 const ResponseOptions &responseOptions,
-                                                std::optional<TranslationCache> &cache) {
+                                                std::optional<TranslationCache> &cache,
+                                                const TranslatedSentences *previousTranslations) {
   Segments segments;
 
-  textProcessor_.processFromAnnotation(previousTarget, segments);
-  ResponseBuilder responseBuilder(responseOptions, std::move(previousTarget), vocabs_, callback, *qualityEstimator_);
+  if (previousTranslations != nullptr) {
+    ABORT_IF(previousTranslations->size() != previousTarget.numSentences(),
+             "Mismatch in pivot sentences and their translations");
+    Word eos = vocabs_.sources().front()->getEosId();
+    for (auto &translation : *previousTranslations) {
+      Words words;
+      if (!reusableWords(*translation, eos, words)) {
+        break;
+      }
+      segments.push_back(std::move(words));
+    }
+  }
+
+  // If the words could not be reused, tokenize the text of the previous translation. Otherwise, the tokens of
+  // previousTarget are exactly those words.
+  if (segments.size() != previousTarget.numSentences()) {
+    segments.clear();
+    textProcessor_.processFromAnnotation(previousTarget, segments);
+  }
+
+  ResponseBuilder responseBuilder(responseOptions, std::move(previousTarget), callback);
 
   Ptr<Request> request = New<Request>(requestId, *this, std::move(segments), std::move(responseBuilder), cache);
   return request;
 }
 
+Ptr<Request> TranslationModel::makePivotSentenceRequest(size_t requestId, Ptr<TranslatedSentence const> previous,
+                                                        bool reuseWords, PivotSentenceCallback callback,
+                                                        std::optional<TranslationCache> &cache) {
+  const AnnotatedText &previousTarget = previous->target;
+  assert(previousTarget.numSentences() == 1);
+  ByteRange sentenceRange = previousTarget.sentenceAsByteRange(0);
+
+  Segments segments;
+  std::vector<ByteRange> wordRanges;
+
+  Words words;
+  if (reuseWords && reusableWords(*previous, vocabs_.sources().front()->getEosId(), words)) {
+    // The tokens of the previous translation are exactly the words.
+    segments.push_back(std::move(words));
+    wordRanges.reserve(previousTarget.numWords(0));
+    for (size_t w = 0; w < previousTarget.numWords(0); w++) {
+      ByteRange word = previousTarget.wordAsByteRange(0, w);
+      wordRanges.push_back(ByteRange{word.begin - sentenceRange.begin, word.end - sentenceRange.begin});
+    }
+  } else {
+    string_view sentence = previousTarget.sentence(0);
+
+    std::vector<string_view> tokenRanges;
+    segments.push_back(textProcessor_.processSentence(sentence, tokenRanges));
+
+    wordRanges.reserve(tokenRanges.size());
+    for (auto &token : tokenRanges) {
+      size_t begin = token.data() - sentence.data();
+      wordRanges.push_back(ByteRange{begin, begin + token.size()});
+    }
+  }
+
+  auto onComplete = [callback, wordRanges = std::move(wordRanges)](TranslatedSentences &&translations) mutable {
+    callback(translations.front(), std::move(wordRanges));
+  };
+
+  Ptr<Request> request = New<Request>(requestId, *this, std::move(segments), std::move(onComplete), cache);
+  return request;
+}
+
 Ptr<marian::data::CorpusBatch> TranslationModel::convertToMarianBatch(Batch &batch) {
   std::vector<data::SentenceTuple> batchVector;
   auto &sentences = batch.sentences();
@@ -199,9 +278,56 @@ void TranslationModel::translateBatch(size_t deviceId, Batch &batch) {
     backend.initialized = true;
   }
 
+  WorkerTimings timings;
+  if constexpr (kStageTimingEnabled) timings.started = Clock::now();
+  Stopwatch stopwatch;
+
   BeamSearch search(options_, backend.scorerEnsemble, vocabs_.target());
   Histories histories = search.search(backend.graph, convertToMarianBatch(batch));
-  batch.completeBatch(histories);
+  timings.translate = stopwatch.lap();
+
+  TranslatedSentences translations = processHistories(histories, timings);
+  batch.completeBatch(translations, timings);
+}
+
+TranslatedSentences TranslationModel::processHistories(const Histories &histories, WorkerTimings &timings) const {
+  Stopwatch stopwatch;
+  std::vector<Ptr<TranslatedSentence>> sentences;
+  sentences.reserve(histories.size());
+
+  // Words of the target sentences of the whole batch, so their quality can be estimated in one go.
+  std::vector<std::vector<SubwordRange>> wordIndices;
+  wordIndices.reserve(histories.size());
+
+  for (auto &history : histories) {
+    // TODO(jerin): Change hardcode of nBest = 1
+    NBestList onebest = history->nBest(1);
+
+    Result result = onebest[0];  // Expecting only one result;
+    Words words = std::get<0>(result);
+
+    std::string decoded;
+    std::vector<string_view> targetSentenceMappings;
+    vocabs_.target()->decodeWithByteRanges(words, decoded, targetSentenceMappings, /*ignoreEOS=*/false);
+
+    auto sentence = New<TranslatedSentence>();
+    sentence->history = history;
+    sentence->target.appendSentence("", targetSentenceMappings.begin(), targetSentenceMappings.end());
+    sentence->words = mapWords(targetSentenceMappings);
+    wordIndices.push_back(sentence->words);
+    sentences.push_back(std::move(sentence));
+  }
+
+  timings.translate += stopwatch.lap();
+
+  std::vector<Response::SentenceQualityScore> qualityScores;
+  qualityEstimator_->computeQualityScores(histories, wordIndices, qualityScores);
+  for (size_t i = 0; i < sentences.size(); ++i) {
+    sentences[i]->qualityScore = std::move(qualityScores[i]);
+  }
+  timings.qualityEstimate = stopwatch.lap();
+
+  return TranslatedSentences(sentences.begin(), sentences.end());
 }
 
 }  // namespace bergamot
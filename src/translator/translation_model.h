@@ -12,6 +12,7 @@
 #include "data/shortlist.h"
 #include "definitions.h"
 #include "parser.h"
+#include "quality_estimator.h"
 #include "request.h"
 #include "text_processor.h"
 #include "translator/history.h"
@@ -69,12 +70,43 @@ class TranslationModel {
   /// @param [in] callback: Callback (from client) to be issued upon completion of translation of all sentences in the
   /// created Request.
   /// @param [in] responseOptions: Configuration used to prepare the Response corresponding to the created request.
+  /// @param [in] sentenceCallback: Optional callback issued with each sentence as soon as it is translated, see
+  /// Request.
   //  @returns Request created from the query parameters wrapped within a shared-pointer.
   Ptr<Request> makeRequest(size_t requestId, std::string&& source, CallbackType callback,
-                           const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache);
-
+                           const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache,
+                           SentenceCallback sentenceCallback = nullptr);
+
+  /// Make a Request to translate the output of another TranslationModel, when pivoting. The text is tokenized again
+  /// with this model's vocabulary, unless previousTranslations are given.
+  /// @param [in] previousTranslations: Optional translations of the sentences of previousTarget by the other model.
+  /// Only to be given if this model acceptsOutputOf() the other one: the words in them are then translated as they
+  /// are, and previousTarget keeps its annotation.
   Ptr<Request> makePivotRequest(size_t requestId, AnnotatedText&& previousTarget, CallbackType callback,
-                                const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache);
+                                const ResponseOptions& responseOptions, std::optional<TranslationCache>& cache,
+                                const TranslatedSentences* previousTranslations = nullptr);
+
+  /// Whether the source vocabulary of this model is the same as the target vocabulary of `previous`. If so, the words
+  /// `previous` outputs can be translated by this model without decoding and tokenizing them again when pivoting.
+  bool acceptsOutputOf(const TranslationModel& previous) const {
+    return vocabs_.sourceFingerprint() == previous.vocabs_.targetFingerprint();
+  }
+
+  /// Callback for makePivotSentenceRequest, with the translation of the sentence and the byte-ranges of the tokens the
+  /// sentence was split into by this model, relative to the start of the sentence.
+  typedef std::function<void(Ptr<TranslatedSentence const>, std::vector<ByteRange>&&)> PivotSentenceCallback;
+
+  /// Make a Request for a single sentence translated by another model, so that pivoting can continue with it while the
+  /// other model is still busy with the rest of the text. Unlike makePivotRequest, no Response is built: the
+  /// translation is passed to the callback as-is.
+  /// @param [in] requestId: Unique identifier associated with this request, available from Service.
+  /// @param [in] previous: Translation of the sentence by the previous model.
+  /// @param [in] reuseWords: Translate the words of `previous` as they are, rather than tokenizing its text. Only valid
+  /// if this model acceptsOutputOf() the previous one.
+  /// @param [in] callback: Callback to be issued with the translation of the sentence.
+  //  @returns Request created from the query parameters wrapped within a shared-pointer.
+  Ptr<Request> makePivotSentenceRequest(size_t requestId, Ptr<TranslatedSentence const> previous, bool reuseWords,
+                                        PivotSentenceCallback callback, std::optional<TranslationCache>& cache);
 
   /// Relays a request to the batching-pool specific to this translation model.
   /// @param [in] request: Request constructed through makeRequest
@@ -87,6 +119,15 @@ class TranslationModel {
   /// @returns number of sentences that constitute the Batch.
   size_t generateBatch(Batch& batch) { return batchingPool_.generateBatch(batch); }
 
+  /// Drops all sentences queued for translation with this model.
+  void clear() { batchingPool_.clear(); }
+
+  /// Maximum number of tokens in a batch for this model, including padding.
+  size_t miniBatchWords() const { return batchingPool_.miniBatchWords(); }
+
+  /// Snapshot of the sentences queued for this model and the batches made from them. Safe to call from any thread.
+  BatchingMetrics batchingMetrics() const { return batchingPool_.metrics(); }
+
   /// Translate a batch generated with generateBatch
   ///
   /// @param [in] deviceId: There are replicas of backend created for use in each worker thread. deviceId indicates
@@ -128,6 +169,12 @@ class TranslationModel {
   void loadBackend(size_t idx);
   Ptr<marian::data::CorpusBatch> convertToMarianBatch(Batch& batch);
 
+  /// Decodes the translated sentences and estimates their quality. This happens on the worker, right after translating
+  /// while the hypotheses are still hot in cache. It is done for every sentence regardless of the options of the
+  /// request, so translations that come from the cache later on have all of it available as well.
+  /// The time spent on decoding and on quality estimation is added to timings.
+  TranslatedSentences processHistories(const Histories& histories, WorkerTimings& timings) const;
+
   static std::atomic<size_t> modelCounter_;
 };
 
@@ -17,6 +17,8 @@ class Vocabs {
       auto vocabPaths = options->get<std::vector<std::string>>("vocabs");
       load(vocabPaths);
     }
+    sourceFingerprint_ = fingerprint(*srcVocabs_.front());
+    targetFingerprint_ = fingerprint(*trgVocab_);
   }
 
   /// Get all source vocabularies (as a vector)
@@ -25,11 +27,31 @@ class Vocabs {
   /// Get the target vocabulary
   const Ptr<Vocab const>& target() const { return trgVocab_; }
 
+  /// Hash of the (first) source vocabulary, see fingerprint().
+  size_t sourceFingerprint() const { return sourceFingerprint_; }
+
+  /// Hash of the target vocabulary, see fingerprint().
+  size_t targetFingerprint() const { return targetFingerprint_; }
+
  private:
   std::vector<Ptr<Vocab const>> srcVocabs_;  // source vocabularies
   Ptr<Vocab const> trgVocab_;                // target vocabulary
   Ptr<Options> options_;
 
+  size_t sourceFingerprint_{0};
+  size_t targetFingerprint_{0};
+
+  /// Hashes the tokens of a vocabulary in order of their ids. Vocabularies with the same fingerprint map the same ids
+  /// to the same tokens, even when they are loaded separately (e.g. by different models), so words can be passed from
+  /// one to the other without decoding them to text.
+  static size_t fingerprint(const Vocab& vocab) {
+    size_t seed = vocab.size();
+    for (size_t i = 0; i < vocab.size(); i++) {
+      util::hash_combine<size_t>(seed, std::hash<std::string>()(vocab[Word::fromWordIndex(i)]));
+    }
+    return seed;
+  }
+
   // load from buffer
   void load(std::vector<std::shared_ptr<AlignedMemory>>&& vocabMemories) {
     // At least two vocabs: src and trg
@@ -0,0 +1,103 @@
+#include "wrap.h"
+
+#include <algorithm>
+#include <cctype>
+
+#include "common/logging.h"
+
+namespace marian {
+namespace bergamot {
+
+namespace {
+
+/// Ranks how good a place the boundary just before tokens[i] is to cut at, the higher the better.
+int boundaryStrength(const std::vector<std::string_view> &tokens, size_t i) {
+  std::string_view previous = tokens[i - 1];
+  while (!previous.empty() && std::isspace(static_cast<unsigned char>(previous.back()))) {
+    previous.remove_suffix(1);
+  }
+
+  auto endsWith = [&previous](std::string_view suffix) {
+    return previous.size() >= suffix.size() && previous.substr(previous.size() - suffix.size()) == suffix;
+  };
+
+  // Sentence and clause ends, including the full-width forms used in CJK text.
+  for (std::string_view mark : {".", "!", "?", ";", ":", "。", "！", "？", "；", "："}) {
+    if (endsWith(mark)) return 3;
+  }
+  for (std::string_view mark : {",", ")", "]", "\"", "、", "，"}) {
+    if (endsWith(mark)) return 2;
+  }
+
+  // Between words: there is a gap between the tokens, or the next token takes the whitespace before it along.
+  std::string_view next = tokens[i];
+  bool gap = previous.data() + previous.size() != next.data();
+  if (gap || (!next.empty() && std::isspace(static_cast<unsigned char>(next.front())))) return 1;
+
+  return 0;
+}
+
+}  // namespace
+
+WrapMode parseWrapMode(const std::string &mode) {
+  if (mode == "fixed") {
+    return WrapMode::FIXED;
+  } else if (mode == "balanced") {
+    return WrapMode::BALANCED;
+  } else {
+    ABORT("Unknown wrap-mode {}, choose one of {{fixed,balanced}}", mode);
+  }
+}
+
+std::vector<size_t> wrapPoints(const std::vector<std::string_view> &tokens, size_t maxLength, WrapMode mode) {
+  ABORT_IF(maxLength == 0, "Cannot wrap into pieces of 0 tokens");
+  size_t numTokens = tokens.size();
+  std::vector<size_t> starts;
+  if (numTokens == 0) return starts;
+
+  if (mode == WrapMode::FIXED || numTokens <= maxLength) {
+    for (size_t start = 0; start < numTokens; start += maxLength) {
+      starts.push_back(start);
+    }
+    return starts;
+  }
+
+  // As many pieces as fixed wrapping makes, so that no more sentences are made than necessary.
+  size_t numPieces = (numTokens + maxLength - 1) / maxLength;
+  size_t window = std::max<size_t>(1, maxLength / 4);
+
+  starts.push_back(0);
+  for (size_t piece = 1; piece < numPieces; piece++) {
+    size_t previous = starts.back();
+    size_t remaining = numPieces - piece;  // Pieces after this cut.
+
+    // The cut has to leave the piece before it within maxLength, and room for at least one token per piece after it
+    // without any of them going over maxLength.
+    size_t lowest = std::max(previous + 1, numTokens - std::min(numTokens, remaining * maxLength));
+    size_t highest = std::min(previous + maxLength, numTokens - remaining);
+
+    // Where the cut would go to share what is left equally between the pieces from here.
+    size_t ideal = previous + (numTokens - previous + remaining) / (remaining + 1);
+    ideal = std::clamp(ideal, lowest, highest);
+
+    size_t from = std::max(lowest, ideal > window ? ideal - window : 0);
+    size_t to = std::min(highest, ideal + window);
+
+    size_t best = ideal;
+    int bestStrength = boundaryStrength(tokens, ideal);
+    for (size_t cut = from; cut <= to; cut++) {
+      int strength = boundaryStrength(tokens, cut);
+      size_t distance = cut > ideal ? cut - ideal : ideal - cut;
+      size_t bestDistance = best > ideal ? best - ideal : ideal - best;
+      if (strength > bestStrength || (strength == bestStrength && distance < bestDistance)) {
+        best = cut;
+        bestStrength = strength;
+      }
+    }
+    starts.push_back(best);
+  }
+  return starts;
+}
+
+}  // namespace bergamot
+}  // namespace marian
@@ -0,0 +1,36 @@
+#ifndef SRC_BERGAMOT_WRAP_H_
+#define SRC_BERGAMOT_WRAP_H_
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace marian {
+namespace bergamot {
+
+/// How a sentence with more tokens than fit in one is cut into several.
+enum class WrapMode {
+  /// Into pieces of exactly the maximum length, and what is left over. Cuts fall wherever they fall, often inside a
+  /// word, and all but the last piece are as long as can be.
+  FIXED,
+
+  /// Into as few pieces as fixed, but of near-equal length, with each cut moved to the nearby token boundary that is
+  /// the most natural place to break: after a sentence or clause ending punctuation mark, then after a comma or closing
+  /// bracket, then between words, and only then inside a word.
+  BALANCED,
+};
+
+/// Parses `fixed` or `balanced`, see the `wrap-mode` option.
+WrapMode parseWrapMode(const std::string &mode);
+
+/// Works out where to cut a sentence into pieces of at most maxLength tokens.
+/// @param [in] tokens: Text of the tokens of the sentence, as views into the same string.
+/// @param [in] maxLength: Maximum number of tokens in a piece, at least 1.
+/// @param [in] mode: How to choose the cuts.
+/// @returns Index of the first token of every piece, in order, starting with 0. Empty if there are no tokens.
+std::vector<size_t> wrapPoints(const std::vector<std::string_view> &tokens, size_t maxLength, WrapMode mode);
+
+}  // namespace bergamot
+}  // namespace marian
+
+#endif  // SRC_BERGAMOT_WRAP_H_
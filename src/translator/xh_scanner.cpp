@@ -5,10 +5,109 @@
 
 #include <cassert>
 #include <cctype>
+#include <cstdint>
 #include <cstring>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define XH_SCANNER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define XH_SCANNER_SSE2
+#endif
+
+#if defined(_MSC_VER) && (defined(XH_SCANNER_AVX2) || defined(XH_SCANNER_SSE2))
+#include <intrin.h>
+#endif
+
 namespace {
 
+// True if `c` is one of `Needles`.
+template <char... Needles>
+inline bool isAnyOf(char c) {
+  return ((c == Needles) || ...);
+}
+
+#if defined(XH_SCANNER_AVX2) || defined(XH_SCANNER_SSE2)
+
+inline unsigned countTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+#if defined(XH_SCANNER_AVX2)
+constexpr size_t kBlockSize = 32;
+
+// Bitmask with bit i set if byte i of the 32-byte block at `p` is one of `Needles`.
+template <char... Needles>
+inline uint32_t matchBlock(const char *p) {
+  const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+  __m256i hits = _mm256_setzero_si256();
+  ((hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, _mm256_set1_epi8(Needles)))), ...);
+  return static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+}
+#else
+constexpr size_t kBlockSize = 16;
+
+// Bitmask with bit i set if byte i of the 16-byte block at `p` is one of `Needles`.
+template <char... Needles>
+inline uint32_t matchBlock(const char *p) {
+  const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+  __m128i hits = _mm_setzero_si128();
+  ((hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, _mm_set1_epi8(Needles)))), ...);
+  return static_cast<uint32_t>(_mm_movemask_epi8(hits));
+}
+#endif
+
+constexpr uint32_t kBlockMask = kBlockSize == 32 ? ~uint32_t(0) : (uint32_t(1) << kBlockSize) - 1;
+
+#endif  // XH_SCANNER_AVX2 || XH_SCANNER_SSE2
+
+// Returns a pointer to the first character in [p, end) that is (or, if
+// `Negate`, is not) one of `Needles`, or `end` if there is none. Whole blocks
+// are tested with SIMD compares; the remaining tail (and builds without SSE2)
+// fall back to testing one character at a time. Never reads beyond `end`.
+template <bool Negate, char... Needles>
+inline const char *findFirst(const char *p, const char *end) {
+#if defined(XH_SCANNER_AVX2) || defined(XH_SCANNER_SSE2)
+  for (; end - p >= static_cast<std::ptrdiff_t>(kBlockSize); p += kBlockSize) {
+    uint32_t mask = matchBlock<Needles...>(p);
+    if (Negate) mask = ~mask & kBlockMask;
+    if (mask) return p + countTrailingZeros(mask);
+  }
+#endif
+  for (; p < end; ++p)
+    if (isAnyOf<Needles...>(*p) != Negate) return p;
+  return end;
+}
+
+// First character in [p, end) that is one of `Needles`.
+template <char... Needles>
+inline const char *findAnyOf(const char *p, const char *end) {
+  return findFirst<false, Needles...>(p, end);
+}
+
+// First character in [p, end) that is not one of `Needles`.
+template <char... Needles>
+inline const char *findNoneOf(const char *p, const char *end) {
+  return findFirst<true, Needles...>(p, end);
+}
+
+// Advances `input` to the first occurrence of any of `Needles` (or its end)
+// and returns the number of characters skipped.
+template <char... Needles>
+inline size_t skipUntil(markup::instream &input) {
+  const char *stop = findAnyOf<Needles...>(input.pos(), input.end);
+  size_t skipped = stop - input.pos();
+  input.seek(stop);
+  return skipped;
+}
+
 // Simple replacement for string_view.ends_with(compile-time C string)
 template <typename Char_t, size_t Len>
 inline bool endsWith(markup::string_ref &str, const Char_t (&suffix)[Len]) {
@@ -68,18 +167,18 @@ Scanner::TokenType Scanner::scanBody() {
       return scanEntity(TT_TEXT);
   }
 
-  while (true) {
-    switch (input_.peek()) {
-      case '\0':
-      case '<':
-      case '&':
-        return TT_TEXT;
-      default:
-        input_.consume();
-        ++value_.size;
-        break;
-    }
-  }
+  // Text runs until the next tag or entity. '\0' stops it too, which is what
+  // `peek()` would have returned at the end of the input.
+  value_.size += skipUntil<'<', '&', '\0'>(input_);
+  return TT_TEXT;
+}
+
+bool Scanner::isSpecial(std::string_view tag) {
+  string_ref name{tag.data(), tag.size()};
+  return /*equalsCaseInsensitive(name, "title") ||*/ equalsCaseInsensitive(name, "script") ||
+         equalsCaseInsensitive(name, "style") || equalsCaseInsensitive(name, "textarea") ||
+         equalsCaseInsensitive(name, "iframe") || equalsCaseInsensitive(name, "noembed") ||
+         equalsCaseInsensitive(name, "noscript") || equalsCaseInsensitive(name, "noframes");
 }
 
 // Consumes one or closing bit of a tag:
@@ -106,10 +205,7 @@ Scanner::TokenType Scanner::scanAttribute() {
       input_.consume();
 
       // Treat some elements as opaque, e.g. <script>, <style>
-      if (/*equalsCaseInsensitive(tagName_, "title") ||*/ equalsCaseInsensitive(tagName_, "script") ||
-          equalsCaseInsensitive(tagName_, "style") || equalsCaseInsensitive(tagName_, "textarea") ||
-          equalsCaseInsensitive(tagName_, "iframe") || equalsCaseInsensitive(tagName_, "noembed") ||
-          equalsCaseInsensitive(tagName_, "noscript") || equalsCaseInsensitive(tagName_, "noframes")) {
+      if (isSpecial(tag())) {
         // script is special because we want to parse the attributes,
         // but not the content
         scanFun_ = &Scanner::scanSpecial;
@@ -135,7 +231,10 @@ Scanner::TokenType Scanner::scanAttribute() {
 
   // attribute name...
   while (input_.peek() != '=') {
+    attributeName_.size += skipUntil<'=', '\0', '>', '<', ' ', '\t', '\n', '\r', '\f'>(input_);
     switch (input_.peek()) {
+      case '=':
+        break;
       case '\0':
         return TT_EOF;
       case '>':
@@ -143,15 +242,10 @@ Scanner::TokenType Scanner::scanAttribute() {
       case '<':
         return TT_ERROR;
       default:
-        if (skipWhitespace()) {
-          if (input_.peek() == '=') {
-            break;
-          } else {
-            return TT_ATTRIBUTE;  // attribute without value (HTML style) but not yet at end of tag
-          }
-        }
-        input_.consume();
-        ++attributeName_.size;
+        // whitespace: either followed by '=', or this is an attribute without
+        // value (HTML style) but not yet at end of tag
+        skipWhitespace();
+        if (input_.peek() != '=') return TT_ATTRIBUTE;
         break;
     }
   }
@@ -167,28 +261,16 @@ Scanner::TokenType Scanner::scanAttribute() {
     case '\'':
       quote = input_.consume();
       value_ = string_ref{input_.pos(), 0};
-      while (true) {
-        if (input_.peek() == '\0') {
-          return TT_ERROR;
-        } else if (input_.peek() == quote) {
-          input_.consume();
-          return TT_ATTRIBUTE;
-        } else {
-          input_.consume();
-          ++value_.size;
-        }
-      }
-      break;
+      value_.size += quote == '"' ? skipUntil<'"', '\0'>(input_) : skipUntil<'\'', '\0'>(input_);
+      if (input_.peek() != quote) return TT_ERROR;  // '\0' or end of input
+      input_.consume();
+      return TT_ATTRIBUTE;
     default:
       value_ = string_ref{input_.pos(), 0};
-
-      while (true) {
-        if (isWhitespace(input_.peek())) return TT_ATTRIBUTE;
-        if (input_.peek() == '>') return TT_ATTRIBUTE;  // '>' will be consumed next round
-        input_.consume();
-        ++value_.size;
-      }
-      break;
+      // Unquoted value ends at whitespace or '>' ('>' will be consumed next
+      // round). At the end of input the next round will yield TT_EOF.
+      value_.size += skipUntil<'>', ' ', '\t', '\n', '\r', '\f'>(input_);
+      return TT_ATTRIBUTE;
   }
 
   // How did we end up here?!
@@ -308,11 +390,9 @@ bool Scanner::resolveEntity(string_ref const &buffer, string_ref &decoded) const
 // skip whitespaces.
 // returns how many whitespaces were skipped
 size_t Scanner::skipWhitespace() {
-  size_t skipped = 0;
-  while (isWhitespace(input_.peek())) {
-    input_.consume();
-    ++skipped;
-  }
+  const char *stop = findNoneOf<' ', '\t', '\n', '\r', '\f'>(input_.pos(), input_.end);
+  size_t skipped = stop - input_.pos();
+  input_.seek(stop);
   return skipped;
 }
 
@@ -332,6 +412,8 @@ Scanner::TokenType Scanner::scanComment() {
   value_ = string_ref{input_.pos(), 0};
 
   while (true) {
+    // Only a '>' can complete the tail, so jump straight to the next one.
+    value_.size += skipUntil<'>', '\0'>(input_);
     if (input_.consume() == '\0') return TT_EOF;
     ++value_.size;
 
@@ -356,6 +438,8 @@ Scanner::TokenType Scanner::scanProcessingInstruction() {
   value_ = string_ref{input_.pos(), 0};
 
   while (true) {
+    // Only a '>' can complete the tail, so jump straight to the next one.
+    value_.size += skipUntil<'>', '\0'>(input_);
     if (input_.consume() == '\0') return TT_EOF;
     ++value_.size;
 
@@ -380,6 +464,7 @@ Scanner::TokenType Scanner::scanSpecial() {
   value_ = string_ref{input_.pos(), 0};
 
   while (true) {
+    value_.size += skipUntil<'>', '\0'>(input_);
     if (input_.consume() == '\0') return TT_EOF;
     ++value_.size;
 
@@ -20,6 +20,7 @@ struct instream {
   char consume() { return p < end ? *p++ : 0; }
   char peek() const { return p < end ? *p : 0; }
   const char *pos() const { return p; }
+  void seek(const char *pos) { p = pos; }
 };
 
 // Think string_view, but with a mutable range
@@ -101,6 +102,17 @@ class Scanner {
 
   inline const char *start() const { return start_; }
 
+  // whether the content of element `tag` is not scanned as HTML but returned
+  // as a single TT_DATA token, e.g. <script> and <style>
+  static bool isSpecial(std::string_view tag);
+
+  // whether the scanner is inside a comment, processing instruction or the
+  // content of a special element, where it only looks for the end of those
+  bool inContent() const {
+    return scanFun_ == &Scanner::scanComment || scanFun_ == &Scanner::scanProcessingInstruction ||
+           scanFun_ == &Scanner::scanSpecial;
+  }
+
  private: /* methods */
   typedef TokenType (Scanner::*ScanPtr)();
 
@@ -11,9 +11,23 @@
 
 using Response = marian::bergamot::Response;
 using ByteRange = marian::bergamot::ByteRange;
+using Alignment = marian::bergamot::Alignment;
 
 using namespace emscripten;
 
+// Returns the alignment scores of a sentence as `{rows, cols, data}`, with
+// `data` a Float32Array of `rows * cols` scores in row-major order. `data` is a
+// view into the response, so it is only valid as long as the response is, and
+// until the WASM memory grows. Copy it (`data.slice()`) to keep it longer.
+val getAlignment(const Response &response, size_t sentenceIdx) {
+  const Alignment &alignment = response.alignments[sentenceIdx];
+  val out = val::object();
+  out.set("rows", alignment.rows());
+  out.set("cols", alignment.cols());
+  out.set("data", val(typed_memory_view(alignment.rows() * alignment.cols(), alignment.data())));
+  return out;
+}
+
 // Binding code
 EMSCRIPTEN_BINDINGS(byte_range) {
   value_object<ByteRange>("ByteRange").field("begin", &ByteRange::begin).field("end", &ByteRange::end);
@@ -26,7 +40,8 @@ EMSCRIPTEN_BINDINGS(response) {
       .function("getOriginalText", &Response::getOriginalText)
       .function("getTranslatedText", &Response::getTranslatedText)
       .function("getSourceSentence", &Response::getSourceSentenceAsByteRange)
-      .function("getTranslatedSentence", &Response::getTargetSentenceAsByteRange);
+      .function("getTranslatedSentence", &Response::getTargetSentenceAsByteRange)
+      .function("getAlignment", &getAlignment);
 
   register_vector<Response>("VectorResponse");
 }